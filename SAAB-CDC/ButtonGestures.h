@@ -0,0 +1,203 @@
+/*
+ * C++ template for telling button gestures apart on SAAB I-Bus button frames
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef BUTTONGESTURES_H
+#define BUTTONGESTURES_H
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+/**
+ * A module declares the buttons it wants gestures for as a constexpr table:
+ *
+ *      constexpr ButtonGesture buttons[] = {
+ *          {STEERING_WHEEL_BUTTONS, 4, 0x04, 0, 0, BUTTON_LONG_PRESS, 0, 0, BUTTON_RELEASE_TIMEOUT, &wheelNxtGesture},
+ *          ...
+ *      };
+ *      ButtonGestures<COUNT> gestures(buttons);
+ *
+ * hands every button frame to onFrame() and calls run() from its loop.
+ * Each entry has its own slot, so buttons on different frames (or different
+ * buttons on the same one) never disturb each other. Times come from the
+ * frame timestamps, not from how many frames arrived:
+ *
+ *      GESTURE_LONG    held for longPress ms
+ *      GESTURE_REPEAT  every repeat ms while still held after that
+ *      GESTURE_DOUBLE  pressed again within doublePress ms of letting go
+ *      GESTURE_SHORT   let go before longPress; with doublePress set only
+ *                      once the double press window has passed
+ *
+ * A button counts as pressed while its frames carry its code, and as let go
+ * when a frame of the same ID carries something else or when none has come
+ * for the entry's release ms. That has to be longer than the gap between
+ * the frames of a held button, or a long press falls apart into short ones.
+ * An event frame (byte 0 = 0x80) always starts a new press.
+ */
+
+enum Gesture {
+    GESTURE_SHORT,
+    GESTURE_LONG,
+    GESTURE_REPEAT,
+    GESTURE_DOUBLE
+};
+
+typedef void (*GestureFn)(Gesture gesture);
+
+struct ButtonGesture {
+    uint16_t id;                // Frame the button comes in
+    uint8_t byte;               // Data byte that holds the button code
+    uint8_t code;
+    uint8_t subByte;            // Second data byte that has to match as well, 0 = none
+    uint8_t subCode;
+    uint16_t longPress;         // ms, 0 = no GESTURE_LONG
+    uint16_t repeat;            // ms, 0 = no GESTURE_REPEAT
+    uint16_t doublePress;       // ms, 0 = no GESTURE_DOUBLE
+    uint16_t release;           // ms without a frame before a held button counts as let go
+    GestureFn action;
+};
+
+#define BUTTON_EVENT_FRAME      0x80
+
+template <uint8_t COUNT>
+class ButtonGestures
+{
+    static_assert(COUNT >= 1 && COUNT <= 8, "ButtonGestures keeps its slots in 8 bit masks");
+
+public:
+    ButtonGestures(const ButtonGesture *table) : table(table), held(0), longSent(0), doubled(0), pending(0) {}
+
+    // time is the frame's micros() timestamp
+    void onFrame(uint16_t id, const uint8_t *data, uint32_t time) {
+        bool event = (data[0] == BUTTON_EVENT_FRAME);
+        for (uint8_t i = 0; i < COUNT; i++) {
+            const ButtonGesture &button = table[i];
+            if (button.id != id) {
+                continue;
+            }
+            uint8_t bit = (1 << i);
+            bool match = data[button.byte] == button.code && (!button.subByte || data[button.subByte] == button.subCode);
+            if (match) {
+                if (event || !(held & bit)) {
+                    press(i, time);
+                }
+                seen[i] = time;
+                check(i, time);
+            }
+            else if (held & bit) {
+                release(i, time);
+            }
+        }
+    }
+
+    // Long presses, repeats and let go buttons that no frame tells us about; now is micros()
+    void run(uint32_t now) {
+        if (!(held | pending)) {
+            return;
+        }
+        for (uint8_t i = 0; i < COUNT; i++) {
+            uint8_t bit = (1 << i);
+            if (held & bit) {
+                if (now - seen[i] > table[i].release * 1000UL) {
+                    release(i, seen[i]);
+                }
+                else {
+                    check(i, now);
+                }
+            }
+            if ((pending & bit) && now - at[i] > table[i].doublePress * 1000UL) {
+                pending &= ~bit;
+                table[i].action(GESTURE_SHORT);
+            }
+        }
+    }
+
+    bool isHeld(uint8_t i) const { return held & (1 << i); }
+
+    static uint8_t count() { return COUNT; }
+
+private:
+    void press(uint8_t i, uint32_t time) {
+        uint8_t bit = (1 << i);
+        if (held & bit) {
+            release(i, time);
+        }
+        held |= bit;
+        longSent &= ~bit;
+        doubled &= ~bit;
+        if (pending & bit) {
+            pending &= ~bit;
+            if (time - at[i] <= table[i].doublePress * 1000UL) {
+                doubled |= bit;
+                table[i].action(GESTURE_DOUBLE);
+            }
+            else {
+                table[i].action(GESTURE_SHORT);
+            }
+        }
+        at[i] = time;
+    }
+
+    void check(uint8_t i, uint32_t now) {
+        uint8_t bit = (1 << i);
+        const ButtonGesture &button = table[i];
+        if (!(held & bit) || (doubled & bit) || !button.longPress) {
+            return;
+        }
+        if (!(longSent & bit)) {
+            if (now - at[i] >= button.longPress * 1000UL) {
+                longSent |= bit;
+                repeatAt[i] = at[i] + button.longPress * 1000UL;
+                button.action(GESTURE_LONG);
+            }
+        }
+        else if (button.repeat && now - repeatAt[i] >= button.repeat * 1000UL) {
+            repeatAt[i] += button.repeat * 1000UL;
+            button.action(GESTURE_REPEAT);
+        }
+    }
+
+    void release(uint8_t i, uint32_t time) {
+        uint8_t bit = (1 << i);
+        held &= ~bit;
+        if ((longSent | doubled) & bit) {
+            return;
+        }
+        if (table[i].doublePress) {
+            pending |= bit;
+            at[i] = time;
+        }
+        else {
+            table[i].action(GESTURE_SHORT);
+        }
+    }
+
+    const ButtonGesture *table;
+    uint8_t held;               // Bit i: button i is down
+    uint8_t longSent;           // Bit i: GESTURE_LONG has gone out for this press
+    uint8_t doubled;            // Bit i: this press was the second of a double press
+    uint8_t pending;            // Bit i: let go after a short press, a second one may still follow
+    uint32_t at[COUNT];         // micros() of the press, or of letting go while pending
+    uint32_t seen[COUNT];       // micros() of the last frame with the button down
+    uint32_t repeatAt[COUNT];   // micros() of the last GESTURE_LONG/GESTURE_REPEAT
+};
+
+#endif
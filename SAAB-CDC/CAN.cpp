@@ -24,196 +24,241 @@
 #include <WProgram.h>
 #endif
 
+#include <avr/interrupt.h>
 #include "CAN.h"
+#include "CANBitTiming.h"
 
 #define DEBUGMODE	0
 
+#if (CAN_SPI_STATISTICS==1)
+#define SPI_STATISTICS_OP(op)       _spiOp = (op)
+#define SPI_STATISTICS_CALL(op)     { _spiOp = (op); _spiOpCalls[op]++; }
+#else
+#define SPI_STATISTICS_OP(op)
+#define SPI_STATISTICS_CALL(op)
+#endif
+
 
 /******************************************************************************
  * Variables
  ******************************************************************************/
-CANClass CAN;
-CANClass::msgCAN CAN_TxMsg;
-CANClass::msgCAN CAN_RxMsg;
+CANClass CAN(CAN_PINS(MCP2515_CS, MCP2515_INT, MCP2515_INT_NUM));
+#if defined(MCP2515_PBUS_CS)
+#ifndef MCP2515_PBUS_INT_NUM
+#define MCP2515_PBUS_INT_NUM    CAN_INT_NONE
+#endif
+CANClass PBUS(CAN_PINS(MCP2515_PBUS_CS, MCP2515_PBUS_INT, MCP2515_PBUS_INT_NUM));
+#endif
+
+uint8_t CANClass::_intBits = 0;
 
 
 /******************************************************************************
- * Constructors
+ * Bit timing, see CANBitTiming.h
+ ******************************************************************************/
+typedef CANBitTiming<MCP2515_OSC_FREQ, 47619, 760>     CAN_TIMING_47K;     // SAAB I-Bus
+typedef CANBitTiming<MCP2515_OSC_FREQ, 100000, 875>    CAN_TIMING_100K;
+typedef CANBitTiming<MCP2515_OSC_FREQ, 125000, 875>    CAN_TIMING_125K;
+typedef CANBitTiming<MCP2515_OSC_FREQ, 250000, 875>    CAN_TIMING_250K;
+// SAAB P-Bus; an 8 MHz oscillator only leaves 8 TQ per bit, not enough for 87.5%
+typedef CANBitTiming<MCP2515_OSC_FREQ, 500000, (MCP2515_OSC_FREQ >= 16000000UL) ? 875 : 750> CAN_TIMING_500K;
+#if (MCP2515_OSC_FREQ >= 16000000UL)
+typedef CANBitTiming<MCP2515_OSC_FREQ, 1000000, 750>   CAN_TIMING_1M;
+#endif
+
+#if (MCP2515_OSC_FREQ == 16000000UL)
+// The I-Bus timing the CDC has always run with: 21 TQ of 1 us, SJW 4, sampled at 76.19%
+static_assert(CAN_TIMING_47K::cnf1 == 0xC7 && CAN_TIMING_47K::cnf2 == 0xBE && CAN_TIMING_47K::cnf3 == 0x04,
+              "I-Bus bit timing differs from the proven CNF1/2/3 = C7/BE/04");
+#endif
+
+
+/******************************************************************************
+ * Interrupt
  ******************************************************************************/
+#ifdef MCP2515_INT_VECT
+ISR(MCP2515_INT_VECT)
+{
+    CAN.handleInterrupt();
+}
+#endif
+
+#ifdef MCP2515_PBUS_INT_VECT
+ISR(MCP2515_PBUS_INT_VECT)
+{
+    PBUS.handleInterrupt();
+}
+#endif
+
 
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+// ----------------------------------------------------------------------------
+/*
+ Name: CANClass(pins)
+ Parameters(type):
+	pins(CANPins): CS and INT pins of this MCP2515, see CAN_PINS()
+ Description:
+	One instance per MCP2515. All of them share the SPI bus, so CS goes
+	high right away: a controller that is not begin() yet must not take
+	the other one's SPI traffic for its own.
+ Example:
+	CANClass PBUS(CAN_PINS(MCP2515_PBUS_CS, MCP2515_PBUS_INT, CAN_INT_NONE));
+ */
+CANClass::CANClass(const CANPins &pins) : _pins(pins)
+{
+    *_pins.csPort |= (1 << _pins.csBit);
+    *(_pins.csPort - 1) |= (1 << _pins.csBit);
+}
 
 
 
 /******************************************************************************
  * PUBLIC METHODS
  ******************************************************************************/
+// ----------------------------------------------------------------------------
+/*
+ Name: begin(speed)
+ Parameters(type):
+	speed(uint16_t): bitrate in kbit/s; 47 (47.619, SAAB I-Bus), 100, 125,
+	250, 500 or 1 for 1 Mbit/s (1 Mbit/s needs a 16 MHz or faster oscillator)
+ Description:
+	Initializes the MCP2515 with bit timing solved at compile time for
+	MCP2515_OSC_FREQ. Any other speed falls back to the fastest one.
+ Returns:
+	Nothing
+ Example:
+	CAN.begin(47);
+ 
+ */
 void CANClass::begin(uint16_t speed)
 {
-    
-#if (DEBUGMODE==1)
-    Serial.println(F("-- Constructor Can(uint16_t speed) --"));
-#endif
-    
-    SET(MCP2515_CS);
-    SET_OUTPUT(MCP2515_CS);
-    
-    RESET(P_SCK);
-    RESET(P_MOSI);
-    RESET(P_MISO);
-    
-    SET_OUTPUT(P_SCK);
-    SET_OUTPUT(P_MOSI);
-    SET_INPUT(P_MISO);
-    
-    SET_INPUT(MCP2515_INT);
-    SET(MCP2515_INT);
-    
-    // We activate the SPI Arduino as Master and Fosc/2=8 MHz
-    SPCR = (1<<SPE)|(1<<MSTR) | (0<<SPR1)|(0<<SPR0);
-    SPSR = (1<<SPI2X);
-#if (DEBUGMODE==1)
-    Serial.println(F("SPI=8 Mhz"));
-#endif
-    
-    
-    
-    // reset MCP2515 by software reset.
-    // After this he is in configuration mode.
-    RESET(MCP2515_CS);
-    spi_putc(SPI_RESET);
-    SET(MCP2515_CS);
-    
-    // wait a little bit until the MCP2515 has restarted
-    _delay_us(10);
-    
-    
-    
     switch(speed)
     {
         case 47:
-            /*
-             Supposed to use...?
-             SJW = 1
-             SP% ~= 75
-            */
-            //Original CNF values
-             mcp2515_write_register(CNF1,0xC7);
-             mcp2515_write_register(CNF2,0xBE);
-             mcp2515_write_register(CNF3,0x04);
-            /*
-             T1   = 16
-             T2   = 5
-             BTQ  = 21
-             SP%  = 76.19
-             SJW  = 4
-             Err% = 0
-             */
-            
-            /*
-             // Version 1
-             mcp2515_write_register(CNF1,0x4B);
-             mcp2515_write_register(CNF2,0xF1);
-             mcp2515_write_register(CNF3,0x03);
-             
-             T1   = 14
-             T2   = 7
-             BTQ  = 21
-             SP%  = 66.67
-             SJW  = 4
-             Err% = 0
-             
-             
-             // Version 2
-             mcp2515_write_register(CNF1,0xC7);
-             mcp2515_write_register(CNF2,0xFE);
-             mcp2515_write_register(CNF3,0x44);
-             
-             T1   = 16
-             T2   = 8
-             BTQ  = 24
-             SP%  = 66.67
-             SJW  = 1
-             Err% = 0
-             */
-            /*
-            // Version 3
-            mcp2515_write_register(CNF1,0xC7);
-            mcp2515_write_register(CNF2,0xBE);
-            mcp2515_write_register(CNF3,0x44);
-             T1   = 10
-             T2   = 4
-             BTQ  = 14
-             SP%  = 71.4
-             SJW  = 2
-             Err% = 0
-             */
-            
 #if (DEBUGMODE==1)
             Serial.println(F("Speed = 47.619Kbps"));
 #endif
+            begin(CAN_TIMING_47K::cnf1, CAN_TIMING_47K::cnf2, CAN_TIMING_47K::cnf3);
             break;
             
-        case 1:
-            mcp2515_write_register(CNF1,0x00);
-            mcp2515_write_register(CNF2,0x90);
-            mcp2515_write_register(CNF3,0x02);
+        case 100:
 #if (DEBUGMODE==1)
-            Serial.println(F("Speed = 1Mbps"));
+            Serial.println(F("Speed = 100Kbps"));
 #endif
+            begin(CAN_TIMING_100K::cnf1, CAN_TIMING_100K::cnf2, CAN_TIMING_100K::cnf3);
             break;
             
-        case 500:
-            mcp2515_write_register(CNF1,0x01);
-            mcp2515_write_register(CNF2,0x90);
-            mcp2515_write_register(CNF3,0x02);
+        case 125:
 #if (DEBUGMODE==1)
-            Serial.println(F("Speed = 500Kbps"));
+            Serial.println(F("Speed = 125Kbps"));
 #endif
+            begin(CAN_TIMING_125K::cnf1, CAN_TIMING_125K::cnf2, CAN_TIMING_125K::cnf3);
             break;
             
         case 250:
-            mcp2515_write_register(CNF1,0x01);
-            mcp2515_write_register(CNF2,0xB8);
-            mcp2515_write_register(CNF3,0x05);
 #if (DEBUGMODE==1)
             Serial.println(F("Speed = 250Kbps"));
 #endif
+            begin(CAN_TIMING_250K::cnf1, CAN_TIMING_250K::cnf2, CAN_TIMING_250K::cnf3);
             break;
             
-        case 125:
-            mcp2515_write_register(CNF1,0x07);
-            mcp2515_write_register(CNF2,0x90);
-            mcp2515_write_register(CNF3,0x02);
+        case 500:
 #if (DEBUGMODE==1)
-            Serial.println(F("Speed = 125Kbps"));
+            Serial.println(F("Speed = 500Kbps"));
 #endif
+            begin(CAN_TIMING_500K::cnf1, CAN_TIMING_500K::cnf2, CAN_TIMING_500K::cnf3);
             break;
             
-        case 100:
-            mcp2515_write_register(CNF1,0x03);
-            mcp2515_write_register(CNF2,0xBA);
-            mcp2515_write_register(CNF3,0x07);
+#if (MCP2515_OSC_FREQ >= 16000000UL)
+        case 1:
+        default:
 #if (DEBUGMODE==1)
-            Serial.println(F("Speed = 100Kbps"));
+            Serial.println(F("Speed = 1Mbps"));
 #endif
+            begin(CAN_TIMING_1M::cnf1, CAN_TIMING_1M::cnf2, CAN_TIMING_1M::cnf3);
             break;
-            
+#else
         default:
-            mcp2515_write_register(CNF1,0x00);
-            mcp2515_write_register(CNF2,0x90);
-            mcp2515_write_register(CNF3,0x02);
+            begin(CAN_TIMING_500K::cnf1, CAN_TIMING_500K::cnf2, CAN_TIMING_500K::cnf3);
+            break;
+#endif
+    }
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: begin(cnf1, cnf2, cnf3)
+ Parameters(type):
+	cnf1, cnf2, cnf3(uint8_t): MCP2515 bit timing registers, e.g. from
+	CANBitTiming<MCP2515_OSC_FREQ, bitrate, sample point>
+ Description:
+	Resets and initializes the MCP2515, leaving it in normal mode
+ Returns:
+	Nothing
+ Example:
+	typedef CANBitTiming<MCP2515_OSC_FREQ, 33333, 800> GMLAN;
+	CAN.begin(GMLAN::cnf1, GMLAN::cnf2, GMLAN::cnf3);
+ 
+ */
+void CANClass::begin(uint8_t cnf1, uint8_t cnf2, uint8_t cnf3)
+{
+    
 #if (DEBUGMODE==1)
-            Serial.println(F("Speed = Default"));
+    Serial.println(F("-- Constructor Can(cnf1, cnf2, cnf3) --"));
 #endif
-            break;
-            
+    
+#if (CAN_SPI_STATISTICS==1)
+    for (uint8_t op = 0; op < SPI_OP_COUNT; op++) {
+        _spiOpBytes[op] = 0;
+        _spiOpCalls[op] = 0;
     }
+#endif
+    SPI_STATISTICS_CALL(SPI_OP_OTHER);
+    
+    *_pins.csPort |= (1 << _pins.csBit);
+    *(_pins.csPort - 1) |= (1 << _pins.csBit);
+    
+    RESET(P_SCK);
+    RESET(P_MOSI);
+    RESET(P_MISO);
+    
+    SET_OUTPUT(P_SCK);
+    SET_OUTPUT(P_MOSI);
+    SET_INPUT(P_MISO);
+    
+    *(_pins.intPort - 1) &= ~(1 << _pins.intBit);
+    *_pins.intPort |= (1 << _pins.intBit);
+    
+    // We activate the SPI Arduino as Master and Fosc/2=8 MHz
+    SPCR = (1<<SPE)|(1<<MSTR) | (0<<SPR1)|(0<<SPR0);
+    SPSR = (1<<SPI2X);
+#if (DEBUGMODE==1)
+    Serial.println(F("SPI=8 Mhz"));
+#endif
+    
+    
+    
+    // reset MCP2515 by software reset.
+    // After this he is in configuration mode.
+    mcp2515_select();
+    spi_putc(SPI_RESET);
+    mcp2515_unselect();
+    
+    // wait a little bit until the MCP2515 has restarted
+    _delay_us(10);
     
     
     
+    mcp2515_write_register(CNF1,cnf1);
+    mcp2515_write_register(CNF2,cnf2);
+    mcp2515_write_register(CNF3,cnf3);
     
-    //Activate RX Interruption
-    mcp2515_write_register(CANINTE,(1<<RX1IE)|(1<<RX0IE)); //The two buffers activated interrupt pin
+    
+    
+    
+    //Activate RX Interruption, TX interruption timestamps our own frames
+    mcp2515_write_register(CANINTE,(1<<TX2IE)|(1<<TX1IE)|(1<<TX0IE)|(1<<RX1IE)|(1<<RX0IE));
     
     //Filters
     //Buffer 0: All Messages and Rollover=>If buffer 0 full, send to buffer 1
@@ -240,226 +285,533 @@ void CANClass::begin(uint16_t speed)
     mcp2515_write_register(CANCTRL, 0);
     
     //Initialize buffer
-    _CAN_RX_BUFFER.head=0;
-    _CAN_RX_BUFFER.tail=0;
+    _CAN_RX_BUFFER.clear();
+    _intMask=0;
+    
+    //Initialize tx queue; the 2515 resets all TXBnCTRL priorities to 0
+    _txQueueCount=0;
+    _txQueueHighWater=0;
+    _txDropCount=0;
+    _txPriority[0]=_txPriority[1]=_txPriority[2]=0;
+    _txContentValid=0;
+    _txBytesSaved=0;
+    _txCacheSince=millis();
+    for (uint8_t n = 0; n < 3; n++) {
+        _txLoadedId[n]=0;
+        _txDoneId[n]=0;
+        _txDoneTime[n]=0;
+        _txLoadTime[n]=0;
+        _txQueuedTime[n]=0;
+    }
+    _responderRequestId=0;
+    _responderReplyId=0;
+    _responderPending=0;
+    _replyCount=0;
+    _replyLatencyMax=0;
+    _replyLatencySum=0;
+#if (CAN_FAST_RESPONDER==1)
+    _responder=0;
+    _fastReplyRequest=0;
+#endif
+#if (CAN_TX_STATISTICS==1)
+    memset(_txStats, 0, sizeof(_txStats));
+#endif
+    
+    //Initialize error monitor
+    _errCheckTime=0;
+    _eflg=_tec=_rec=0;
+    _rxOverflowCount=0;
+    _txAbortCount=0;
+    _txAborting=0;
+    _errorPassiveCount=0;
+    _busOffCount=0;
+    _busOffStart=0;
+    _busOffLastMs=0;
+    _busOffMaxMs=0;
+    
+    if (_pins.intNumber != CAN_INT_NONE) {
+        //INT pin of the MCP2515 stays low as long as a received frame is waiting,
+        //so a low level trigger can never miss a frame that arrives while draining
+        EICRA &= ~(0x03 << (2 * _pins.intNumber));
+        EIMSK |= (1 << _pins.intNumber);
+        _intBits |= (1 << _pins.intNumber);
+    }
     
 #if (DEBUGMODE==1)
-    Serial.println(F("-- End Constructor Can(uint16_t speed) --"));
+    Serial.println(F("-- End Constructor Can(cnf1, cnf2, cnf3) --"));
 #endif
     
     
 }
 // ----------------------------------------------------------------------------
 /*
- Name:send(message)
+ Name:send(message, priority)
  Parameters(type):
 	message(*mesCAN):message to be sent
+	priority(uint8_t): TX_PRIORITY_LOW ... TX_PRIORITY_HIGHEST
  Description:
-	It sends through the bus the message passed by reference
+	It sends through the bus the message passed by reference. If all three
+	of the 2515's tx-buffers are busy the message waits in the tx queue and
+	goes out from update() as soon as a buffer is free, highest priority
+	first. The priority also goes to the TXP bits of the tx-buffer, so the
+	2515 starts with the most important of its pending buffers. Never blocks.
  Returns:
-	0xFF: if 2515's tx-buffer is full
+	0xFF: if the message had to be dropped, see getTxDropCount()
+	0x00: if the message was queued
 	0x01: if when 2515's TxBuffer[0] used
 	0x02: if when 2515's TxBuffer[1] used
 	0x04: if when 2515's TxBuffer[2] used
  Example:
-	uint8_t count = 0;
-	while(CAN.send(!CAN_TxMsg)==0xFF && count < 15);
+	CAN.send(&message, TX_PRIORITY_HIGHEST);
+ 
+ */
+uint8_t CANClass::send(msgCAN *message, uint8_t priority)
+{
+    *txSlot() = *message;
+    return sendTxSlot(priority);
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: txSlot() / sendTxSlot(priority)
+ Parameters(type):
+	priority(uint8_t): TX_PRIORITY_LOW ... TX_PRIORITY_HIGHEST
+ Description:
+	send() without the copy: txSlot() hands out the tx queue entry the next
+	message goes into, fill it in place and pass it on with sendTxSlot().
+	If a tx-buffer is free it is loaded straight from the slot. The slot is
+	only valid until the next call into the driver's tx side.
+ Returns:
+	txSlot(): The message to fill in
+	sendTxSlot(): Same as send()
+ Example:
+	CANClass::msgCAN *frame = CAN.txSlot();
+	frame->setHeader(0x3C8, 0, 8);
+	...
+	CAN.sendTxSlot(TX_PRIORITY_HIGHEST);
  
  */
-uint8_t CANClass::send(msgCAN *message)
+CANClass::msgCAN *CANClass::txSlot(void)
+{
+    // Whatever is already waiting goes first; done here, because it moves the queue
+    update();
+    
+    return &_txQueue[_txQueueCount].message;
+}
+
+uint8_t CANClass::sendTxSlot(uint8_t priority)
 {
     
     
 #if (DEBUGMODE==1)
-    Serial.println(F("-- uint8_t CANClass::send(msgCAN *message) --"));
+    Serial.println(F("-- uint8_t CANClass::sendTxSlot(uint8_t priority) --"));
 #endif
     
-    uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
-    
-    /* Statusbyte:
-     *
-     * Bit	Function
-     *  2	TXB0CNTRL.TXREQ
-     *  4	TXB1CNTRL.TXREQ
-     *  6	TXB2CNTRL.TXREQ
-     */
-    uint8_t address;
     uint8_t t;
     
-    if (bit_is_clear(status, 2)) {
-        address = 0x00;
-    }
-    else if (bit_is_clear(status, 4)) {
-        address = 0x02;
-    }
-    else if (bit_is_clear(status, 6)) {
-        address = 0x04;
-    }
-    else {
-        // all buffer used => could not send message
-        return 0xFF;
-    }
-    
-    RESET(MCP2515_CS);
-    spi_putc(SPI_WRITE_TX | address);
-    
-    spi_putc(message->id >> 3);
-    spi_putc(message->id << 5);
+    SPI_STATISTICS_CALL(SPI_OP_SEND);
     
-    spi_putc(0);
-    spi_putc(0);
+    _txQueue[_txQueueCount].queued = micros();
     
-    uint8_t length = message->header.length & 0x0f;
-    
-    if (message->header.rtr) {
-        // a rtr-frame has a length, but contains no data
-        spi_putc((1<<RTR) | length);
-    }
-    else {
-        // set message length
-        spi_putc(length);
-        
-        // data
-        for (t=0;t<length;t++) {
-            spi_putc(message->data[t]);
+    if (_txQueueCount == 0) {
+        t = mcp2515_load_tx(&_txQueue[0].message, priority, _txQueue[0].queued);
+        if (t != 0xFF) {
+            return t;
         }
     }
-    SET(MCP2515_CS);
     
-    _delay_us(1);
+    if (_txQueueCount == TX_CAN_QUEUE_SIZE) {
+        // Queue full; make room by dropping the newest of the least important frames, unless that is this one
+        uint8_t victim = 0;
+        for (t = 1; t < TX_CAN_QUEUE_SIZE; t++) {
+            if (_txQueue[t].priority <= _txQueue[victim].priority) {
+                victim = t;
+            }
+        }
+        _txDropCount++;
+        if (_txQueue[victim].priority >= priority) {
+            return 0xFF;
+        }
+        // the new message sits right after the queue and moves down with it
+        for (t = victim + 1; t <= _txQueueCount; t++) {
+            _txQueue[t - 1] = _txQueue[t];
+        }
+        _txQueueCount--;
+    }
     
-    // send message
-    RESET(MCP2515_CS);
-    address = (address == 0) ? 1 : address;
-    spi_putc(SPI_RTS | address);
-    SET(MCP2515_CS);
+    _txQueue[_txQueueCount].priority = priority;
+    _txQueueCount++;
+    if (_txQueueCount > _txQueueHighWater) {
+        _txQueueHighWater = _txQueueCount;
+    }
     
     
 #if (DEBUGMODE==1)
-    Serial.println(F("-- END uint8_t CANClass::send(msgCAN *message) --"));
+    Serial.println(F("-- END uint8_t CANClass::sendTxSlot(uint8_t priority) --"));
 #endif
     
     
     
-    return address;
+    return 0x00;
 }
 // ----------------------------------------------------------------------------
 /*
- Name:ReadFromDevice(message)
+ Name: update()
  Parameters(type):
-	message(*msgCAN): Menssage passed by reference to be filled with the new
- message coming fron the 2515 drvier
+	None
  Description:
-	Receives by parameter a struct msgCAN
- Returns(uint8_t):
-	last 3 bits of 2515's status. More in the
+	Moves queued messages into free tx-buffers of the 2515, highest priority
+	first and in order of sending within the same priority. Call it from the
+	main loop.
+ Returns:
+	Nothing
  Example:
-	if(CAN.ReadFromDevice(&message))
-	{
-	}
+	CAN.update();
+ 
  */
-uint8_t CANClass::ReadFromDevice(msgCAN *message)
+void CANClass::update(void)
 {
+    SPI_STATISTICS_OP(SPI_OP_SEND);
     
-    
-#if (DEBUGMODE==1)
-    Serial.println(F("-- START uint8_t ReadFromDevice(msgCAN *message) --"));
-#endif
-    
-    //	static uint8_t previousBuffer;
-    
-    // read status
-    uint8_t status = mcp2515_read_status(SPI_RX_STATUS);
-    uint8_t addr;
-    uint8_t t;
-    
-#if (DEBUGMODE==1)
-    Serial.print(F("MCP2515 Status="));
-    Serial.println(status,BIN);
-    Serial.print(F("Mask to check Buffer="));
-    Serial.println( ((status & 0b11000000)>>6)&0b00000011,BIN);
-#endif
-    
-    /* This piece of code sometimes causes us to read from the wrong buffer
-     
-     if ( (((status & 0b11000000)>>6)&0b00000011) >2 )
-     {
-     addr=SPI_READ_RX | (previousBuffer++ & 0x01)<<2;
-     
-     #if (DEBUGMODE==1)
-     Serial.println("Dos buffer con datos");
-     Serial.print("addr=");
-     Serial.println(addr,HEX);
-     Serial.print("previousBuffer=");
-     Serial.println(previousBuffer,DEC);
-     
-     #endif
-     }
-     else
-     */
-    if (bit_is_set(status,6))
-    {
-        // message in buffer 0
-        addr = SPI_READ_RX;
-        
-#if (DEBUGMODE==1)
-        Serial.println(F("Read From Buffer 0"));
-        Serial.print(F("addr="));
-        Serial.println(addr,HEX);
-#endif
-    }
-    else if (bit_is_set(status,7))
-    {
-        // message in buffer 1
-        addr = SPI_READ_RX | 0x04;
+    while (_txQueueCount > 0) {
+        uint8_t next = 0;
+        uint8_t t;
         
-#if (DEBUGMODE==1)
-        Serial.println(F("Read From Buffer 1"));
-        Serial.print(F("addr="));
-        Serial.println(addr,HEX);
-#endif
-    }
-    else {
-        // Error: no message available
-        return 0;
+        for (t = 1; t < _txQueueCount; t++) {
+            if (_txQueue[t].priority > _txQueue[next].priority) {
+                next = t;
+            }
+        }
+        if (mcp2515_load_tx(&_txQueue[next].message, _txQueue[next].priority, _txQueue[next].queued) == 0xFF) {
+            // all buffer used => try again next time
+            return;
+        }
+        for (t = next + 1; t < _txQueueCount; t++) {
+            _txQueue[t - 1] = _txQueue[t];
+        }
+        _txQueueCount--;
     }
-    
-    RESET(MCP2515_CS);
-    spi_putc(addr);
-    
-    // read id
-    message->id  = (uint16_t) spi_putc(0xff) << 3;
-    message->id |=            spi_putc(0xff) >> 5;
-    
-    spi_putc(0xff);
-    spi_putc(0xff);
-    
-    // read DLC
-    uint8_t length = spi_putc(0xff) & 0x0f;
-    
-    message->header.length = length;
-    message->header.rtr = (bit_is_set(status, 3)) ? 1 : 0;
-    
-    // read data
-    for (t=0;t<length;t++) {
-        message->data[t] = spi_putc(0xff);
-    }
-    SET(MCP2515_CS);
-    
-    /*
-     // clear interrupt flag
-     if (bit_is_set(status, 6)) {
-     mcp2515_bit_modify(CANINTF, (1<<RX0IF), 0);
-     }
-     else {
-     mcp2515_bit_modify(CANINTF, (1<<RX1IF), 0);
-     }
-     */
-    
-    
-    
-#if (DEBUGMODE==1)
-    Serial.print(F("Return = "));
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: getTxQueueDepth() / getTxQueueHighWater() / getTxDropCount()
+ Description:
+	Messages waiting in the tx queue right now, the most there has ever been
+	and how many had to be dropped because the queue was full
+ */
+uint8_t CANClass::getTxQueueDepth(void)
+{
+    return _txQueueCount;
+}
+
+uint8_t CANClass::getTxQueueHighWater(void)
+{
+    return _txQueueHighWater;
+}
+
+uint16_t CANClass::getTxDropCount(void)
+{
+    return _txDropCount;
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: getTxCompleteTime(id)
+ Parameters(type):
+	id(uint16_t): identifier of one of our own frames
+ Description:
+	micros() at which the last frame with this id left one of the three
+	transmit buffers, taken when its TXnIF was handled. Only the last frame
+	of each buffer is remembered.
+ Returns(uint32_t):
+	Timestamp, or 0 if no such frame is on record
+ Example:
+	uint32_t sent = CAN.getTxCompleteTime(NODE_STATUS_TX_CDC);
+ */
+uint32_t CANClass::getTxCompleteTime(uint16_t id)
+{
+    uint8_t oldSREG = SREG;
+    uint32_t now = micros();
+    uint32_t latest = 0;
+    uint32_t age = 0xFFFFFFFF;
+    
+    cli();
+    for (uint8_t n = 0; n < 3; n++) {
+        if (_txDoneId[n] == id && _txDoneTime[n] && (now - _txDoneTime[n]) < age) {
+            age = now - _txDoneTime[n];
+            latest = _txDoneTime[n];
+        }
+    }
+    SREG = oldSREG;
+    return latest;
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: setTxTiming(id, minMs, maxMs, burstGapMs)
+ Parameters(type):
+	id(uint16_t): frame to check
+	minMs, maxMs(uint16_t): allowed interval between two of its frames on the bus
+	burstGapMs(uint16_t): for frames sent in bursts, a longer interval
+	starts the next burst and is not checked; 0 checks every interval
+ Description:
+	Checks the interval between the TXnIF of every two frames of this id
+	against the window, counting the ones below and above it and keeping a
+	histogram of them all for printStatistics(). Takes one of the
+	TX_STATS_IDS entries. Does nothing without CAN_TX_STATISTICS.
+ Returns:
+	None
+ Example:
+	CAN.setTxTiming(0x3C8, 50, 1045);          // 950 ms +10%, events 50 ms apart
+	CAN.setTxTiming(0x6A2, 126, 154, 308);     // 140 ms +/-10% within a reply
+ */
+void CANClass::setTxTiming(uint16_t id, uint16_t minMs, uint16_t maxMs, uint16_t burstGapMs)
+{
+#if (CAN_TX_STATISTICS==1)
+    uint8_t oldSREG = SREG;
+    cli();
+    TX_CAN_STATS *stats = txStats(id);
+    if (stats) {
+        stats->windowMin = minMs;
+        stats->windowMax = (maxMs > minMs) ? maxMs : minMs + 1;
+        stats->burstGap = burstGapMs;
+        stats->early = 0;
+        stats->late = 0;
+        memset(stats->histogram, 0, sizeof(stats->histogram));
+    }
+    SREG = oldSREG;
+#endif
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: checkErrors()
+ Parameters(type):
+	None
+ Description:
+	Error monitor, call it from the main loop; it runs once every
+	CAN_ERROR_CHECK_MS. Reads EFLG, TEC and REC and
+	- clears RX0OVR/RX1OVR, counting the overflows,
+	- counts entries into error passive and bus-off. The MCP2515 leaves
+	  bus-off by itself after 128 x 11 recessive bits, the time that took is
+	  recorded (to CAN_ERROR_CHECK_MS resolution),
+	- aborts all pending transmissions with ABAT when bus-off or when a TX
+	  request has been pending for CAN_TX_STALE_MS, as happens with nobody
+	  left on the bus to acknowledge. It does not wait for the abort: the
+	  next call clears ABAT once the frame on the wire is done, until then
+	  nothing new is loaded. The queue behind them gets sent by update()
+	  once the buffers are free again.
+ Returns:
+	Nothing
+ Example:
+	CAN.checkErrors();
+ */
+void CANClass::checkErrors(void)
+{
+    uint32_t now = millis();
+    
+    // ABAT set by an earlier pass stays until the frame on the wire is done
+    if (_txAborting) {
+        if (mcp2515_read_status(SPI_READ_STATUS) & 0x54) {
+            return;
+        }
+        mcp2515_bit_modify(CANCTRL, (1<<ABAT), 0);
+        _txAborting = 0;
+    }
+    
+    if (now - _errCheckTime < CAN_ERROR_CHECK_MS) {
+        return;
+    }
+    _errCheckTime = now;
+    
+    uint8_t eflg = mcp2515_read_register(EFLG);
+    _tec = mcp2515_read_register(TEC);
+    _rec = mcp2515_read_register(REC);
+    
+    if (eflg & ((1<<RX1OVR)|(1<<RX0OVR))) {
+        if (bit_is_set(eflg, RX0OVR)) _rxOverflowCount++;
+        if (bit_is_set(eflg, RX1OVR)) _rxOverflowCount++;
+        mcp2515_bit_modify(EFLG, (1<<RX1OVR)|(1<<RX0OVR), 0);
+        mcp2515_bit_modify(CANINTF, (1<<ERRIF), 0);
+    }
+    
+    if ((eflg & ((1<<TXEP)|(1<<RXEP))) && !(_eflg & ((1<<TXEP)|(1<<RXEP)))) {
+        _errorPassiveCount++;
+    }
+    
+    // EFLG bit 5 is TXBO, bus-off
+    uint8_t abort = 0;
+    if (bit_is_set(eflg, TXB0)) {
+        if (_busOffStart == 0) {
+            _busOffStart = now ? now : 1;
+            _busOffCount++;
+            abort = 1;
+        }
+    }
+    else if (_busOffStart != 0) {
+        _busOffLastMs = now - _busOffStart;
+        if (_busOffLastMs > _busOffMaxMs) {
+            _busOffMaxMs = _busOffLastMs;
+        }
+        _busOffStart = 0;
+    }
+    _eflg = eflg;
+    
+    // READ_STATUS bits 2, 4 and 6 are TXREQ of TXB0..TXB2
+    uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
+    uint8_t pending = 0;
+    for (uint8_t n = 0; n < 3; n++) {
+        if (bit_is_set(status, 2 + 2 * n)) {
+            pending++;
+            if (now - _txLoadTime[n] >= CAN_TX_STALE_MS) {
+                abort = 1;
+            }
+        }
+    }
+    
+    if (abort && pending) {
+        // ABAT takes effect at the end of a frame already on the wire, the
+        // next call clears it once no TXREQ is left
+        mcp2515_bit_modify(CANCTRL, (1<<ABAT), (1<<ABAT));
+        _txAborting = status & 0x54;
+        _txAbortCount += pending;
+#if (CAN_TX_STATISTICS==1)
+        for (uint8_t n = 0; n < 3; n++) {
+            if (bit_is_set(status, 2 + 2 * n)) {
+                TX_CAN_STATS *stats = txStats(_txLoadedId[n]);
+                if (stats) {
+                    stats->aborted++;
+                }
+            }
+        }
+#endif
+    }
+}
+
+// ----------------------------------------------------------------------------
+/*
+ Name: getErrorFlags()
+ Description:
+	EFLG as read by the last checkErrors() pass
+ */
+uint8_t CANClass::getErrorFlags(void)
+{
+    return _eflg;
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: setResponder(requestId, replyId, responder, preload)
+ Parameters(type):
+	requestId(uint16_t): frame to answer, 0 turns the responder off
+	replyId(uint16_t): frame the reply goes out as, always 8 data bytes
+	responder(ResponderFn): picks the reply data (in PROGMEM) for a request, 0 for none
+	preload(*uint8_t): reply data (in PROGMEM) TXB2 starts out with, best the most common one
+ Description:
+	Lets the interrupt handler answer requestId on its own. TXB2 is kept
+	loaded with the reply header at the highest priority, so a reply only
+	costs the changed data bytes and a RTS, however long the main loop takes
+	to get to the request. The request still goes into the receive buffer;
+	fastReplySent() tells the main loop whether the first reply went out.
+	The responder runs in the interrupt handler and must be quick.
+	With CAN_FAST_RESPONDER 0 or no responder only the request to reply
+	latency of replyId frames sent with send() is measured.
+	Call right after begin(), while TXB2 is still free.
+ Returns:
+	None
+ Example:
+	CAN.setResponder(0x6A1, 0x6A2, &nodeStatusFastReply, cdcActiveCmd[0]);
+ */
+void CANClass::setResponder(uint16_t requestId, uint16_t replyId, ResponderFn responder, const uint8_t *preload)
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    _responderRequestId = requestId;
+    _responderReplyId = replyId;
+    _responderPending = 0;
+#if (CAN_FAST_RESPONDER==1)
+    _responder = (requestId && preload) ? responder : 0;
+    SREG = oldSREG;
+    
+    if (!_responder) {
+        return;
+    }
+    
+    msgCAN reply;
+    
+    reply.setHeader(replyId, 0, 8);
+    memcpy_P(reply.data, preload, 8);
+    
+    mcp2515_write_register(TXB2CTRL, (1<<TXP1)|(1<<TXP0));
+    _txPriority[2] = TX_PRIORITY_HIGHEST;
+    mcp2515_write_tx(2, &reply);
+#else
+    SREG = oldSREG;
+#endif
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: fastReplySent(request)
+ Description:
+	True if the interrupt handler already answered this request from TXB2
+ */
+bool CANClass::fastReplySent(const rxMsgCAN &request)
+{
+#if (CAN_FAST_RESPONDER==1)
+    uint8_t oldSREG = SREG;
+    cli();
+    bool sent = (_fastReplyRequest == request.timestamp);
+    SREG = oldSREG;
+    return sent;
+#else
+    return false;
+#endif
+}
+// ----------------------------------------------------------------------------
+/*
+ Name:ReadFromDevice(message)
+ Parameters(type):
+	message(*msgCAN): Menssage passed by reference to be filled with the new
+ message coming fron the 2515 drvier
+ Description:
+	Receives by parameter a struct msgCAN
+ Returns(uint8_t):
+	last 3 bits of 2515's status. More in the
+ Example:
+	if(CAN.ReadFromDevice(&message))
+	{
+	}
+ */
+uint8_t CANClass::ReadFromDevice(msgCAN *message)
+{
+    
+    
+#if (DEBUGMODE==1)
+    Serial.println(F("-- START uint8_t ReadFromDevice(msgCAN *message) --"));
+#endif
+    
+    SPI_STATISTICS_OP(SPI_OP_READ);
+    
+    // read status
+    uint8_t status = mcp2515_read_status(SPI_RX_STATUS);
+    
+#if (DEBUGMODE==1)
+    Serial.print(F("MCP2515 Status="));
+    Serial.println(status,BIN);
+#endif
+    
+    if (bit_is_set(status,6))
+    {
+        // message in buffer 0
+        mcp2515_read_rx(SPI_READ_RX, message);
+    }
+    else if (bit_is_set(status,7))
+    {
+        // message in buffer 1
+        mcp2515_read_rx(SPI_READ_RX | 0x04, message);
+    }
+    else {
+        // Error: no message available
+        return 0;
+    }
+    
+#if (DEBUGMODE==1)
+    Serial.print(F("Return = "));
     Serial.println((status & 0x07) + 1,DEC);
     Serial.println("-- END uint8_t Can::ReadFromDevice(msgCAN *message) --");
 #endif
@@ -469,6 +821,30 @@ uint8_t CANClass::ReadFromDevice(msgCAN *message)
     
     
     
+}
+// ----------------------------------------------------------------------------
+/*
+ Name:ReadAllFromDevice(messages)
+ Parameters(type):
+	messages(*msgCAN): Array of 2 messages to be filled with what is waiting
+ in the 2515's receive buffers
+ Description:
+	Drains RXB0 and RXB1 after a single SPI_RX_STATUS read. With rollover
+	(BUKT) a frame only goes to RXB1 while RXB0 is still full, and as both
+	buffers are always drained together RXB0 holds the older frame, so
+	messages[] comes out in arrival order. Only DLC data bytes are read.
+ Returns(uint8_t):
+	Number of messages read: 0, 1 or 2
+ Example:
+	CANClass::msgCAN messages[2];
+	uint8_t count = CAN.ReadAllFromDevice(messages);
+ */
+uint8_t CANClass::ReadAllFromDevice(msgCAN *messages)
+{
+    SPI_STATISTICS_OP(SPI_OP_READ);
+    
+    // RX_STATUS bits 6 and 7 are RX0IF and RX1IF
+    return mcp2515_read_all_rx(mcp2515_read_status(SPI_RX_STATUS) >> 6, messages);
 }
 // ----------------------------------------------------------------------------
 /*
@@ -486,7 +862,7 @@ uint8_t CANClass::ReadFromDevice(msgCAN *message)
  */
 uint8_t CANClass::CheckNew(void)
 {
-    return (!IS_SET(MCP2515_INT));
+    return !(*(_pins.intPort - 2) & (1 << _pins.intBit));
 }
 // ----------------------------------------------------------------------------
 /*
@@ -512,6 +888,8 @@ void CANClass::SetMode(uint8_t mode)
 {
     uint8_t reg = 0;
     
+    SPI_STATISTICS_CALL(SPI_OP_MODE);
+    
     if (mode == LISTEN_ONLY_MODE) {
         reg = (0<<REQOP2)|(1<<REQOP1)|(1<<REQOP0);
     }
@@ -556,6 +934,8 @@ void CANClass::SetFilters(uint16_t *Filters,uint16_t *Masks)
     Serial.println(F("-- void CANClass::SetFilters(uint16_t *Filters) --"));
 #endif
     
+    SPI_STATISTICS_CALL(SPI_OP_FILTERS);
+    
     
     //Mask=0xE0=0b11100000  (bits 7-5)
     //Set Config Mode=100 (bits 7-5)
@@ -594,167 +974,886 @@ void CANClass::SetFilters(uint16_t *Filters,uint16_t *Masks)
     mcp2515_write_register( RXM1SIDL, (uint8_t)(Masks[1]<<5) );
     
     
-    //Buffer configuration
-    //Bufer 0
-    mcp2515_write_register(RXB0CTRL,(0<<RXM1)|(1<<RXM0)|(1<<BUKT));
-    //Bufer 1
-    mcp2515_write_register(RXB1CTRL,(0<<RXM1)|(1<<RXM0));
+    //Buffer configuration
+    //Bufer 0
+    mcp2515_write_register(RXB0CTRL,(0<<RXM1)|(0<<RXM0)|(1<<BUKT)); //RXM1 & RXM0 the filter/mask on+Rollover
+    //Bufer 1
+    mcp2515_write_register(RXB1CTRL,(0<<RXM1)|(0<<RXM0)); //RXM1 & RXM0 the filter/mask on
+    
+    
+#if (DEBUGMODE==1)
+    Serial.print(F("Filter 0 = "));
+    Serial.print(Filters[0],BIN);
+    Serial.print(F("-"));
+    Serial.println(Filters[0],HEX);
+    
+    Serial.print(F("Filter 1 = "));
+    Serial.print(Filters[1],BIN);
+    Serial.print(F("-"));
+    Serial.println(Filters[1],HEX);
+    
+    Serial.print(F("Filter 2 = "));
+    Serial.print(Filters[2],BIN);
+    Serial.print(F("-"));
+    Serial.println(Filters[2],HEX);
+    
+    Serial.print(F("Filter 3 = "));
+    Serial.print(Filters[3],BIN);
+    Serial.print(F("-"));
+    Serial.println(Filters[3],HEX);
+    
+    Serial.print(F("Filter 4 = "));
+    Serial.print(Filters[4],BIN);
+    Serial.print(F("-"));
+    Serial.println(Filters[4],HEX);
+    
+    Serial.print(F("Filter 5 = "));
+    Serial.print(Filters[5],BIN);
+    Serial.print(F("-"));
+    Serial.println(Filters[5],HEX);
+    
+    Serial.print(F("Mask 0 = "));
+    Serial.print(Masks[0],BIN);
+    Serial.print(F("-"));
+    Serial.println(Masks[0],HEX);
+    
+    Serial.print(F("Mask 1 = "));
+    Serial.print(Masks[1],BIN);
+    Serial.print(F("-"));
+    Serial.println(Masks[1],HEX);
+    
+    Serial.print(F("RXB0CTRL = "));
+    Serial.println(mcp2515_read_register(RXB0CTRL),BIN);
+    Serial.print(F("RXB1CTRL = "));
+    Serial.println(mcp2515_read_register(RXB1CTRL),BIN);
+    Serial.println(F("----------------------"));
+    
+    Serial.print(F("RXF0SIDH = "));
+    Serial.println(mcp2515_read_register(RXF0SIDH),BIN);
+    Serial.print(F("RXF0SIDL = "));
+    Serial.println(mcp2515_read_register(RXF0SIDL),BIN);
+    Serial.print(F("RXF1SIDH = "));
+    Serial.println(mcp2515_read_register(RXF1SIDH),BIN);
+    Serial.print(F("RXF1SIDL = "));
+    Serial.println(mcp2515_read_register(RXF1SIDL),BIN);
+    Serial.print(F("RXF2SIDH = "));
+    Serial.println(mcp2515_read_register(RXF2SIDH),BIN);
+    Serial.print(F("RXF2SIDL = "));
+    Serial.println(mcp2515_read_register(RXF2SIDL),BIN);
+    Serial.print(F("RXF3SIDH = "));
+    Serial.println(mcp2515_read_register(RXF3SIDH),BIN);
+    Serial.print(F("RXF3SIDL = "));
+    Serial.println(mcp2515_read_register(RXF3SIDL),BIN);
+    Serial.print(F("RXF4SIDH = "));
+    Serial.println(mcp2515_read_register(RXF4SIDH),BIN);
+    Serial.print(F("RXF4SIDL = "));
+    Serial.println(mcp2515_read_register(RXF4SIDL),BIN);
+    Serial.print(F("RXF5SIDH = "));
+    Serial.println(mcp2515_read_register(RXF5SIDH),BIN);
+    Serial.print(F("RXF5SIDL = "));
+    Serial.println(mcp2515_read_register(RXF5SIDL),BIN);
+    Serial.println(("----------------------"));
+    
+    Serial.print(F("RXM0SIDH = "));
+    Serial.println(mcp2515_read_register(RXM0SIDH),BIN);
+    Serial.print(F("RXM0SIDL = "));
+    Serial.println(mcp2515_read_register(RXM0SIDL),BIN);
+    Serial.print(F("RXM1SIDH = "));
+    Serial.println(mcp2515_read_register(RXM1SIDH),BIN);
+    Serial.print(F("RXM1SIDL = "));
+    Serial.println(mcp2515_read_register(RXM1SIDL),BIN);
+    
+    
+    
+#endif
+    
+    //Normal Operation Mode
+    mcp2515_bit_modify(CANCTRL,0xE0,0);
+    
+#if (DEBUGMODE==1)
+    Serial.println(F("-- END void CANClass::SetFilters(uint16_t *Filters) --"));
+#endif
+    
+    
+}
+// ----------------------------------------------------------------------------
+
+
+
+
+
+
+/*
+ Name: ComputeFilters(ids, count, Filters, Masks)
+ 
+ Parameters(type):
+	ids(const uint16_t*): standard IDs that must be received
+	count(uint8_t): number of IDs, FILTER_MAX_IDS at most
+	Filters(uint16_t*): 6 filters to be passed to SetFilters()
+	Masks(uint16_t*): 2 masks to be passed to SetFilters()
+	
+ Description:
+	Finds masks and filters that let every given ID through while keeping out
+	as many other IDs as possible. RXB0 has mask 0 with filters 0-1, RXB1 has
+	mask 1 with filters 2-5. Up to 6 IDs fit exactly. For more IDs a mask bit
+	is cleared at a time until the IDs of each buffer collapse into as many
+	values as it has filters; every split of the IDs between the two buffers
+	is tried for up to FILTER_SEARCH_IDS IDs, otherwise RXB1 takes them all.
+	
+ Returns(uint16_t):
+	Number of foreign standard IDs that still get through the filters
+	
+ Example:
+	uint16_t filters[6], masks[2];
+	CAN.ComputeFilters(ids, 4, filters, masks);
+	CAN.SetFilters(filters, masks);
+ */
+static uint8_t filter_values(const uint16_t *ids, uint8_t count, uint16_t group, uint16_t mask, uint16_t *values)
+{
+    uint8_t n = 0;
+    uint8_t i, j;
+    
+    for (i = 0; i < count; i++) {
+        if (!(group & (1 << i))) {
+            continue;
+        }
+        uint16_t value = ids[i] & mask;
+        for (j = 0; j < n && values[j] != value; j++);
+        if (j == n) {
+            values[n++] = value;
+        }
+    }
+    return n;
+}
+
+static uint16_t filter_mask(const uint16_t *ids, uint8_t count, uint16_t group, uint8_t filters)
+{
+    uint16_t values[FILTER_MAX_IDS];
+    uint16_t mask = 0x7FF;
+    
+    while (filter_values(ids, count, group, mask, values) > filters) {
+        uint16_t bestMask = 0;
+        uint8_t best = 0xFF;
+        for (uint8_t b = 0; b < 11; b++) {
+            if (!(mask & (1 << b))) {
+                continue;
+            }
+            uint8_t n = filter_values(ids, count, group, mask & ~(1 << b), values);
+            if (n < best) {
+                best = n;
+                bestMask = mask & ~(1 << b);
+            }
+        }
+        mask = bestMask;
+    }
+    return mask;
+}
+
+static uint16_t filter_cost(const uint16_t *ids, uint8_t count, uint16_t group, uint16_t mask)
+{
+    uint16_t values[FILTER_MAX_IDS];
+    uint16_t cost = filter_values(ids, count, group, mask, values);
+    
+    // Every cleared mask bit doubles what each filter lets through
+    for (uint8_t b = 0; b < 11; b++) {
+        if (!(mask & (1 << b))) {
+            cost <<= 1;
+        }
+    }
+    return cost;
+}
+
+uint16_t CANClass::ComputeFilters(const uint16_t *ids, uint8_t count, uint16_t *Filters, uint16_t *Masks)
+{
+    uint16_t values[FILTER_MAX_IDS] = {0};
+    uint16_t group0 = 0;
+    uint16_t all;
+    uint8_t n, i;
+    
+    if (count > FILTER_MAX_IDS) {
+        count = FILTER_MAX_IDS;
+    }
+    all = (uint16_t)((1UL << count) - 1);
+    
+    if (count > 6) {
+        uint16_t bestCost = 0xFFFF;
+        uint16_t last = (count <= FILTER_SEARCH_IDS) ? all : 0;
+        uint16_t g = 0;
+        
+        do {
+            uint16_t cost = filter_cost(ids, count, g, filter_mask(ids, count, g, 2))
+                          + filter_cost(ids, count, all & ~g, filter_mask(ids, count, all & ~g, 4));
+            if (cost < bestCost) {
+                bestCost = cost;
+                group0 = g;
+            }
+        } while (g++ != last);
+    }
+    else {
+        // Two exact filters on RXB0, the rest on RXB1
+        group0 = all & 0x03;
+    }
+    
+    // RXB0 => Filter 0-1 & Mask 0
+    Masks[0] = filter_mask(ids, count, group0, 2);
+    n = filter_values(ids, count, group0, Masks[0], values);
+    for (i = 0; i < 2; i++) {
+        Filters[i] = values[(i < n) ? i : 0];
+    }
+    
+    // RXB1 => Filter 2-5 & Mask 1
+    Masks[1] = filter_mask(ids, count, all & ~group0, 4);
+    n = filter_values(ids, count, all & ~group0, Masks[1], values);
+    for (i = 0; i < 4; i++) {
+        Filters[2 + i] = values[(i < n) ? i : 0];
+    }
+    
+    // A buffer without IDs of its own repeats a filter of the other one
+    if (!group0) {
+        Masks[0] = Masks[1];
+        Filters[0] = Filters[1] = Filters[2];
+    }
+    else if (!(all & ~group0)) {
+        Masks[1] = Masks[0];
+        Filters[2] = Filters[3] = Filters[4] = Filters[5] = Filters[0];
+    }
+    
+    // Count what else gets through
+    uint16_t foreign = 0;
+    for (uint16_t id = 0; id <= 0x7FF; id++) {
+        boolean pass = false;
+        for (i = 0; i < 6 && !pass; i++) {
+            uint16_t mask = Masks[(i < 2) ? 0 : 1];
+            pass = ((id & mask) == (Filters[i] & mask));
+        }
+        for (i = 0; i < count && pass; i++) {
+            pass = (ids[i] != id);
+        }
+        if (pass) {
+            foreign++;
+        }
+    }
+    
+    return foreign;
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: handleInterrupt()
+ Parameters(type):
+	None
+ Description:
+	Called from the MCP2515_INT interrupt. Drains both RX buffers of the
+	MCP2515 into the circular buffer, so the main loop only has to consume
+	frames with available(), front() and pop(), no matter how long it was
+	stalled.
+	SPI_READ_RX clears RXnIF when CS goes high, which releases the INT pin.
+	TXnIF of a finished transmission is timestamped and cleared as well.
+	A request registered with setResponder() is answered from here, before
+	the frame is handed to the main loop.
+ Returns:
+	None
+ Example:
+	ISR(INT0_vect) { CAN.handleInterrupt(); }
+ 
+ */
+void CANClass::handleInterrupt(void)
+{
+    uint8_t status;
+#if (CAN_SPI_STATISTICS==1)
+    uint8_t interruptedOp = _spiOp;
+#endif
+    
+    do {
+        SPI_STATISTICS_OP(SPI_OP_READ);
+        
+        // READ_STATUS bits 0 and 1 are RX0IF and RX1IF, 3, 5 and 7 TX0IF..TX2IF
+        status = mcp2515_read_status(SPI_READ_STATUS);
+        if (status & 0xA8) {
+            mcp2515_tx_complete(status);
+        }
+        // Frames are read straight into the circular buffer, RXB0 first
+        for (uint8_t n = 0; n < 2; n++) {
+            if (bit_is_set(status, n)) {
+                rxMsgCAN *slot = _CAN_RX_BUFFER.reserve();
+                if (slot) {
+                    slot->timestamp = micros();
+                    mcp2515_read_rx(SPI_READ_RX | (n << 2), slot);
+                    if (_responderRequestId && slot->id() == _responderRequestId) {
+                        _responderPending = slot->timestamp;
+#if (CAN_FAST_RESPONDER==1)
+                        mcp2515_fast_reply(slot);
+#endif
+                    }
+                    _CAN_RX_BUFFER.commit();
+                }
+                else {
+                    // buffer full, counted by reserve(); drop the frame to release INT
+                    mcp2515_bit_modify(CANINTF, (1 << (RX0IF + n)), 0);
+                }
+            }
+        }
+    } while ((status & 0xAB) && CheckNew());
+    
+    SPI_STATISTICS_OP(interruptedOp);
+}
+// ----------------------------------------------------------------------------
+
+
+
+
+/******************************************************************************
+ * PRIVATE METHODS
+ ******************************************************************************/
+
+// -------------------------------------------------------------------------
+/*
+ The interrupt handlers talk to their MCP2515 over the same SPI bus, so they
+ are held off while the main loop has CS asserted, the ones of every other
+ controller on the bus too. Only the MCP2515 external interrupts are masked
+ to leave SoftwareSerial's pin change interrupt untouched.
+ */
+inline void CANClass::mcp2515_select(void)
+{
+    _intMask = EIMSK & _intBits;
+    EIMSK &= ~_intBits;
+    *_pins.csPort &= ~(1 << _pins.csBit);
+}
+
+// -------------------------------------------------------------------------
+inline void CANClass::mcp2515_unselect(void)
+{
+    *_pins.csPort |= (1 << _pins.csBit);
+    EIMSK |= _intMask;
+}
+
+// -------------------------------------------------------------------------
+uint8_t CANClass::spi_putc( uint8_t data )
+{
+#if (CAN_SPI_STATISTICS==1)
+    _spiOpBytes[_spiOp]++;
+#endif
+    
+    // put byte in send-buffer
+    SPDR = data;
+    
+    // wait until byte was send
+    while( !( SPSR & (1<<SPIF) ) );
+    
+    return SPDR;
+}
+
+// -------------------------------------------------------------------------
+/*
+ Burst transfers keep the SPI shift register busy: the next byte is fetched
+ while the current one is still shifting, so SPDR is reloaded as soon as SPIF
+ sets. At MCP2515_SPI_CLOCK = F_CPU/2 a byte takes 16 CPU cycles on the wire.
+ Byte by byte through spi_putc() every byte also pays the call, the return
+ value and the caller's loop before the next SPDR write, roughly 28 cycles a
+ byte in total. A burst runs at about 19 cycles a byte, and the unrolled
+ fixed-length versions below drop the loop counter as well. benchmarkSpi()
+ measures both on the target.
+ */
+static inline void spi_wait(void)
+{
+    while( !( SPSR & (1<<SPIF) ) );
+}
+
+template<uint8_t N> struct spi_burst
+{
+    // the byte before data[0] is shifting, N bytes follow it
+    static inline void write_next(const uint8_t *data)
+    {
+        uint8_t next = *data;
+        spi_wait();
+        SPDR = next;
+        spi_burst<N - 1>::write_next(data + 1);
+    }
+    
+    // data[0] is shifting, N - 1 bytes follow it
+    static inline void read_next(uint8_t *data)
+    {
+        spi_wait();
+        uint8_t received = SPDR;
+        SPDR = 0xff;
+        *data = received;
+        spi_burst<N - 1>::read_next(data + 1);
+    }
+};
+
+template<> struct spi_burst<0>
+{
+    static inline void write_next(const uint8_t *) { spi_wait(); }
+};
+
+template<> struct spi_burst<1>
+{
+    static inline void write_next(const uint8_t *data)
+    {
+        uint8_t next = *data;
+        spi_wait();
+        SPDR = next;
+        spi_wait();
+    }
+    
+    static inline void read_next(uint8_t *data)
+    {
+        spi_wait();
+        *data = SPDR;
+    }
+};
+
+template<uint8_t N> inline void CANClass::spi_write_burst(const uint8_t *data)
+{
+#if (CAN_SPI_STATISTICS==1)
+    _spiOpBytes[_spiOp] += N;
+#endif
+    SPDR = data[0];
+    spi_burst<N - 1>::write_next(data + 1);
+}
+
+template<uint8_t N> inline void CANClass::spi_read_burst(uint8_t *data)
+{
+#if (CAN_SPI_STATISTICS==1)
+    _spiOpBytes[_spiOp] += N;
+#endif
+    SPDR = 0xff;
+    spi_burst<N>::read_next(data);
+}
+
+void CANClass::spi_write_burst(const uint8_t *data, uint8_t length)
+{
+    if (length == 0) {
+        return;
+    }
+#if (CAN_SPI_STATISTICS==1)
+    _spiOpBytes[_spiOp] += length;
+#endif
+    
+    SPDR = *data++;
+    while (--length) {
+        uint8_t next = *data++;
+        spi_wait();
+        SPDR = next;
+    }
+    spi_wait();
+}
+
+void CANClass::spi_read_burst(uint8_t *data, uint8_t length)
+{
+    if (length == 0) {
+        return;
+    }
+#if (CAN_SPI_STATISTICS==1)
+    _spiOpBytes[_spiOp] += length;
+#endif
+    
+    SPDR = 0xff;
+    while (--length) {
+        spi_wait();
+        uint8_t received = SPDR;
+        SPDR = 0xff;
+        *data++ = received;
+    }
+    spi_wait();
+    *data = SPDR;
+}
+
+// -------------------------------------------------------------------------
+/*
+ Loads the message into a free tx-buffer and requests its transmission.
+ Returns the RTS bit of the buffer used, or 0xFF if all three are busy.
+ */
+uint8_t CANClass::mcp2515_load_tx(msgCAN *message, uint8_t priority, uint32_t queued)
+{
+    uint8_t oldSREG = SREG;
+    
+    cli();
+    uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
+    
+    /* Statusbyte:
+     *
+     * Bit	Function
+     *  2	TXB0CNTRL.TXREQ
+     *  3	TX0IF
+     *  4	TXB1CNTRL.TXREQ
+     *  5	TX1IF
+     *  6	TXB2CNTRL.TXREQ
+     *  7	TX2IF
+     */
+    // a buffer can be free before the interrupt handler saw its TXnIF,
+    // book that transmission before the buffer is reused
+    if (status & 0xA8) {
+        mcp2515_tx_complete(status);
+    }
+    SREG = oldSREG;
+    
+    // with ABAT set a new TX request would be aborted right away
+    if (_txAborting) {
+        return 0xFF;
+    }
+    
+#if (CAN_FAST_RESPONDER==1)
+    // TXB2 is kept for the fast responder
+    if (_responder) {
+        status |= (1<<6);
+    }
+#endif
+
+    uint8_t address = 0xFF;
+    
+    // first free buffer, unless another free one still holds this frame's
+    // header, so mcp2515_write_tx() gets away with the changed data only
+    for (uint8_t n = 0; n < 3; n++) {
+        if (bit_is_clear(status, 2 + 2 * n)) {
+            if (address == 0xFF) {
+                address = n << 1;
+            }
+            if ((_txContentValid & (1 << n)) && _txContent[n].sidh == message->sidh && _txContent[n].sidl == message->sidl) {
+                address = n << 1;
+                break;
+            }
+        }
+    }
+    if (address == 0xFF) {
+        // all buffer used => could not send message
+        return 0xFF;
+    }
+    
+    // TXBnCTRL only needs writing when the buffer's priority changes
+    priority &= (1<<TXP1)|(1<<TXP0);
+    if (_txPriority[address >> 1] != priority) {
+        mcp2515_write_register(TXB0CTRL + (address << 3), priority);
+        _txPriority[address >> 1] = priority;
+    }
+    
+    _txLoadedId[address >> 1] = message->id();
+    _txLoadTime[address >> 1] = millis();
+    _txQueuedTime[address >> 1] = queued;
     
+    mcp2515_write_tx(address >> 1, message);
     
-#if (DEBUGMODE==1)
-    Serial.print(F("Filter 0 = "));
-    Serial.print(Filters[0],BIN);
-    Serial.print(F("-"));
-    Serial.println(Filters[0],HEX);
+    _delay_us(1);
     
-    Serial.print(F("Filter 1 = "));
-    Serial.print(Filters[1],BIN);
-    Serial.print(F("-"));
-    Serial.println(Filters[1],HEX);
+    // send message
+    mcp2515_select();
+    address = (address == 0) ? 1 : address;
+    spi_putc(SPI_RTS | address);
+    mcp2515_unselect();
     
-    Serial.print(F("Filter 2 = "));
-    Serial.print(Filters[2],BIN);
-    Serial.print(F("-"));
-    Serial.println(Filters[2],HEX);
+    return address;
+}
+
+// -------------------------------------------------------------------------
+/*
+ Writes a frame into TXBn (n = 0..2), skipping what the buffer still holds
+ from its last frame: the header only goes out when id, RTR or DLC changed,
+ of the data only the span from the first to the last changed byte. That
+ span is written with LOAD TX BUFFER at TXBnD0 when it starts there, with
+ WRITE at its register address otherwise. An unchanged frame costs nothing
+ here, only the RTS. The bytes saved over a full load are counted.
+ With CAN_TX_CACHE 0 no buffer is ever marked valid, so every frame is
+ loaded in full.
+ */
+void CANClass::mcp2515_write_tx(uint8_t n, const msgCAN *message)
+{
+    msgCAN *cached = &_txContent[n];
+    // a rtr-frame has a length, but contains no data
+    uint8_t length = message->rtr() ? 0 : message->length();
+    uint8_t written = 0;
     
-    Serial.print(F("Filter 3 = "));
-    Serial.print(Filters[3],BIN);
-    Serial.print(F("-"));
-    Serial.println(Filters[3],HEX);
+    if (!(_txContentValid & (1 << n)) || cached->sidh != message->sidh || cached->sidl != message->sidl) {
+        uint8_t header[6];
+        
+        header[0] = SPI_WRITE_TX | (n << 1);
+        header[1] = message->sidh;
+        header[2] = message->sidl & 0xE0;
+        header[3] = 0;
+        header[4] = 0;
+        header[5] = message->rtr() ? ((1<<RTR) | message->length()) : length;
+        
+        mcp2515_select();
+        spi_write_burst<6>(header);
+        if (length == 8) {
+            spi_write_burst<8>(message->data);
+        }
+        else {
+            spi_write_burst(message->data, length);
+        }
+        mcp2515_unselect();
+        
+        cached->sidh = message->sidh;
+        cached->sidl = message->sidl;
+        memcpy(cached->data, message->data, length);
+#if (CAN_TX_CACHE==1)
+        _txContentValid |= (1 << n);
+#endif
+        return;
+    }
     
-    Serial.print(F("Filter 4 = "));
-    Serial.print(Filters[4],BIN);
-    Serial.print(F("-"));
-    Serial.println(Filters[4],HEX);
+    uint8_t first = 0;
+    uint8_t last = length;
+    while (first < last && message->data[first] == cached->data[first]) first++;
+    while (last > first && message->data[last - 1] == cached->data[last - 1]) last--;
     
-    Serial.print(F("Filter 5 = "));
-    Serial.print(Filters[5],BIN);
-    Serial.print(F("-"));
-    Serial.println(Filters[5],HEX);
+    if (first < last) {
+        mcp2515_select();
+        if (first == 0) {
+            spi_putc(SPI_WRITE_TX | (n << 1) | 0x01);
+            written = 1;
+        }
+        else {
+            spi_putc(SPI_WRITE);
+            spi_putc(TXB0D0 + (n << 4) + first);
+            written = 2;
+        }
+        spi_write_burst(message->data + first, last - first);
+        mcp2515_unselect();
+        
+        memcpy(cached->data + first, message->data + first, last - first);
+        written += last - first;
+    }
     
-    Serial.print(F("Mask 0 = "));
-    Serial.print(Masks[0],BIN);
-    Serial.print(F("-"));
-    Serial.println(Masks[0],HEX);
+    // also counted from the interrupt handler's fast replies
+    uint8_t oldSREG = SREG;
+    cli();
+    _txBytesSaved += 6 + length - written;
+    SREG = oldSREG;
+}
+
+// -------------------------------------------------------------------------
+/*
+ Reads a whole frame from the receive buffer selected by SPI_READ_RX | addr,
+ stopping after DLC data bytes. CS going high clears the buffer's RXnIF.
+ */
+void CANClass::mcp2515_read_rx(uint8_t addr, msgCAN *message)
+{
+    uint8_t header[5];          // SIDH, SIDL, EID8, EID0, DLC
     
-    Serial.print(F("Mask 1 = "));
-    Serial.print(Masks[1],BIN);
-    Serial.print(F("-"));
-    Serial.println(Masks[1],HEX);
+    mcp2515_select();
+    spi_putc(addr);
+    spi_read_burst<5>(header);
     
-    Serial.print(F("RXB0CTRL = "));
-    Serial.println(mcp2515_read_register(RXB0CTRL),BIN);
-    Serial.print(F("RXB1CTRL = "));
-    Serial.println(mcp2515_read_register(RXB1CTRL),BIN);
-    Serial.println(F("----------------------"));
+    // read DLC
+    uint8_t length = header[4] & 0x0f;
+    if (length > 8) {
+        length = 8;
+    }
     
-    Serial.print(F("RXF0SIDH = "));
-    Serial.println(mcp2515_read_register(RXF0SIDH),BIN);
-    Serial.print(F("RXF0SIDL = "));
-    Serial.println(mcp2515_read_register(RXF0SIDL),BIN);
-    Serial.print(F("RXF1SIDH = "));
-    Serial.println(mcp2515_read_register(RXF1SIDH),BIN);
-    Serial.print(F("RXF1SIDL = "));
-    Serial.println(mcp2515_read_register(RXF1SIDL),BIN);
-    Serial.print(F("RXF2SIDH = "));
-    Serial.println(mcp2515_read_register(RXF2SIDH),BIN);
-    Serial.print(F("RXF2SIDL = "));
-    Serial.println(mcp2515_read_register(RXF2SIDL),BIN);
-    Serial.print(F("RXF3SIDH = "));
-    Serial.println(mcp2515_read_register(RXF3SIDH),BIN);
-    Serial.print(F("RXF3SIDL = "));
-    Serial.println(mcp2515_read_register(RXF3SIDL),BIN);
-    Serial.print(F("RXF4SIDH = "));
-    Serial.println(mcp2515_read_register(RXF4SIDH),BIN);
-    Serial.print(F("RXF4SIDL = "));
-    Serial.println(mcp2515_read_register(RXF4SIDL),BIN);
-    Serial.print(F("RXF5SIDH = "));
-    Serial.println(mcp2515_read_register(RXF5SIDH),BIN);
-    Serial.print(F("RXF5SIDL = "));
-    Serial.println(mcp2515_read_register(RXF5SIDL),BIN);
-    Serial.println(("----------------------"));
+    // id and SRR (rtr) stay where SIDH/SIDL have them
+    message->sidh = header[0];
+    message->sidl = (header[1] & 0xF0) | length;
     
-    Serial.print(F("RXM0SIDH = "));
-    Serial.println(mcp2515_read_register(RXM0SIDH),BIN);
-    Serial.print(F("RXM0SIDL = "));
-    Serial.println(mcp2515_read_register(RXM0SIDL),BIN);
-    Serial.print(F("RXM1SIDH = "));
-    Serial.println(mcp2515_read_register(RXM1SIDH),BIN);
-    Serial.print(F("RXM1SIDL = "));
-    Serial.println(mcp2515_read_register(RXM1SIDL),BIN);
+    // read data
+    if (length == 8) {
+        spi_read_burst<8>(message->data);
+    }
+    else {
+        spi_read_burst(message->data, length);
+    }
+    mcp2515_unselect();
     
+#if (CAN_SPI_STATISTICS==1)
+    _spiOpCalls[SPI_OP_READ]++;
+#endif
+}
+
+// -------------------------------------------------------------------------
+/*
+ Reads the receive buffers flagged in pending (bit 0 RXB0, bit 1 RXB1) into
+ messages[], RXB0 first. Returns the number of frames read.
+ */
+uint8_t CANClass::mcp2515_read_all_rx(uint8_t pending, msgCAN *messages)
+{
+    uint8_t count = 0;
     
+    if (bit_is_set(pending,0)) {
+        mcp2515_read_rx(SPI_READ_RX, &messages[count++]);
+    }
+    if (bit_is_set(pending,1)) {
+        mcp2515_read_rx(SPI_READ_RX | 0x04, &messages[count++]);
+    }
     
+    return count;
+}
+
+// -------------------------------------------------------------------------
+/*
+ Timestamps the transmissions whose TXnIF is set in a READ_STATUS byte and
+ clears those flags. With CAN_TX_STATISTICS the buffer's MLOA and TXERR,
+ which stay set until the buffer is requested again, tell whether the frame
+ had to be retried. Runs with interrupts disabled.
+ */
+void CANClass::mcp2515_tx_complete(uint8_t status)
+{
+    uint32_t now = micros();
+    uint8_t flags = 0;
+    
+    for (uint8_t n = 0; n < 3; n++) {
+        if (bit_is_set(status, 3 + 2 * n)) {
+            _txDoneId[n] = _txLoadedId[n];
+            _txDoneTime[n] = now;
+            flags |= (1 << (TX0IF + n));
+            
+            if (_responderPending && _txLoadedId[n] == _responderReplyId) {
+                uint32_t latency = now - _responderPending;
+                if (latency > 0xFFFF) latency = 0xFFFF;
+                if (latency > _replyLatencyMax) _replyLatencyMax = latency;
+                if (_replyCount < 0xFFFF) {
+                    _replyLatencySum += latency;
+                    _replyCount++;
+                }
+                _responderPending = 0;
+            }
+            
+#if (CAN_TX_STATISTICS==1)
+            TX_CAN_STATS *stats = txStats(_txLoadedId[n]);
+            if (stats) {
+                uint8_t ctrl = mcp2515_read_register(TXB0CTRL + (n << 4));
+                uint32_t latency = now - _txQueuedTime[n];
+                
+                if (bit_is_set(ctrl, MLOA)) stats->arbitrationLost++;
+                if (bit_is_set(ctrl, TXERR)) stats->errors++;
+                
+                if (latency > 0xFFFF) latency = 0xFFFF;
+                if (latency > stats->latencyMax) stats->latencyMax = latency;
+                stats->latencySum += latency;
+                
+                if (stats->sent) {
+                    uint32_t interval = (now - stats->lastSent) / 1000;
+                    if (interval > 0xFFFF) interval = 0xFFFF;
+                    if (stats->sent == 1 || interval < stats->intervalMin) stats->intervalMin = interval;
+                    if (interval > stats->intervalMax) stats->intervalMax = interval;
+                    
+                    if (stats->windowMax && !(stats->burstGap && interval > stats->burstGap)) {
+                        uint8_t bin;
+                        if (interval < stats->windowMin) {
+                            stats->early++;
+                            bin = 0;
+                        }
+                        else if (interval > stats->windowMax) {
+                            stats->late++;
+                            bin = TX_TIMING_BINS - 1;
+                        }
+                        else {
+                            bin = 1 + (uint16_t)(interval - stats->windowMin) * (TX_TIMING_BINS - 2) / (stats->windowMax - stats->windowMin + 1);
+                        }
+                        if (stats->histogram[bin] < 0xFFFF) stats->histogram[bin]++;
+                    }
+                }
+                stats->lastSent = now;
+                stats->sent++;
+            }
 #endif
+        }
+    }
+    mcp2515_bit_modify(CANINTF, flags, 0);
+}
+
+#if (CAN_FAST_RESPONDER==1)
+// -------------------------------------------------------------------------
+/*
+ Answers a request from TXB2: the responder picks the reply data, only the
+ bytes that differ from what TXB2 already holds are written (see
+ mcp2515_write_tx()), then RTS.
+ Nothing is sent while TXB2 still waits for the bus with the previous reply
+ or while checkErrors() aborts, the main loop then sees fastReplySent()
+ false and sends it the slow way.
+ Runs in the interrupt handler.
+ */
+void CANClass::mcp2515_fast_reply(const rxMsgCAN *request)
+{
+    if (!_responder || _txAborting) {
+        return;
+    }
+    const uint8_t *data = _responder(*request);
+    if (!data) {
+        return;
+    }
     
-    //Normal Operation Mode
-    mcp2515_bit_modify(CANCTRL,0xE0,0);
+    uint8_t status = mcp2515_read_status(SPI_READ_STATUS);
+    if (status & 0xA8) {
+        mcp2515_tx_complete(status);
+    }
+    if (bit_is_set(status, 6)) {
+        return;
+    }
     
-#if (DEBUGMODE==1)
-    Serial.println(F("-- END void CANClass::SetFilters(uint16_t *Filters) --"));
-#endif
+    msgCAN reply;
+    
+    reply.setHeader(_responderReplyId, 0, 8);
+    memcpy_P(reply.data, data, 8);
+    mcp2515_write_tx(2, &reply);
+    _delay_us(1);
+    
+    _txLoadedId[2] = _responderReplyId;
+    _txLoadTime[2] = millis();
+    _txQueuedTime[2] = request->timestamp;
     
+    mcp2515_select();
+    spi_putc(SPI_RTS | 0x04);
+    mcp2515_unselect();
     
+    _fastReplyRequest = request->timestamp;
 }
-// ----------------------------------------------------------------------------
-
-
-
-
-
-
-/******************************************************************************
- * PRIVATE METHODS
- ******************************************************************************/
+#endif
 
+#if (CAN_TX_STATISTICS==1)
 // -------------------------------------------------------------------------
-uint8_t CANClass::spi_putc( uint8_t data )
+/*
+ The tx statistics of a frame id, a free entry is taken for a new id.
+ Returns 0 once all TX_STATS_IDS entries are in use.
+ */
+CANClass::TX_CAN_STATS *CANClass::txStats(uint16_t id)
 {
-    // put byte in send-buffer
-    SPDR = data;
-    
-    // wait until byte was send
-    while( !( SPSR & (1<<SPIF) ) );
-    
-    return SPDR;
+    for (uint8_t i = 0; i < TX_STATS_IDS; i++) {
+        if (_txStats[i].id == id) {
+            return &_txStats[i];
+        }
+        if (_txStats[i].id == 0) {
+            _txStats[i].id = id;
+            return &_txStats[i];
+        }
+    }
+    return 0;
 }
+#endif
 
 // -------------------------------------------------------------------------
 void CANClass::mcp2515_write_register( uint8_t adress, uint8_t data )
 {
-    RESET(MCP2515_CS);
+    mcp2515_select();
     
     spi_putc(SPI_WRITE);
     spi_putc(adress);
     spi_putc(data);
     
-    SET(MCP2515_CS);
+    mcp2515_unselect();
 }
 // ----------------------------------------------------------------------------
 uint8_t CANClass::mcp2515_read_status(uint8_t type)
 {
     uint8_t data;
     
-    RESET(MCP2515_CS);
+    mcp2515_select();
     
     spi_putc(type);
     data = spi_putc(0xff);
     
-    SET(MCP2515_CS);
+    mcp2515_unselect();
     
     return data;
 }
 // -------------------------------------------------------------------------
 void CANClass::mcp2515_bit_modify(uint8_t adress, uint8_t mask, uint8_t data)
 {
-    RESET(MCP2515_CS);
+    mcp2515_select();
     
     spi_putc(SPI_BIT_MODIFY);
     spi_putc(adress);
     spi_putc(mask);
     spi_putc(data);
     
-    SET(MCP2515_CS);
+    mcp2515_unselect();
 }
 // ----------------------------------------------------------------------------
 uint8_t CANClass::mcp2515_check_free_buffer(void)
@@ -773,55 +1872,276 @@ uint8_t CANClass::mcp2515_read_register(uint8_t adress)
 {
     uint8_t data;
     
-    RESET(MCP2515_CS);
+    mcp2515_select();
     
     spi_putc(SPI_READ);
     spi_putc(adress);
     
     data = spi_putc(0xff);
     
-    SET(MCP2515_CS);
+    mcp2515_unselect();
     
     return data;
 }
 // ----------------------------------------------------------------------------
 /*
- Name: store(message)
+ Name: printStatistics()
  Parameters(type):
-	message(msgCAN*); Message to sotre in circular buffer
+	None
  Description:
-	it stores the message given in the circular buffer
+	Prints tx queue and error monitor counters and, with
+	CAN_SPI_STATISTICS, the SPI cost of each driver operation: calls, bytes,
+	bytes per call and the time a call keeps the SPI bus busy at
+	MCP2515_SPI_CLOCK. For SPI_OP_READ a call is a
+	received frame, so the RX STATUS polls are spread over the frames.
  Returns:
+	Nothing
+ Example:
+	CAN.printStatistics();
+ 
+ */
+void CANClass::printStatistics(void)
+{
+    Serial.print(F("CAN tx queue depth/high water/drops: "));
+    Serial.print(getTxQueueDepth());
+    Serial.print(F("/"));
+    Serial.print(getTxQueueHighWater());
+    Serial.print(F("/"));
+    Serial.println(getTxDropCount());
+    Serial.print(F("CAN rx buffer overflows: "));
+    Serial.println(_CAN_RX_BUFFER.getOverflowCount());
+    
+    Serial.print(F("CAN EFLG/TEC/REC: "));
+    Serial.print(_eflg, BIN);
+    Serial.print(F("/"));
+    Serial.print(_tec);
+    Serial.print(F("/"));
+    Serial.println(_rec);
+    Serial.print(F("CAN rx overflows/tx aborts/error passive/bus-off: "));
+    Serial.print(_rxOverflowCount);
+    Serial.print(F("/"));
+    Serial.print(_txAbortCount);
+    Serial.print(F("/"));
+    Serial.print(_errorPassiveCount);
+    Serial.print(F("/"));
+    Serial.println(_busOffCount);
+    Serial.print(F("CAN bus-off recovery ms last/max: "));
+    Serial.print(_busOffLastMs);
+    Serial.print(F("/"));
+    Serial.println(_busOffMaxMs);
+    
+    uint8_t cacheSREG = SREG;
+    cli();
+    uint32_t saved = _txBytesSaved;
+    SREG = cacheSREG;
+    uint32_t minutes = (millis() - _txCacheSince) / 60000;
+    Serial.print(F("CAN TX cache SPI bytes saved: "));
+    Serial.print(saved);
+    Serial.print(F(", per minute: "));
+    Serial.println(minutes ? saved / minutes : saved);
+    
+    if (_responderRequestId) {
+        uint8_t oldSREG = SREG;
+        cli();
+        uint16_t count = _replyCount;
+        uint16_t latencyMax = _replyLatencyMax;
+        uint32_t latencySum = _replyLatencySum;
+        SREG = oldSREG;
+        
+        Serial.print(_responderRequestId, HEX);
+        Serial.print(F("->"));
+        Serial.print(_responderReplyId, HEX);
+#if (CAN_FAST_RESPONDER==1)
+        Serial.print(F(" fast"));
+#endif
+        Serial.print(F(" reply latency us avg/max: "));
+        Serial.print(count ? latencySum / count : 0);
+        Serial.print(F("/"));
+        Serial.print(latencyMax);
+        Serial.print(F(" of "));
+        Serial.println(count);
+    }
+    
+#if (CAN_TX_STATISTICS==1)
+    Serial.println(F("TX id: sent arb.lost errors aborted latency avg/max us interval min/max ms [window ms: early late histogram]"));
+    for (uint8_t i = 0; i < TX_STATS_IDS && _txStats[i].id; i++) {
+        uint8_t oldSREG = SREG;
+        cli();
+        TX_CAN_STATS stats = _txStats[i];
+        SREG = oldSREG;
+        
+        Serial.print(stats.id, HEX);
+        Serial.print(F(": "));
+        Serial.print(stats.sent);
+        Serial.print(F(" "));
+        Serial.print(stats.arbitrationLost);
+        Serial.print(F(" "));
+        Serial.print(stats.errors);
+        Serial.print(F(" "));
+        Serial.print(stats.aborted);
+        Serial.print(F(" "));
+        Serial.print(stats.sent ? stats.latencySum / stats.sent : 0);
+        Serial.print(F("/"));
+        Serial.print(stats.latencyMax);
+        Serial.print(F(" "));
+        Serial.print(stats.intervalMin);
+        Serial.print(F("/"));
+        Serial.print(stats.intervalMax);
+        if (stats.windowMax) {
+            Serial.print(F(" ["));
+            Serial.print(stats.windowMin);
+            Serial.print(F("-"));
+            Serial.print(stats.windowMax);
+            Serial.print(F(": "));
+            Serial.print(stats.early);
+            Serial.print(F(" "));
+            Serial.print(stats.late);
+            for (uint8_t bin = 0; bin < TX_TIMING_BINS; bin++) {
+                Serial.print(bin ? F(" ") : F(" |"));
+                Serial.print(stats.histogram[bin]);
+            }
+            Serial.print(F("|]"));
+        }
+        Serial.println();
+    }
+#endif
+    
+#if (CAN_SPI_STATISTICS==1)
+    Serial.println(F("SPI op: calls bytes bytes/call us/call"));
+    for (uint8_t op = 0; op < SPI_OP_COUNT; op++) {
+        uint8_t oldSREG = SREG;
+        cli();
+        uint32_t bytes = _spiOpBytes[op];
+        uint16_t calls = _spiOpCalls[op];
+        SREG = oldSREG;
+        
+        switch (op) {
+            case SPI_OP_SEND:       Serial.print(F("send() ")); break;
+            case SPI_OP_READ:       Serial.print(F("ReadFromDevice() ")); break;
+            case SPI_OP_MODE:       Serial.print(F("SetMode() ")); break;
+            case SPI_OP_FILTERS:    Serial.print(F("SetFilters() ")); break;
+            default:                Serial.print(F("begin() ")); break;
+        }
+        Serial.print(calls);
+        Serial.print(F(" "));
+        Serial.print(bytes);
+        Serial.print(F(" "));
+        Serial.print(calls ? bytes / calls : 0);
+        Serial.print(F(" "));
+        Serial.println(calls ? (bytes * 8) / (MCP2515_SPI_CLOCK / 1000000UL) / calls : 0);
+    }
+    
+    benchmarkSpi();
+#endif
+}
+
+#if (CAN_SPI_STATISTICS==1)
+// ----------------------------------------------------------------------------
+/*
+ Name: benchmarkSpi()
+ Parameters(type):
 	None
+ Description:
+	Reads the 13 bytes of RXB0 (SIDH .. D7) with SPI_READ 100 times byte by
+	byte through spi_putc() and 100 times as a burst, and prints the time
+	each path needs per transfer. SPI_READ leaves RX0IF alone, so a frame
+	waiting in RXB0 is not lost.
+ Returns:
+	Nothing
  Example:
-	CAN.store(&CAN_RxMsg);
+	CAN.benchmarkSpi();
  
  */
-void CANClass::store(msgCAN *message)
+void CANClass::benchmarkSpi(void)
 {
+    uint8_t buffer[13];
+    uint32_t start;
+    uint32_t single;
+    uint32_t burst;
+    uint8_t i;
+    uint8_t t;
     
-    int i=(_CAN_RX_BUFFER.head+1)%RX_CAN_BUFFER_SIZE;
+    start = micros();
+    for (i = 0; i < 100; i++) {
+        mcp2515_select();
+        spi_putc(SPI_READ);
+        spi_putc(RXB0SIDH);
+        for (t = 0; t < 13; t++) {
+            buffer[t] = spi_putc(0xff);
+        }
+        mcp2515_unselect();
+    }
+    single = micros() - start;
+    
+    start = micros();
+    for (i = 0; i < 100; i++) {
+        mcp2515_select();
+        spi_putc(SPI_READ);
+        spi_putc(RXB0SIDH);
+        spi_read_burst<13>(buffer);
+        mcp2515_unselect();
+    }
+    burst = micros() - start;
     
-    //Must be stored in the buffer, as long as're from behind the tail
-    //We see example if the buffer size is 10:
-    //The rest of 1/10=1, meter data CAN_RX_BUFFER.buffer[0]; i=1
-    //The rest of 2/10=2, meter data CAN_RX_BUFFER.buffer[1]; i=2
-    //...
-    //The rest of 10/10=0, BUFFER FULL. Does nothing.
+    Serial.print(F("SPI 13 byte read, us/100 spi_putc/burst: "));
+    Serial.print(single);
+    Serial.print(F("/"));
+    Serial.println(burst);
+}
+
+// ----------------------------------------------------------------------------
+/*
+ Name: getSpiByteCount() / getRxFrameCount()
+ Description:
+	SPI bytes clocked since begin() and frames read out of the RX buffers
+ */
+uint32_t CANClass::getSpiByteCount(void)
+{
+    uint8_t oldSREG = SREG;
+    uint32_t count = 0;
     
-    if (i!=_CAN_RX_BUFFER.tail)
-    {
-        _CAN_RX_BUFFER.buffer[_CAN_RX_BUFFER.head]=*message;
-        //increase the current position of the circular buffer
-        _CAN_RX_BUFFER.head=i;
-        
-    }else{
-        
-        //todo
-        
+    cli();
+    for (uint8_t op = 0; op < SPI_OP_COUNT; op++) {
+        count += _spiOpBytes[op];
     }
+    SREG = oldSREG;
+    return count;
+}
+
+uint32_t CANClass::getRxFrameCount(void)
+{
+    uint8_t oldSREG = SREG;
+    uint32_t count;
     
+    cli();
+    count = _spiOpCalls[SPI_OP_READ];
+    SREG = oldSREG;
+    return count;
+}
+#endif
+// ----------------------------------------------------------------------------
+/*
+ Name: store(message)
+ Parameters(type):
+	message(msgCAN*); Message to sotre in circular buffer
+ Description:
+	it stores the message given in the circular buffer. When the buffer is
+	full the message is dropped and counted, see printStatistics()
+ Returns:
+	None
+ Example:
+	CAN.store(&message);
+ 
+ */
+void CANClass::store(msgCAN *message)
+{
+    rxMsgCAN *slot = _CAN_RX_BUFFER.reserve();
     
+    if (slot) {
+        *(msgCAN *)slot = *message;
+        slot->timestamp = micros();
+        _CAN_RX_BUFFER.commit();
+    }
 }
 // ----------------------------------------------------------------------------
 /*
@@ -842,7 +2162,38 @@ void CANClass::store(msgCAN *message)
  */
 uint8_t CANClass::available(void)
 {
-    return ((RX_CAN_BUFFER_SIZE+_CAN_RX_BUFFER.head-_CAN_RX_BUFFER.tail)%RX_CAN_BUFFER_SIZE);
+    //No external interrupt on this controller's INT pin, drain the MCP2515 from here instead
+    if (_pins.intNumber == CAN_INT_NONE && CheckNew()) {
+        handleInterrupt();
+    }
+    return _CAN_RX_BUFFER.available();
+}
+// ----------------------------------------------------------------------------
+/*
+ Name: front() / pop()
+ Parameters(type):
+	None
+ Description:
+	The oldest message in the circular buffer, read in place. It stays
+	valid until pop() hands its slot back to the interrupt handler. Only
+	call them while available() is not 0.
+ Returns:
+	front(): The message
+ Example:
+	while (CAN.available()) {
+		handle(CAN.front());
+		CAN.pop();
+	}
+ 
+ */
+const CANClass::rxMsgCAN &CANClass::front(void)
+{
+    return _CAN_RX_BUFFER.front();
+}
+
+void CANClass::pop(void)
+{
+    _CAN_RX_BUFFER.pop();
 }
 // ----------------------------------------------------------------------------
 /*
@@ -852,8 +2203,8 @@ uint8_t CANClass::available(void)
  Description:
 	it pops a message from the circular buffer
  Example:
-	read(&CAN_TxMsg);
-	if(CAN_TxMsg.id > 0)
+	read(&message);
+	if(message.id() > 0)
 	{
 	}
  
@@ -861,14 +2212,13 @@ uint8_t CANClass::available(void)
 void CANClass::read(msgCAN *message)
 {
     
-    if (_CAN_RX_BUFFER.head==_CAN_RX_BUFFER.tail)
+    if (_CAN_RX_BUFFER.empty())
     {
         //It means no data
-        message->id=0;
-        
+        message->setHeader(0, 0, 0);
     }else{
-        *message=_CAN_RX_BUFFER.buffer[_CAN_RX_BUFFER.tail];
-        _CAN_RX_BUFFER.tail=(_CAN_RX_BUFFER.tail+1)%RX_CAN_BUFFER_SIZE;
+        *message = _CAN_RX_BUFFER.front();
+        _CAN_RX_BUFFER.pop();
     }
     
 }
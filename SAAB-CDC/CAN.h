@@ -9,8 +9,66 @@
 #include <util/delay.h>
 
 #include "pinout.h"
+#include "RingBuffer.h"
 
 
+#ifndef MCP2515_OSC_FREQ
+#define MCP2515_OSC_FREQ    16000000UL  // Crystal on the MCP2515 board, CNF1..3 are solved for it
+#endif
+
+#define CAN_SPI_STATISTICS  0   // 1 = count SPI bytes per driver operation, see printStatistics()
+
+// Driver operations the SPI statistics are broken down into
+#define SPI_OP_OTHER        0
+#define SPI_OP_SEND         1
+#define SPI_OP_READ         2
+#define SPI_OP_MODE         3
+#define SPI_OP_FILTERS      4
+#define SPI_OP_COUNT        5
+
+#define MCP2515_SPI_CLOCK   (F_CPU / 2)     // SPI2X with SPR1:0 = 0, see begin()
+
+#define CAN_TX_STATISTICS   1       // 1 = per frame id tx latency/arbitration statistics, see printStatistics()
+#define TX_STATS_IDS        5       // frame ids the tx statistics keep track of
+#define TX_TIMING_BINS      8       // interval histogram of setTxTiming(): below, 6 bins across, above the window
+
+#ifndef CAN_TX_CACHE
+#define CAN_TX_CACHE        1       // 1 = mcp2515_write_tx() only rewrites what a TX buffer does not hold yet
+#endif
+
+#ifndef CAN_FAST_RESPONDER
+#define CAN_FAST_RESPONDER  1       // 1 = setResponder() answers its request from TXB2 inside the interrupt handler
+#endif
+
+#define CAN_ERROR_CHECK_MS  50      // checkErrors() period
+#define CAN_TX_STALE_MS     200     // a TX request still pending this long is aborted
+
+// TXP priority of a transmit buffer; send() also drains its queue highest first
+#define TX_PRIORITY_LOW         0
+#define TX_PRIORITY_MEDIUM      1
+#define TX_PRIORITY_HIGH        2
+#define TX_PRIORITY_HIGHEST     3
+
+
+// Where one MCP2515 is wired: its CS and INT pins as PORTx register and bit,
+// and the external interrupt INTn (n = 0..3) the INT pin drives, CAN_INT_NONE
+// if there is none and the controller is polled from available() instead.
+// DDRx and PINx sit right below PORTx on AVR.
+struct CANPins
+{
+    volatile uint8_t *csPort;
+    uint8_t csBit;
+    volatile uint8_t *intPort;
+    uint8_t intBit;
+    uint8_t intNumber;
+};
+
+#define CAN_INT_NONE        0xFF
+
+// From the B,2 style pins of pinout.h: CAN_PINS(MCP2515_CS, MCP2515_INT, MCP2515_INT_NUM)
+#define CAN_PINS(cs, irq, num)                              _CAN_PINS(cs, irq, num)
+#define _CAN_PINS(csPort, csBit, intPort, intBit, num)      { &PORT ## csPort, csBit, &PORT ## intPort, intBit, num }
+
 //----------------------------------------------------------------------------
 // CLASS
 //----------------------------------------------------------------------------
@@ -18,34 +76,96 @@
 class CANClass
 {
 public:
-    typedef struct
+    CANClass(const CANPins &pins);
+    
+    // 10 bytes: the 11 bit id, RTR and DLC packed into two bytes laid out like
+    // the MCP2515's SIDH/SIDL registers, followed by the data
+    struct msgCAN
     {
-        uint16_t id;
-        struct
-        {
-            int8_t rtr : 1;
-            uint8_t length : 4;
-        } header;
+        uint8_t sidh;           //id bits 10..3
+        uint8_t sidl;           //id bits 2..0 in 7..5, RTR in 4 (SRR on receive), DLC in 3..0
         uint8_t data[8];
-    } msgCAN;
+        
+        uint16_t id(void) const { return ((uint16_t)sidh << 3) | (sidl >> 5); }
+        uint8_t rtr(void) const { return (sidl >> 4) & 0x01; }
+        uint8_t length(void) const { return sidl & 0x0F; }
+        
+        void setHeader(uint16_t id, uint8_t rtr, uint8_t length) {
+            sidh = id >> 3;
+            sidl = (uint8_t)(id << 5) | (rtr ? 0x10 : 0) | (length & 0x0F);
+        }
+    };
+    
+    // What the circular buffer holds for each received frame
+    struct rxMsgCAN : msgCAN
+    {
+        uint32_t timestamp;     //micros() when the MCP2515 was found holding the frame
+    };
     
     
     void begin(uint16_t speed);
-    uint8_t send(msgCAN *message);
+    void begin(uint8_t cnf1, uint8_t cnf2, uint8_t cnf3);
+    uint8_t send(msgCAN *message, uint8_t priority = TX_PRIORITY_LOW);
+    msgCAN *txSlot(void);
+    uint8_t sendTxSlot(uint8_t priority = TX_PRIORITY_LOW);
+    void update(void);
     uint8_t ReadFromDevice(msgCAN *message);
+    uint8_t ReadAllFromDevice(msgCAN *messages);
     uint8_t CheckNew(void);
     void SetMode(uint8_t mode);
     void SetFilters(uint16_t *Filters,uint16_t *Masks);
+    static uint16_t ComputeFilters(const uint16_t *ids, uint8_t count, uint16_t *Filters, uint16_t *Masks);
     
     //Buffer
     void store(msgCAN *message);
     uint8_t available(void);
+    const rxMsgCAN &front(void);
+    void pop(void);
     void read(msgCAN *message);
     
+    //Tx queue
+    uint8_t getTxQueueDepth(void);
+    uint8_t getTxQueueHighWater(void);
+    uint16_t getTxDropCount(void);
+    uint32_t getTxCompleteTime(uint16_t id);
+    void setTxTiming(uint16_t id, uint16_t minMs, uint16_t maxMs, uint16_t burstGapMs = 0);
+    
+    //Error monitor
+    void checkErrors(void);
+    uint8_t getErrorFlags(void);
+    
+    //Fast responder
+    typedef const uint8_t *(*ResponderFn)(const msgCAN &request);   //returns reply data in PROGMEM
+    void setResponder(uint16_t requestId, uint16_t replyId, ResponderFn responder, const uint8_t *preload);
+    bool fastReplySent(const rxMsgCAN &request);
+    
+    //Interrupt
+    void handleInterrupt(void);
+    
+    //Statistics
+    void printStatistics(void);
+#if (CAN_SPI_STATISTICS==1)
+    void benchmarkSpi(void);
+    uint32_t getSpiByteCount(void);
+    uint32_t getRxFrameCount(void);
+#endif
+    
     
     
 private:
+    inline void mcp2515_select(void);
+    inline void mcp2515_unselect(void);
     uint8_t spi_putc( uint8_t data );
+    void spi_write_burst(const uint8_t *data, uint8_t length);
+    void spi_read_burst(uint8_t *data, uint8_t length);
+    template<uint8_t N> inline void spi_write_burst(const uint8_t *data);
+    template<uint8_t N> inline void spi_read_burst(uint8_t *data);
+    void mcp2515_read_rx(uint8_t addr, msgCAN *message);
+    uint8_t mcp2515_read_all_rx(uint8_t pending, msgCAN *messages);
+    void mcp2515_tx_complete(uint8_t status);
+    void mcp2515_fast_reply(const rxMsgCAN *request);
+    uint8_t mcp2515_load_tx(msgCAN *message, uint8_t priority, uint32_t queued);
+    void mcp2515_write_tx(uint8_t n, const msgCAN *message);
     void mcp2515_write_register( uint8_t adress, uint8_t data );
     uint8_t mcp2515_read_status(uint8_t type);
     void mcp2515_bit_modify(uint8_t adress, uint8_t mask, uint8_t data);
@@ -53,13 +173,86 @@ private:
     uint8_t mcp2515_read_register(uint8_t adress);
     
     
-#define  RX_CAN_BUFFER_SIZE  10
+#define  RX_CAN_BUFFER_SIZE  8
+    RingBuffer<rxMsgCAN, RX_CAN_BUFFER_SIZE> _CAN_RX_BUFFER;     //Filled by the interrupt handler
+    
+    CANPins _pins;
+    static uint8_t _intBits;        //EIMSK bits of all controllers sharing the SPI bus
+    uint8_t _intMask;               //Their enable state saved by mcp2515_select()
+    
+#define  TX_CAN_QUEUE_SIZE  8
+    typedef struct {
+        msgCAN      message;
+        uint8_t     priority;
+        uint32_t    queued;                     //micros() when handed to sendTxSlot()
+    }TX_CAN_ENTRY;
+    TX_CAN_ENTRY    _txQueue[TX_CAN_QUEUE_SIZE + 1];    //Kept in order of sending, the one past the end is txSlot()
+    uint8_t         _txQueueCount;
+    uint8_t         _txQueueHighWater;
+    uint16_t        _txDropCount;
+    uint8_t         _txPriority[3];                 //Last TXP written to TXB0CTRL..TXB2CTRL
+    uint16_t        _txLoadedId[3];                 //Frame last loaded into TXB0..TXB2
+    uint16_t        _txDoneId[3];                   //Frame last sent from TXB0..TXB2
+    uint32_t        _txDoneTime[3];                 //micros() when its TXnIF was handled
+    uint32_t        _txLoadTime[3];                 //millis() when TXB0..TXB2 was loaded
+    uint32_t        _txQueuedTime[3];               //micros() its frame was handed to sendTxSlot()
+    msgCAN          _txContent[3];                  //What TXB0..TXB2 hold, see mcp2515_write_tx()
+    uint8_t         _txContentValid;                //Bit n set once TXBn was written since the reset
+    uint32_t        _txBytesSaved;                  //SPI bytes mcp2515_write_tx() did not have to send
+    uint32_t        _txCacheSince;                  //millis() at begin()
+    
+    uint16_t        _responderRequestId;            //0 = no responder
+    uint16_t        _responderReplyId;
+    uint32_t        _responderPending;              //micros() of the request still waiting for its reply, 0 = none
+    uint16_t        _replyCount;
+    uint16_t        _replyLatencyMax;               //us from request to reply TXnIF, saturating
+    uint32_t        _replyLatencySum;
+#if (CAN_FAST_RESPONDER==1)
+    ResponderFn     _responder;                     //TXB2 is reserved for its replies while set
+    uint32_t        _fastReplyRequest;              //micros() of the last request answered from TXB2
+#endif
+    
+#if (CAN_TX_STATISTICS==1)
     typedef struct {
-        msgCAN 	buffer[RX_CAN_BUFFER_SIZE];
-        uint8_t 	head;
-        uint8_t 	tail;
-    }RX_CAN_BUFFER;
-    RX_CAN_BUFFER    _CAN_RX_BUFFER;
+        uint16_t    id;                         //0 = free
+        uint16_t    sent;
+        uint16_t    arbitrationLost;            //Frames that lost arbitration at least once (MLOA)
+        uint16_t    errors;                     //Frames that hit a bus error at least once (TXERR)
+        uint16_t    aborted;                    //Frames aborted by checkErrors()
+        uint16_t    latencyMax;                 //us from sendTxSlot() to TXnIF, saturating
+        uint32_t    latencySum;
+        uint32_t    lastSent;                   //micros() of the last TXnIF
+        uint16_t    intervalMin;                //ms between two TXnIF of this id
+        uint16_t    intervalMax;
+        uint16_t    windowMin;                  //Allowed interval in ms, see setTxTiming(); windowMax 0 = not checked
+        uint16_t    windowMax;
+        uint16_t    burstGap;                   //A longer interval starts a new burst and is not checked, 0 = none
+        uint16_t    early;                      //Intervals below windowMin
+        uint16_t    late;                       //Intervals above windowMax
+        uint16_t    histogram[TX_TIMING_BINS];
+    }TX_CAN_STATS;
+    TX_CAN_STATS    _txStats[TX_STATS_IDS];
+    TX_CAN_STATS   *txStats(uint16_t id);
+#endif
+    
+    uint32_t        _errCheckTime;                  //millis() of the last checkErrors() pass
+    uint8_t         _eflg;                          //EFLG, TEC and REC as last read
+    uint8_t         _tec;
+    uint8_t         _rec;
+    uint16_t        _rxOverflowCount;
+    uint16_t        _txAbortCount;                  //Stale TX requests aborted with ABAT
+    volatile uint8_t _txAborting;                   //READ_STATUS TXREQ bits ABAT was set for, 0 = ABAT clear
+    uint16_t        _errorPassiveCount;
+    uint16_t        _busOffCount;
+    uint32_t        _busOffStart;                   //millis() bus-off was seen, 0 when not bus-off
+    uint32_t        _busOffLastMs;                  //Time the last bus-off took to recover
+    uint32_t        _busOffMaxMs;
+    
+#if (CAN_SPI_STATISTICS==1)
+    volatile uint8_t _spiOp;                    //SPI_OP_... the bytes clocked right now belong to
+    uint32_t _spiOpBytes[SPI_OP_COUNT];
+    uint16_t _spiOpCalls[SPI_OP_COUNT];         //For SPI_OP_READ: frames read
+#endif
     
     
     
@@ -70,8 +263,9 @@ private:
 //----------------------------------------------------------------------------
 
 extern CANClass CAN;
-extern CANClass::msgCAN CAN_TxMsg;
-extern CANClass::msgCAN CAN_RxMsg;
+#if defined(MCP2515_PBUS_CS)
+extern CANClass PBUS;
+#endif
 
 
 //----------------------------------------------------------------------------
@@ -107,6 +301,10 @@ extern CANClass::msgCAN CAN_RxMsg;
 // MCP2515 DEFINITIONS
 //----------------------------------------------------------------------------
 
+#define FILTER_MAX_IDS      16      // ComputeFilters() handles at most this many IDs
+#define FILTER_SEARCH_IDS   8       // Up to this many IDs every split between RXB0 and RXB1 is tried
+
+
 #define LISTEN_ONLY_MODE	0x01
 #define LOOPBACK_MODE		0x02
 #define SLEEP_MODE          0x03
@@ -0,0 +1,136 @@
+/*
+ * Compile time MCP2515 bit timing calculator
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef CANBITTIMING_H
+#define CANBITTIMING_H
+
+#include <inttypes.h>
+
+/**
+ * CANBitTiming<OSC, BITRATE, SAMPLE_POINT>::cnf1/cnf2/cnf3 are the MCP2515
+ * configuration registers for a bitrate in bit/s and a sample point in per
+ * mille, solved by the compiler:
+ *
+ *      TQ  = 2 * BRP / OSC                     BRP 1..64
+ *      bit = (1 + PropSeg + PS1 + PS2) * TQ    8..25 TQ
+ *
+ * Every BRP and bit length is tried. The best one has the smallest bitrate
+ * error, then the sample point closest to the one asked for, then the most
+ * TQ per bit. For the chosen length PS2 is what puts the sample point
+ * nearest to SAMPLE_POINT within the MCP2515's rules (2 <= PS2 <= PS1 +
+ * PropSeg, all segments 1..8 TQ), PropSeg gets half of the rest and PS1 the
+ * other half, SJW = min(4, PS2 - 1). BTLMODE is set so PS2 comes from CNF3,
+ * the bus is sampled once.
+ *
+ * A configuration more than CAN_TIMING_MAX_RATE_ERROR off the bitrate or
+ * CAN_TIMING_MAX_SP_ERROR off the sample point fails to compile.
+ */
+
+#define CAN_TIMING_MAX_RATE_ERROR   5       // per mille of the bitrate
+#define CAN_TIMING_MAX_SP_ERROR     50      // per mille of the bit
+
+namespace CANTiming {
+
+constexpr uint32_t absDiff(uint32_t a, uint32_t b) {
+    return (a > b) ? a - b : b - a;
+}
+
+constexpr int maxOf(int a, int b) { return (a > b) ? a : b; }
+constexpr int minOf(int a, int b) { return (a < b) ? a : b; }
+constexpr int clamp(int v, int lo, int hi) { return (v < lo) ? lo : (v > hi) ? hi : v; }
+
+// PS2 for a bit of ntq TQ
+constexpr uint8_t ps2(uint8_t ntq, uint16_t sp) {
+    return clamp(ntq - (int)((sp * (uint32_t)ntq + 500) / 1000),
+                 maxOf(2, ntq - 17),        // PropSeg + PS1 <= 16
+                 minOf(8, (ntq - 1) / 2));  // PS2 <= PropSeg + PS1
+}
+
+constexpr uint8_t tseg1(uint8_t ntq, uint16_t sp) { return ntq - 1 - ps2(ntq, sp); }
+constexpr uint8_t propSeg(uint8_t ntq, uint16_t sp) { return tseg1(ntq, sp) / 2; }
+constexpr uint8_t ps1(uint8_t ntq, uint16_t sp) { return tseg1(ntq, sp) - propSeg(ntq, sp); }
+constexpr uint8_t sjw(uint8_t ntq, uint16_t sp) { return minOf(4, ps2(ntq, sp) - 1); }
+
+// Sample point in per mille
+constexpr uint16_t samplePoint(uint8_t ntq, uint16_t sp) {
+    return (1 + tseg1(ntq, sp)) * 1000UL / ntq;
+}
+
+// OSC - bitrate * 2 * BRP * NTQ, the bitrate error scaled by 2 * BRP * NTQ
+constexpr uint32_t rateError(uint32_t osc, uint32_t bitrate, uint8_t brp, uint8_t ntq) {
+    return absDiff(osc, bitrate * 2UL * brp * ntq);
+}
+
+/*
+ Candidates are compared as one number, smaller is better:
+ bits 63..32 bitrate error, 31..16 sample point error, 15..11 25 - NTQ,
+ 10..5 BRP - 1, 4..0 NTQ
+ */
+constexpr uint64_t candidate(uint32_t osc, uint32_t bitrate, uint16_t sp, uint8_t brp, uint8_t ntq) {
+    return ((uint64_t)rateError(osc, bitrate, brp, ntq) << 32)
+         | ((uint64_t)absDiff(samplePoint(ntq, sp), sp) << 16)
+         | ((uint64_t)(25 - ntq) << 11)
+         | ((uint64_t)(brp - 1) << 5)
+         | ntq;
+}
+
+constexpr uint64_t better(uint64_t a, uint64_t b) { return (a < b) ? a : b; }
+
+constexpr uint64_t bestNtq(uint32_t osc, uint32_t bitrate, uint16_t sp, uint8_t brp, uint8_t ntq = 8) {
+    return (ntq == 25) ? candidate(osc, bitrate, sp, brp, ntq)
+         : better(candidate(osc, bitrate, sp, brp, ntq), bestNtq(osc, bitrate, sp, brp, ntq + 1));
+}
+
+constexpr uint64_t best(uint32_t osc, uint32_t bitrate, uint16_t sp, uint8_t brp = 1) {
+    return (brp == 64) ? bestNtq(osc, bitrate, sp, brp)
+         : better(bestNtq(osc, bitrate, sp, brp), best(osc, bitrate, sp, brp + 1));
+}
+
+constexpr uint8_t bestBrp(uint64_t c) { return ((c >> 5) & 0x3F) + 1; }
+constexpr uint8_t bestNtqOf(uint64_t c) { return c & 0x1F; }
+constexpr uint32_t bestRateError(uint64_t c) { return c >> 32; }
+constexpr uint16_t bestSpError(uint64_t c) { return (c >> 16) & 0xFFFF; }
+
+} // namespace CANTiming
+
+template <uint32_t OSC, uint32_t BITRATE, uint16_t SAMPLE_POINT>
+struct CANBitTiming
+{
+    static constexpr uint64_t solution = CANTiming::best(OSC, BITRATE, SAMPLE_POINT);
+    static constexpr uint8_t brp = CANTiming::bestBrp(solution);
+    static constexpr uint8_t ntq = CANTiming::bestNtqOf(solution);
+
+    // |OSC - BITRATE * 2 * BRP * NTQ| / OSC <= CAN_TIMING_MAX_RATE_ERROR / 1000
+    static_assert(CANTiming::bestRateError(solution) * 1000ULL <= (uint64_t)OSC * CAN_TIMING_MAX_RATE_ERROR,
+                  "Bitrate can not be reached with this oscillator");
+    static_assert(CANTiming::bestSpError(solution) <= CAN_TIMING_MAX_SP_ERROR,
+                  "Sample point can not be reached at this bitrate");
+
+    static constexpr uint16_t samplePoint = CANTiming::samplePoint(ntq, SAMPLE_POINT);
+
+    static constexpr uint8_t cnf1 = ((CANTiming::sjw(ntq, SAMPLE_POINT) - 1) << 6) | (brp - 1);
+    static constexpr uint8_t cnf2 = 0x80 | ((CANTiming::ps1(ntq, SAMPLE_POINT) - 1) << 3)
+                                         | (CANTiming::propSeg(ntq, SAMPLE_POINT) - 1);
+    static constexpr uint8_t cnf3 = CANTiming::ps2(ntq, SAMPLE_POINT) - 1;
+};
+
+#endif
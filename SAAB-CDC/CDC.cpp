@@ -25,7 +25,11 @@
 #include <Arduino.h>
 #include "CAN.h"
 #include "CDC.h"
+#include "FrameDispatcher.h"
+#include "FrameSchedule.h"
 #include "MessageSender.h"
+#include "PlaybackClock.h"
+#include "SidText.h"
 #include "RN52handler.h"
 #include "Timer.h"
 
@@ -36,59 +40,116 @@
  */
 
 MessageSender messageSender;
+SidText sidText;
 extern Timer time;
 void sendCdcActiveStatus(void*);
 void sendCdcPowerdownStatus(void*);
 void *currentCdcCmd = NULL;
-volatile unsigned long cdcStatusLastSendTime = 0;            // Timer used to ensure we send the CDC status frame in a timely manner
-unsigned long lastIcomingEventTime = 0;                      // Timer used for determening if we should treat current event as, for example, a long press of a button
 boolean cdcActive = false;                                   // True while our module, the simulated CDC, is active
 boolean sidWriteAccessWanted = false;                        // True while we want to write on SID
-volatile boolean cdcStatusResendNeeded = false;              // True if an internal operation has triggered the need to send the CDC status frame as an event
-volatile boolean cdcStatusResendDueToCdcCommand = false;     // True if the need for sending the CDC status frame was triggered by CDC_CONTROL frame (IHU)
-boolean writeTextOnDisplayTimerActive = false;               // True while we are writing custom text on SID every SID_CONTROL_TX_BASETIME interval
-int incomingEventCounter = 0;                                // Counter for incoming events to determine when we will treat the event, for example, as a long press of a button
-int displayRequestTimerId = -1;
-int writeTextOnDisplayTimerId = -1;
+boolean cdcStatusResendDueToCdcCommand = false;              // True if the pending CDC status event was triggered by CDC_CONTROL frame (IHU)
+unsigned char trackDataShown = 0;                            // BT.bt_track_data_count() of the metadata on the SID
+unsigned char trackLostSeen = 0;                             // BT.bt_track_lost_count() the playback clock was last cleared for
+PlaybackClock playbackClock;                                 // Track/minute/second for GENERAL_STATUS_CDC
 int currentNodeStatusTxTimerEvent = -1;
 int textToSidTimer = -1;
-unsigned char cdcPoweronCmd[NODE_STATUS_TX_MSG_SIZE][CAN_FRAME_LENGTH] = {
+const unsigned char cdcPoweronCmd[NODE_STATUS_TX_MSG_SIZE][CAN_FRAME_LENGTH] PROGMEM = {
     {0x32,0x00,0x00,0x03,0x01,0x02,0x00,0x00},
     {0x42,0x00,0x00,0x22,0x00,0x00,0x00,0x00},
     {0x52,0x00,0x00,0x22,0x00,0x00,0x00,0x00},
     {0x62,0x00,0x00,0x22,0x00,0x00,0x00,0x00}
 };
-unsigned char cdcActiveCmd[NODE_STATUS_TX_MSG_SIZE] [CAN_FRAME_LENGTH] = {
+const unsigned char cdcActiveCmd[NODE_STATUS_TX_MSG_SIZE] [CAN_FRAME_LENGTH] PROGMEM = {
     {0x32,0x00,0x00,0x16,0x01,0x02,0x00,0x00},
     {0x42,0x00,0x00,0x36,0x00,0x00,0x00,0x00},
     {0x52,0x00,0x00,0x36,0x00,0x00,0x00,0x00},
     {0x62,0x00,0x00,0x36,0x00,0x00,0x00,0x00},
 };
-unsigned char cdcPowerdownCmd[NODE_STATUS_TX_MSG_SIZE] [CAN_FRAME_LENGTH] = {
+const unsigned char cdcPowerdownCmd[NODE_STATUS_TX_MSG_SIZE] [CAN_FRAME_LENGTH] PROGMEM = {
     {0x32,0x00,0x00,0x19,0x01,0x00,0x00,0x00},
     {0x42,0x00,0x00,0x38,0x01,0x00,0x00,0x00},
     {0x52,0x00,0x00,0x38,0x01,0x00,0x00,0x00},
     {0x62,0x00,0x00,0x38,0x01,0x00,0x00,0x00}
 };
 
+/**
+ * Every frame we handle is registered here with its handler; the MCP2515 acceptance filters are set up from this table, so anything else never reaches us
+ */
+
+constexpr FrameHandler cdcRxHandlers[] = {
+    //ID                        Handler
+    {NODE_STATUS_RX_IHU,        &nodeStatusRequestOnFrame},
+    {CDC_CONTROL,               &ihuButtonsOnFrame},
+    {STEERING_WHEEL_BUTTONS,    &steeringWheelButtonsOnFrame},
+    {DISPLAY_RESOURCE_GRANT,    &displayResourceGrantOnFrame}
+};
+#define CDC_RX_HANDLER_COUNT    (sizeof(cdcRxHandlers) / sizeof(cdcRxHandlers[0]))
+
+static_assert(frameIdsUnique(cdcRxHandlers, CDC_RX_HANDLER_COUNT), "A frame ID is registered twice in cdcRxHandlers");
+
+FrameDispatcher<CDC_RX_HANDLER_COUNT, frameHashShift(cdcRxHandlers, CDC_RX_HANDLER_COUNT)> cdcRxDispatcher(cdcRxHandlers);
+
+/**
+ * Every frame we send on our own, with its timing requirements; handleCdcStatus() has cdcTxSchedule send them when they are due
+ * The SID frames are only started once we want, or have been granted, the display
+ */
+
+enum {
+    SCHEDULE_CDC_STATUS,
+    SCHEDULE_DISPLAY_REQUEST,
+    SCHEDULE_SID_TEXT
+};
+
+constexpr ScheduledFrame cdcTxFrames[] = {
+    //ID                            Period                      Tolerance %     Event gap                   Builder
+    {GENERAL_STATUS_CDC,            CDC_STATUS_TX_BASETIME,     10,             CDC_STATUS_TX_EVENT_GAP,    &cdcStatusOnSchedule},
+    {NODE_DISPLAY_RESOURCE_REQ,     SID_CONTROL_TX_BASETIME,    10,             0,                          &displayRequestOnSchedule},
+    {NODE_WRITE_TEXT_ON_DISPLAY,    SID_CONTROL_TX_BASETIME,    10,             SID_TEXT_TX_EVENT_GAP,      &sidTextOnSchedule}
+};
+#define CDC_TX_SCHEDULE_COUNT   (sizeof(cdcTxFrames) / sizeof(cdcTxFrames[0]))
+
+static_assert(cdcTxFrames[SCHEDULE_CDC_STATUS].id == GENERAL_STATUS_CDC &&
+              cdcTxFrames[SCHEDULE_DISPLAY_REQUEST].id == NODE_DISPLAY_RESOURCE_REQ &&
+              cdcTxFrames[SCHEDULE_SID_TEXT].id == NODE_WRITE_TEXT_ON_DISPLAY, "cdcTxFrames is out of order with its SCHEDULE_ indices");
+
+FrameSchedule<CDC_TX_SCHEDULE_COUNT> cdcTxSchedule(cdcTxFrames, &sendScheduledFrame);
+
+/**
+ * Buttons we do more with than their event frame, while the CDC is active; handleIhuButtons() and handleSteeringWheelButtons() feed cdcButtons their frames
+ */
+
+constexpr ButtonGesture cdcButtons[] = {
+    //Frame                     Byte    Code    Sub byte    Sub code    Long                Repeat          Double  Release                  Action
+    {STEERING_WHEEL_BUTTONS,    4,      0x04,   0,          0,          BUTTON_LONG_PRESS,  0,              0,      BUTTON_RELEASE_TIMEOUT,  &wheelNxtGesture},
+    {CDC_CONTROL,               1,      0x45,   0,          0,          BUTTON_LONG_PRESS,  0,              0,      BUTTON_RELEASE_TIMEOUT,  &ihuSeekUpGesture},
+    {CDC_CONTROL,               1,      0x46,   0,          0,          BUTTON_LONG_PRESS,  0,              0,      BUTTON_RELEASE_TIMEOUT,  &ihuSeekDownGesture},
+    {CDC_CONTROL,               1,      0x68,   2,          0x01,       BUTTON_LONG_PRESS,  BUTTON_REPEAT,  0,      BUTTON_RELEASE_TIMEOUT,  &ihuButton1Gesture},
+    {CDC_CONTROL,               1,      0x68,   2,          0x03,       BUTTON_LONG_PRESS,  0,              0,      BUTTON_RELEASE_TIMEOUT,  &ihuButton3Gesture},
+    {CDC_CONTROL,               1,      0x68,   2,          0x04,       BUTTON_LONG_PRESS,  BUTTON_REPEAT,  0,      BUTTON_RELEASE_TIMEOUT,  &ihuButton4Gesture},
+    {CDC_CONTROL,               1,      0x68,   2,          0x06,       BUTTON_LONG_PRESS,  0,              0,      BUTTON_RELEASE_TIMEOUT,  &ihuButton6Gesture}
+};
+#define CDC_BUTTON_COUNT        (sizeof(cdcButtons) / sizeof(cdcButtons[0]))
+
+ButtonGestures<CDC_BUTTON_COUNT> cdcButtonGestures(cdcButtons);
+
 /* Format of SOUND_REQUEST frame:
  ID: SOUND_REQUEST
  [0]: Sent on basetime/event; 0 = Basetime; 80 = Event
  [1]: Type of sound
  [2-7]: Zeroed out; not in use
  */
-unsigned char soundCmd[] = {0x80,0x04,0x00,0x00,0x00,0x00,0x00,0x00};
+const unsigned char soundCmd[] PROGMEM = {0x80,0x04,0x00,0x00,0x00,0x00,0x00,0x00};
 
 /**
  * DEBUG: Prints the CAN Tx frame to serial output
  */
 
-void CDChandler::printCanTxFrame() {
+void CDChandler::printCanTxFrame(const CANClass::msgCAN &frame) {
 #if (DEBUGMODE==1)
-    Serial.print(CAN_TxMsg.id,HEX);
+    Serial.print(frame.id(),HEX);
     Serial.print(F(" Tx-> "));
     for (int i = 0; i < CAN_FRAME_LENGTH; i++) {
-        Serial.print(CAN_TxMsg.data[i],HEX);
+        Serial.print(frame.data[i],HEX);
         Serial.print(" ");
     }
     Serial.println();
@@ -99,12 +160,12 @@ void CDChandler::printCanTxFrame() {
  * DEBUG: Prints the CAN Rx frame to serial output
  */
 
-void CDChandler::printCanRxFrame() {
+void CDChandler::printCanRxFrame(const CANClass::msgCAN &frame) {
 //#if (DEBUGMODE==1)
-    Serial.print(CAN_RxMsg.id,HEX);
+    Serial.print(frame.id(),HEX);
     Serial.print(F(" Rx-> "));
     for (int i = 0; i < CAN_FRAME_LENGTH; i++) {
-        Serial.print(CAN_RxMsg.data[i],HEX);
+        Serial.print(frame.data[i],HEX);
         Serial.print(" ");
     }
     Serial.println();
@@ -116,60 +177,95 @@ void CDChandler::printCanRxFrame() {
  */
 
 void CDChandler::openCanBus() {
+    uint16_t filters[6];
+    uint16_t masks[2];
+    uint16_t ids[CDC_RX_HANDLER_COUNT];
+    
     CAN.begin(47);
-    CAN_TxMsg.header.rtr = 0;
-    CAN_TxMsg.header.length = CAN_FRAME_LENGTH;
+    
+    // Have the CAN driver check the intervals of our frames on the bus; 'S' on the console shows the results
+    CAN.setTxTiming(GENERAL_STATUS_CDC, CDC_STATUS_TX_EVENT_GAP, CDC_STATUS_TX_BASETIME * 11 / 10);
+    CAN.setTxTiming(NODE_STATUS_TX_CDC, NODE_STATUS_TX_INTERVAL * 9 / 10, NODE_STATUS_TX_INTERVAL * 11 / 10, NODE_STATUS_TX_INTERVAL * 2);
+    CAN.setTxTiming(NODE_DISPLAY_RESOURCE_REQ, SID_CONTROL_TX_BASETIME * 9 / 10, SID_CONTROL_TX_BASETIME * 11 / 10);
+    
+    // Let the MCP2515 drop frames we have no use for, instead of reading every single one of them over SPI
+    cdcRxDispatcher.getIds(ids);
+    uint16_t foreignIds = CAN.ComputeFilters(ids, CDC_RX_HANDLER_COUNT, filters, masks);
+    CAN.SetFilters(filters, masks);
+    Serial.print(F("CAN filters let through foreign IDs: "));
+    Serial.println(foreignIds);
+    
+    // The first '6A2' reply goes out straight from the CAN interrupt, see nodeStatusFastReply()
+    CAN.setResponder(NODE_STATUS_RX_IHU, NODE_STATUS_TX_CDC, &nodeStatusFastReply, cdcActiveCmd[0]);
+    
+    cdcTxSchedule.start(SCHEDULE_CDC_STATUS);
+    writeTextOnDisplay(MODULE_NAME);
 }
 
 /**
- * Handles an incoming (Rx)frame
+ * Handles incoming (Rx)frames; they are pulled off the MCP2515 by the CAN interrupt, so here we only consume what has been buffered and pass each one to its handler in cdcRxHandlers
+ * Handlers get the frame where the interrupt left it in the CAN driver's buffer; the slot is not reused until pop()
  */
 
 void CDChandler::handleRxFrame() {
-    if (CAN.CheckNew()) {
-        CAN_TxMsg.data[0]++;
-        CAN.ReadFromDevice(&CAN_RxMsg);
-        switch (CAN_RxMsg.id) {
-            case NODE_STATUS_RX_IHU:
-                /*
-                 Here be dragons... This part of the code is responsible for causing lots of headache
-                 We look at the bottom half of 3rd byte of '6A1' frame to determine what the "reply" should be
-                 */
-                switch (CAN_RxMsg.data[3] & 0x0F){
-                    case (0x3):
-                        messageSender.sendCanMessage(NODE_STATUS_TX_CDC,cdcPoweronCmd,4,NODE_STATUS_TX_INTERVAL);
-                        break;
-                    case (0x2):
-                        messageSender.sendCanMessage(NODE_STATUS_TX_CDC,cdcActiveCmd,4,NODE_STATUS_TX_INTERVAL);
-                        break;
-                    case (0x8):
-                        messageSender.sendCanMessage(NODE_STATUS_TX_CDC,cdcPowerdownCmd,4,NODE_STATUS_TX_INTERVAL);
-                        break;
-                }
-                break;
-            case CDC_CONTROL:
-                handleIhuButtons();
-                break;
-            case STEERING_WHEEL_BUTTONS:
-                handleSteeringWheelButtons();
-                break;
-            case DISPLAY_RESOURCE_GRANT:
-                if ((cdcActive) && (CAN_RxMsg.data[0] == 0x02)) {
-                    if (CAN_RxMsg.data[1] == NODE_SID_FUNCTION_ID) {
-                        // We have been granted the right to write text to the second row on the SID"
-                        if (!writeTextOnDisplayTimerActive) {
-                            writeTextOnDisplayTimerId = time.every(SID_CONTROL_TX_BASETIME, &writeTextOnDisplayOnTime,NULL);
-                            writeTextOnDisplayTimerActive = true;
-                        }
-                    }
-                    else {
-                        // ”OK to write” = false
-                    }
-                }
-                break;
-            default:
-                break;
-                
+    while (CAN.available()) {
+        cdcRxDispatcher.dispatch(CAN.front());
+        CAN.pop();
+    }
+}
+
+/**
+ * Picks the set of '6A2' frames (in PROGMEM) that answers a NODE_STATUS_RX_IHU ('6A1') request; NULL if the request needs no reply
+ */
+
+static const unsigned char (*nodeStatusReply(const CANClass::msgCAN &frame))[CAN_FRAME_LENGTH] {
+    /*
+     Here be dragons... This part of the code is responsible for causing lots of headache
+     We look at the bottom half of 3rd byte of '6A1' frame to determine what the "reply" should be
+     */
+    switch (frame.data[3] & 0x0F){
+        case (0x3):
+            return cdcPoweronCmd;
+        case (0x2):
+            return cdcActiveCmd;
+        case (0x8):
+            return cdcPowerdownCmd;
+    }
+    return NULL;
+}
+
+/**
+ * Handles the NODE_STATUS_RX_IHU ('6A1') request
+ * Unless the CAN interrupt already sent the first frame of the reply, the whole set goes out from here; otherwise only the rest, on the same schedule
+ */
+
+void CDChandler::handleNodeStatusRequest(const CANClass::rxMsgCAN &frame) {
+    const unsigned char (*reply)[CAN_FRAME_LENGTH] = nodeStatusReply(frame);
+    
+    if (reply) {
+        if (CAN.fastReplySent(frame)) {
+            messageSender.sendCanMessage_P(NODE_STATUS_TX_CDC,reply,NODE_STATUS_TX_MSG_SIZE,NODE_STATUS_TX_INTERVAL,(micros() - frame.timestamp) / 1000);
+        }
+        else {
+            messageSender.sendCanMessage_P(NODE_STATUS_TX_CDC,reply,NODE_STATUS_TX_MSG_SIZE,NODE_STATUS_TX_INTERVAL);
+        }
+    }
+}
+
+/**
+ * Handles the DISPLAY_RESOURCE_GRANT frame
+ */
+
+void CDChandler::handleDisplayResourceGrant(const CANClass::rxMsgCAN &frame) {
+    if ((cdcActive) && (frame.data[0] == 0x02)) {
+        if (frame.data[1] == NODE_SID_FUNCTION_ID) {
+            // We have been granted the right to write text to the second row on the SID"
+            if (!cdcTxSchedule.isRunning(SCHEDULE_SID_TEXT)) {
+                cdcTxSchedule.start(SCHEDULE_SID_TEXT);
+            }
+        }
+        else {
+            // ”OK to write” = false
         }
     }
 }
@@ -178,34 +274,35 @@ void CDChandler::handleRxFrame() {
  * Handles the CDC_CONTROL frame that the IHU sends us when it wants to control some feature of the CDC
  */
 
-void CDChandler::handleIhuButtons() {
-    boolean event = (CAN_RxMsg.data[0] == 0x80);
-    if ((!event) && (cdcActive)) {
-        checkCanEvent(1);
-        return;
+void CDChandler::handleIhuButtons(const CANClass::rxMsgCAN &frame) {
+    boolean event = (frame.data[0] == 0x80);
+    if (cdcActive) {
+        cdcButtonGestures.onFrame(frame.id(), frame.data, frame.timestamp);
+        if (!event) {
+            return;
+        }
     }
-    switch (CAN_RxMsg.data[1]) {
+    switch (frame.data[1]) {
         case 0x24: // CDC = ON (CD/RDM button has been pressed twice)
             cdcActive = true;
             BT.bt_reconnect();
             //sidWriteAccessWanted = true;
-            //displayRequestTimerId = time.every(SID_CONTROL_TX_BASETIME, &sendDisplayRequestOnTime,NULL);
-            sendCanFrame(SOUND_REQUEST, soundCmd);
+            //cdcTxSchedule.start(SCHEDULE_DISPLAY_REQUEST);
+            sendCanFrame(SOUND_REQUEST, soundCmd, true);
             break;
         case 0x14: // CDC = OFF (Back to Radio or Tape mode)
             //sidWriteAccessWanted = false;
-            //time.stop(writeTextOnDisplayTimerId);
-            //writeTextOnDisplayTimerActive = false;
-            //time.stop(displayRequestTimerId);
+            //cdcTxSchedule.stop(SCHEDULE_SID_TEXT);
+            //cdcTxSchedule.stop(SCHEDULE_DISPLAY_REQUEST);
             BT.bt_disconnect();
             cdcActive = false;
             break;
         default:
             break;
     }
-    if ((event) && (CAN_RxMsg.data[1] != 0x00)) {
+    if ((event) && (frame.data[1] != 0x00)) {
         if (cdcActive) {
-            switch (CAN_RxMsg.data[1]) {
+            switch (frame.data[1]) {
                 case 0x59: // NXT
                     BT.bt_play();
                     break;
@@ -228,7 +325,7 @@ void CDChandler::handleIhuButtons() {
                     BT.bt_prev();
                     break;
                 case 0x68: // IHU buttons "1-6"
-                    switch (CAN_RxMsg.data[2]) {
+                    switch (frame.data[2]) {
                         case 0x01:
                             BT.bt_volup();
                             break;
@@ -250,8 +347,8 @@ void CDChandler::handleIhuButtons() {
                     break;
             }
         }
-        cdcStatusResendNeeded = true;
         cdcStatusResendDueToCdcCommand = true;
+        cdcTxSchedule.trigger(SCHEDULE_CDC_STATUS);
     }
 }
 
@@ -260,10 +357,10 @@ void CDChandler::handleIhuButtons() {
  * TODO connect the SID button events to actions
  */
 
-void CDChandler::handleSteeringWheelButtons() {
+void CDChandler::handleSteeringWheelButtons(const CANClass::rxMsgCAN &frame) {
     if (cdcActive) {
-        checkCanEvent(4);
-        switch (CAN_RxMsg.data[2]) {
+        cdcButtonGestures.onFrame(frame.id(), frame.data, frame.timestamp);
+        switch (frame.data[2]) {
             case 0x04: // NXT button on wheel
                 //BT.bt_play();
                 break;
@@ -281,27 +378,48 @@ void CDChandler::handleSteeringWheelButtons() {
 
 /**
  * Handles CDC status and sends it to IHU as necessary
+ * The CDC status frame goes out every CDC_STATUS_TX_BASETIME, and as an event (no more often than CDC_STATUS_TX_EVENT_GAP) when we have triggered it; see cdcTxFrames
  */
 
 void CDChandler::handleCdcStatus() {
     
+    CAN.checkErrors();
+    CAN.update();
     handleRxFrame();
-    
-    // If the CDC status frame needs to be sent as an event, do so now
-    // (note though, that we may not send the frame more often than once every 50 ms)
-    
-    if (cdcStatusResendNeeded && (millis() - cdcStatusLastSendTime > 50)) {
-        sendCdcStatus(cdcStatusResendNeeded, cdcStatusResendDueToCdcCommand, cdcActive);
+    if (BT.bt_track_data_count() != trackDataShown) {
+        trackDataShown = BT.bt_track_data_count();
+        const RN52::TrackData *track = BT.bt_track_data();
+        if (track) {
+            playbackClock.setTrack(track->number, track->duration);
+            cdcTxSchedule.trigger(SCHEDULE_CDC_STATUS);
+        }
+        showTrackData();
     }
-    
-    // CDC status frame must be sent with a 1000 ms periodicity:
-    if (millis() - cdcStatusLastSendTime > CDC_STATUS_TX_BASETIME) {
-        // Send the CDC status frame, marked periodical and triggered internally:
-        sendCdcStatus(cdcStatusResendNeeded, cdcStatusResendDueToCdcCommand, cdcActive);
+    else if (BT.bt_track_lost_count() != trackLostSeen) {
+        // Not while AD is merely being fetched, the clock counts on until the new track is in
+        trackLostSeen = BT.bt_track_lost_count();
+        playbackClock.clear();
     }
+    playbackClock.setPlaying(BT.bt_streaming());
+    cdcButtonGestures.run(micros());
+    cdcTxSchedule.run();
 }
 
-void CDChandler::sendCdcStatus(boolean event, boolean remote, boolean cdcActive) {
+/**
+ * True while CAN work with a hard deadline waits: received frames not handled yet (a '6A1' wants its reply), or the
+ * next frame of a '6A2' set (NODE_STATUS_TX_INTERVAL, +/- 10%) due within BT_CAN_GUARD
+ * The main loop holds back the RN52 side meanwhile, since its soft-UART writes keep interrupts off for about 1 ms a byte
+ */
+
+boolean CDChandler::canWorkPending() {
+    return CAN.available() || messageSender.nextFrameIn() < BT_CAN_GUARD;
+}
+
+/**
+ * Builds the GENERAL_STATUS_CDC frame
+ */
+
+void CDChandler::buildCdcStatus(unsigned char *data, boolean event, boolean remote, boolean cdcActive) {
     
     /* Format of GENERAL_STATUS_CDC frame:
      ID: CDC node ID
@@ -324,30 +442,21 @@ void CDChandler::sendCdcStatus(boolean event, boolean remote, boolean cdcActive)
     
     byte discMode          = 0x05;  // Play; 0x0E can also be tried for "test mode" but might stop IHU from updating the display
     
-    unsigned char cdcGeneralStatusCmd[CAN_FRAME_LENGTH];
-    cdcGeneralStatusCmd[0] = ((event ? 0x07 : 0x00) | (remote ? 0x00 : 0x01)) << 5;
-    cdcGeneralStatusCmd[1] = (cdcActive ? 0xFF : 0x00);                             // Validation for presence of six discs in the magazine
-    cdcGeneralStatusCmd[2] = (cdcActive ? 0x3F : 0x01);                             // There are six discs in the magazine
-    cdcGeneralStatusCmd[3] = (cdcActive ? 0x41 : 0x01);                             // ToDo: check 0x01 | (discMode << 4) | 0x01
-    cdcGeneralStatusCmd[4] = 0xFF;
-    cdcGeneralStatusCmd[5] = 0xFF;
-    cdcGeneralStatusCmd[6] = 0xFF;
-    cdcGeneralStatusCmd[7] = 0xD0;
-
-    sendCanFrame(GENERAL_STATUS_CDC, cdcGeneralStatusCmd);
-
-    // Record the time of sending and reset status variables
-    cdcStatusLastSendTime = millis();
-    cdcStatusResendNeeded = false;
-    cdcStatusResendDueToCdcCommand = false;
-    
+    data[0] = ((event ? 0x07 : 0x00) | (remote ? 0x00 : 0x01)) << 5;
+    data[1] = (cdcActive ? 0xFF : 0x00);                             // Validation for presence of six discs in the magazine
+    data[2] = (cdcActive ? 0x3F : 0x01);                             // There are six discs in the magazine
+    data[3] = (cdcActive ? 0x41 : 0x01);                             // ToDo: check 0x01 | (discMode << 4) | 0x01
+    data[4] = (cdcActive ? playbackClock.bcdTrack() : PLAYBACK_CLOCK_UNKNOWN);   // BCD, counted on locally between RN52 events
+    data[5] = (cdcActive ? playbackClock.bcdMinute() : PLAYBACK_CLOCK_UNKNOWN);
+    data[6] = (cdcActive ? playbackClock.bcdSecond() : PLAYBACK_CLOCK_UNKNOWN);
+    data[7] = 0xD0;
 }
 
 /**
- * Sends a request for using the SID, row 2. We may NOT start writing until we've received a grant frame with the correct function ID!
+ * Builds a request for using the SID, row 2. We may NOT start writing until we've received a grant frame with the correct function ID!
  */
 
-void CDChandler::sendDisplayRequest(boolean sidWriteAccessWanted) {
+void CDChandler::buildDisplayRequest(unsigned char *data, boolean sidWriteAccessWanted) {
     
     /* Format of NODE_DISPLAY_RESOURCE_REQ frame:
      ID: Node ID requesting to write on SID
@@ -358,125 +467,185 @@ void CDChandler::sendDisplayRequest(boolean sidWriteAccessWanted) {
      [4-7]: Zeroed out; not in use
      */
     
-    unsigned char displayRequestCmd[CAN_FRAME_LENGTH];
-    displayRequestCmd[0] = NODE_APL_ADR;
-    displayRequestCmd[1] = 0x02;
-    displayRequestCmd[2] = (sidWriteAccessWanted ? 0x05 : 0xFF);
-    displayRequestCmd[3] = NODE_SID_FUNCTION_ID;
-    displayRequestCmd[4] = 0x00;
-    displayRequestCmd[5] = 0x00;
-    displayRequestCmd[6] = 0x00;
-    displayRequestCmd[7] = 0x00;
+    data[0] = NODE_APL_ADR;
+    data[1] = 0x02;
+    data[2] = (sidWriteAccessWanted ? 0x05 : 0xFF);
+    data[3] = NODE_SID_FUNCTION_ID;
+    data[4] = 0x00;
+    data[5] = 0x00;
+    data[6] = 0x00;
+    data[7] = 0x00;
+}
+
+/**
+ * Formats and puts a frame on CAN bus; with inFlash the data bytes are read from PROGMEM
+ */
 
-    sendCanFrame(NODE_DISPLAY_RESOURCE_REQ, displayRequestCmd);
+void CDChandler::sendCanFrame(int messageId, const unsigned char *msg, boolean inFlash) {
+    uint8_t priority;
+    
+    // Frames with timing requirements on the IHU side go ahead of SID traffic when the MCP2515 has a backlog
+    switch (messageId) {
+        case NODE_STATUS_TX_CDC:
+        case GENERAL_STATUS_CDC:
+            priority = TX_PRIORITY_HIGHEST;
+            break;
+        case SOUND_REQUEST:
+            priority = TX_PRIORITY_HIGH;
+            break;
+        case NODE_DISPLAY_RESOURCE_REQ:
+            priority = TX_PRIORITY_MEDIUM;
+            break;
+        default:
+            priority = TX_PRIORITY_LOW;
+            break;
+    }
+    
+    // Build the frame right in the CAN driver's tx queue
+    CANClass::msgCAN *frame = CAN.txSlot();
+    frame->setHeader(messageId, 0, CAN_FRAME_LENGTH);
+    readCanFrame(frame->data, msg, inFlash);
+    if (CAN.sendTxSlot(priority) == 0xFF) {
+#if (DEBUGMODE==1)
+        Serial.print(F("Tx queue full, dropped frame "));
+        Serial.println(messageId,HEX);
+#endif
+    }
 }
 
 /**
- * Formats and puts a frame on CAN bus
+ * Frame builders registered in cdcTxFrames
  */
 
-void CDChandler::sendCanFrame(int messageId, unsigned char *msg) {
-    CAN_TxMsg.id = messageId;
-    for (int i = 0; i < CAN_FRAME_LENGTH; i++) {
-        CAN_TxMsg.data[i] = msg[i];
+bool cdcStatusOnSchedule(uint8_t *data, bool event) {
+    CDC.buildCdcStatus(data, event, event && cdcStatusResendDueToCdcCommand, cdcActive);
+    if (event) {
+        cdcStatusResendDueToCdcCommand = false;
     }
-    CAN.send(&CAN_TxMsg);
+    return true;
+}
+
+bool displayRequestOnSchedule(uint8_t *data, bool) {
+    CDC.buildDisplayRequest(data, sidWriteAccessWanted);
+    return true;
+}
+
+bool sidTextOnSchedule(uint8_t *, bool) {
+    // Three frames 10 ms apart, MessageSender reads them out of sidText as they go;
+    // sidText leaves a group alone until the next but one, SID_TEXT_TX_EVENT_GAP apart at least
+    messageSender.sendCanMessage(NODE_WRITE_TEXT_ON_DISPLAY,sidText.nextFrames(),SID_TEXT_FRAMES,10);
+    return false;
+}
+
+void sendScheduledFrame(uint16_t id, uint8_t *data) {
+    CDC.sendCanFrame(id, data);
 }
 
 /**
- * Sends display request every SID_CONTROL_TX_BASETIME interval
+ * Frame handlers registered in cdcRxHandlers
  */
 
-void sendDisplayRequestOnTime(void*) {
-    CDC.sendDisplayRequest(sidWriteAccessWanted);
+void nodeStatusRequestOnFrame(const CANClass::rxMsgCAN &frame) {
+    CDC.handleNodeStatusRequest(frame);
 }
 
 /**
- * Writes provided text every SID_CONTROL_TX_BASETIME interval
+ * Runs inside the CAN interrupt: hands the driver the first '6A2' frame (in PROGMEM) for a '6A1' request, so it can go out before the main loop gets to the request
  */
 
-void writeTextOnDisplayOnTime(void*) {
-    CDC.writeTextOnDisplay(MODULE_NAME);
+const uint8_t *nodeStatusFastReply(const CANClass::msgCAN &request) {
+    const unsigned char (*reply)[CAN_FRAME_LENGTH] = nodeStatusReply(request);
+    return reply ? reply[0] : NULL;
+}
+
+void ihuButtonsOnFrame(const CANClass::rxMsgCAN &frame) {
+    CDC.handleIhuButtons(frame);
+}
+
+void steeringWheelButtonsOnFrame(const CANClass::rxMsgCAN &frame) {
+    CDC.handleSteeringWheelButtons(frame);
+}
+
+void displayResourceGrantOnFrame(const CANClass::rxMsgCAN &frame) {
+    CDC.handleDisplayResourceGrant(frame);
 }
 
 /**
- * Formats provided text for writing on the SID. This function assumes that we have been granted write access. Do not call it if we haven't!
- * Note: the character set used by the SID is slightly nonstandard. "Normal" characters should work fine.
+ * Gesture actions registered in cdcButtons; the short presses are already taken care of by the event frames
  */
 
-void CDChandler::writeTextOnDisplay(const char textIn[]) {
+void wheelNxtGesture(Gesture gesture) {
+    if (gesture == GESTURE_LONG) {
+        BT.bt_vassistant();
+    }
+}
 
-    if (!textIn) {
-        return;
+void ihuSeekUpGesture(Gesture gesture) {
+    if (gesture == GESTURE_LONG) {
+        BT.bt_visible();
+        CDC.sendCanFrame(SOUND_REQUEST, soundCmd, true);
+    }
+}
+
+void ihuSeekDownGesture(Gesture gesture) {
+    if (gesture == GESTURE_LONG) {
+        BT.bt_reboot();
+        CDC.sendCanFrame(SOUND_REQUEST, soundCmd, true);
     }
-    // Copy the provided string and make sure we have a new array of the correct length
-    char textToSid[15];
-    int i, m, n;
-    n = strlen(textIn);
-    n = n > 12 ? 12 : n;      // 12 is the number of characters SID can display on each row; anything beyond 12 is going to be zeroed out
-    for (i = 0; i < n; i++) {
-        textToSid[i] = textIn[i];
+}
+
+void ihuButton1Gesture(Gesture gesture) {
+    if (gesture == GESTURE_LONG || gesture == GESTURE_REPEAT) {
+        BT.bt_volup();
     }
-    for (i = n; i < 15; i++) {
-        textToSid[i] = 0;
+}
+
+void ihuButton3Gesture(Gesture gesture) {
+    if (gesture == GESTURE_LONG) {
+        BT.bt_visible();
+        CDC.sendCanFrame(SOUND_REQUEST, soundCmd, true);
     }
-    
-    unsigned char sidMessageGroup[3][CAN_FRAME_LENGTH] = {
-        {0x42,0x96,0x02,textToSid[0],textToSid[1],textToSid[2],textToSid[3],textToSid[4]},
-        {0x01,0x96,0x02,textToSid[5],textToSid[6],textToSid[7],textToSid[8],textToSid[9]},
-        {0x00,0x96,0x02,textToSid[10],textToSid[11],textToSid[12],textToSid[13],textToSid[14]}
-    };
-    
-    messageSender.sendCanMessage(NODE_WRITE_TEXT_ON_DISPLAY,sidMessageGroup,3,10);
+}
 
+void ihuButton4Gesture(Gesture gesture) {
+    if (gesture == GESTURE_LONG || gesture == GESTURE_REPEAT) {
+        BT.bt_voldown();
+    }
+}
+
+void ihuButton6Gesture(Gesture gesture) {
+    if (gesture == GESTURE_LONG) {
+        BT.bt_reboot();
+        CDC.sendCanFrame(SOUND_REQUEST, soundCmd, true);
+    }
 }
 
 /**
- * Checks for a long press of a button event
- * A long press is considered if the first byte of CAN frame != 0x80
- * Then we look at 'frameElement' passed in by function call to look at which element we should put the counter on
- * Once we reach 3 on the counter, we assert that a certain button has been held for a while and take an action accordingly
- * LAST_EVENT_IN_TIMEOUT indicates how many milliseconds have to pass till we reset all the counters and wait for the next potential long press to come in
+ * Sets the text for the second row on the SID; text longer than 12 characters scrolls. It goes out once we have been granted write access, and with every SID_CONTROL_TX_BASETIME after that
+ * A changed text is sent right away; the same text again costs nothing
+ * Note: the character set used by the SID is slightly nonstandard. "Normal" characters should work fine.
  */
 
-void CDChandler::checkCanEvent(int frameElement) {
-    boolean event = (CAN_RxMsg.data[0] == 0x80);
-    if (!event && (CAN_RxMsg.data[frameElement]) != 0) { // Long press of a steering wheel button has taken place.
-        if (millis() - lastIcomingEventTime > LAST_EVENT_IN_TIMEOUT) {
-            incomingEventCounter = 0;
-        }
-        incomingEventCounter++;
-        lastIcomingEventTime = millis();
-        if (incomingEventCounter == 3) {
-            switch (CAN_RxMsg.data[frameElement]) {
-                case 0x04: // NXT button on steering wheel
-                    BT.bt_vassistant();
-                    break;
-                case 0x45: // SEEK+ button long press on IHU
-                    BT.bt_visible();
-                    sendCanFrame(SOUND_REQUEST, soundCmd);
-                    break;
-                case 0x46: // SEEK- button long press on IHU
-                    BT.bt_reboot();
-                    sendCanFrame(SOUND_REQUEST, soundCmd);
-                    break;
-                case 0x68: // IHU buttons "1-6"
-                    switch (CAN_RxMsg.data[2]) {
-                        case 0x03:
-                            BT.bt_visible();
-                            sendCanFrame(SOUND_REQUEST, soundCmd);
-                            break;
-                        case 0x06:
-                            BT.bt_reboot();
-                            sendCanFrame(SOUND_REQUEST, soundCmd);
-                            break;
-                        default:
-                            break;
-                    }
-                default:
-                    break;
-            }
-        }
+void CDChandler::writeTextOnDisplay(const char textIn[]) {
+    if (sidText.setText(textIn)) {
+        cdcTxSchedule.trigger(SCHEDULE_SID_TEXT);
+    }
+}
+
+/**
+ * Puts "Artist - Title" of the track the RN52 last told us about on the SID; just the title if there is no artist
+ */
+
+void CDChandler::showTrackData() {
+    const RN52::TrackData *track = BT.bt_track_data();
+    if (!track || !track->title[0]) {
+        return;
+    }
+    char text[SID_TEXT_MAX_LENGTH + 1] = "";
+    if (track->artist[0]) {
+        strncat(text, track->artist, SID_TEXT_MAX_LENGTH);
+        strncat(text, " - ", SID_TEXT_MAX_LENGTH - strlen(text));
     }
-    return;
+    strncat(text, track->title, SID_TEXT_MAX_LENGTH - strlen(text));
+    writeTextOnDisplay(text);
 }
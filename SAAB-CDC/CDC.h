@@ -26,6 +26,8 @@
 #define CDC_H
 
 #include <Arduino.h>
+#include "CAN.h"
+#include "ButtonGestures.h"
 
 
 /**
@@ -58,7 +60,6 @@
  */
 
 #define MODULE_NAME                 "BlueSaab"
-#define LAST_EVENT_IN_TIMEOUT       3000    // Milliseconds
 #define NODE_STATUS_TX_MSG_SIZE     4       // Decimal; defines how many frames do we need to reply with to '6A1'
 
 /**
@@ -85,6 +86,12 @@
 #define NODE_STATUS_TX_INTERVAL     140     // Replies to '6A1' request need to be sent with no more than 140ms interval; tolerances +/- 10%
 #define CDC_STATUS_TX_BASETIME      950     // The CDC status frame must be sent periodically within this timeframe; tolerances +/- 10%
 #define SID_CONTROL_TX_BASETIME     1000    // SID control/resource request frames needs to be sent within this timeframe; tolerances +/- 10%
+#define CDC_STATUS_TX_EVENT_GAP     50      // The CDC status frame may not be sent as an event more often than this
+#define SID_TEXT_TX_EVENT_GAP       50      // A changed SID text goes out right away, but no more often than this
+#define BUTTON_LONG_PRESS           800     // A button held this long is a long press
+#define BUTTON_REPEAT               300     // Buttons that repeat do so this often after the long press
+#define BUTTON_RELEASE_TIMEOUT      3000    // A held button whose frames stop for this long counts as let go; the 3 s the old long press counter (LAST_EVENT_IN_TIMEOUT) allowed between frames
+#define BT_CAN_GUARD                15      // No RN52 work while a frame set of ours has a frame due within this many ms (a 12 byte command is ~12.5 ms of soft-UART)
 
 /**
  * Class:
@@ -92,22 +99,39 @@
 
 class CDChandler {
 public:
-    void printCanTxFrame();
-    void printCanRxFrame();
+    void printCanTxFrame(const CANClass::msgCAN &frame);
+    void printCanRxFrame(const CANClass::msgCAN &frame);
     void openCanBus();
     void handleRxFrame();
-    void handleIhuButtons();
-    void handleSteeringWheelButtons();
+    void handleNodeStatusRequest(const CANClass::rxMsgCAN &frame);
+    void handleIhuButtons(const CANClass::rxMsgCAN &frame);
+    void handleSteeringWheelButtons(const CANClass::rxMsgCAN &frame);
+    void handleDisplayResourceGrant(const CANClass::rxMsgCAN &frame);
     void handleCdcStatus();
-    void sendCdcStatus(boolean event, boolean remote, boolean cdcActive);
-    void sendDisplayRequest(boolean sidWriteAccessWanted);
-    void sendCanFrame(int message_id, unsigned char *msg);
+    boolean canWorkPending();
+    void buildCdcStatus(unsigned char *data, boolean event, boolean remote, boolean cdcActive);
+    void buildDisplayRequest(unsigned char *data, boolean sidWriteAccessWanted);
+    void sendCanFrame(int message_id, const unsigned char *msg, boolean inFlash = false);
     void writeTextOnDisplay(const char textIn[]);
-    void checkCanEvent(int frameElement);
+    void showTrackData();
 };
 
-void sendDisplayRequestOnTime(void*);
-void writeTextOnDisplayOnTime(void*);
+bool cdcStatusOnSchedule(uint8_t *data, bool event);
+bool displayRequestOnSchedule(uint8_t *data, bool event);
+bool sidTextOnSchedule(uint8_t *data, bool event);
+void sendScheduledFrame(uint16_t id, uint8_t *data);
+void nodeStatusRequestOnFrame(const CANClass::rxMsgCAN &frame);
+const uint8_t *nodeStatusFastReply(const CANClass::msgCAN &request);
+void ihuButtonsOnFrame(const CANClass::rxMsgCAN &frame);
+void steeringWheelButtonsOnFrame(const CANClass::rxMsgCAN &frame);
+void displayResourceGrantOnFrame(const CANClass::rxMsgCAN &frame);
+void wheelNxtGesture(Gesture gesture);
+void ihuSeekUpGesture(Gesture gesture);
+void ihuSeekDownGesture(Gesture gesture);
+void ihuButton1Gesture(Gesture gesture);
+void ihuButton3Gesture(Gesture gesture);
+void ihuButton4Gesture(Gesture gesture);
+void ihuButton6Gesture(Gesture gesture);
 
 /**
  * Variables:
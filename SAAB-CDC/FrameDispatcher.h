@@ -0,0 +1,120 @@
+/*
+ * C++ template for dispatching received CAN frames to their handlers by ID
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef FRAMEDISPATCHER_H
+#define FRAMEDISPATCHER_H
+
+#include <inttypes.h>
+#include "CAN.h"
+
+/**
+ * A module declares the frames it handles as a constexpr table:
+ *
+ *      constexpr FrameHandler rxHandlers[] = {
+ *          {CDC_CONTROL, &ihuButtonsOnFrame},
+ *          ...
+ *      };
+ *      static_assert(frameIdsUnique(rxHandlers, COUNT), "...");
+ *      FrameDispatcher<COUNT, frameHashShift(rxHandlers, COUNT)> rxDispatcher(rxHandlers);
+ *
+ * frameHashShift() looks for a shift that gives every ID its own bucket in
+ * (id >> shift) & (2^BITS - 1) at compile time, so dispatch() is one table
+ * lookup and one compare, no matter how many handlers there are.
+ */
+
+typedef void (*FrameHandlerFn)(const CANClass::rxMsgCAN &frame);
+
+struct FrameHandler {
+    uint16_t id;
+    FrameHandlerFn handler;
+};
+
+#define FRAME_HASH_BITS         3       // 8 buckets
+#define FRAME_HASH_NONE         0xFF
+
+constexpr bool frameIdsUnique(const FrameHandler *table, uint8_t count, uint8_t i = 0, uint8_t j = 1) {
+    return (i >= count) ? true
+         : (j >= count) ? frameIdsUnique(table, count, i + 1, i + 2)
+         : (table[i].id == table[j].id) ? false
+         : frameIdsUnique(table, count, i, j + 1);
+}
+
+constexpr uint8_t frameHash(uint16_t id, uint8_t shift, uint8_t bits) {
+    return (id >> shift) & ((1 << bits) - 1);
+}
+
+constexpr bool frameHashUnique(const FrameHandler *table, uint8_t count, uint8_t shift, uint8_t bits, uint8_t i = 0, uint8_t j = 1) {
+    return (i >= count) ? true
+         : (j >= count) ? frameHashUnique(table, count, shift, bits, i + 1, i + 2)
+         : (frameHash(table[i].id, shift, bits) == frameHash(table[j].id, shift, bits)) ? false
+         : frameHashUnique(table, count, shift, bits, i, j + 1);
+}
+
+// Smallest shift that puts every ID in a bucket of its own, FRAME_HASH_NONE if there is none
+constexpr uint8_t frameHashShift(const FrameHandler *table, uint8_t count, uint8_t bits = FRAME_HASH_BITS, uint8_t shift = 0) {
+    return (shift > 11 - bits) ? FRAME_HASH_NONE
+         : frameHashUnique(table, count, shift, bits) ? shift
+         : frameHashShift(table, count, bits, shift + 1);
+}
+
+template <uint8_t COUNT, uint8_t SHIFT, uint8_t BITS = FRAME_HASH_BITS>
+class FrameDispatcher
+{
+    static_assert(COUNT <= (1 << BITS), "More frame handlers than hash buckets, raise BITS");
+    static_assert(SHIFT != FRAME_HASH_NONE, "No collision free hash for these frame IDs, raise BITS");
+
+public:
+    FrameDispatcher(const FrameHandler *table) : table(table) {
+        for (uint8_t b = 0; b < (1 << BITS); b++) {
+            buckets[b] = 0xFF;
+        }
+        for (uint8_t i = 0; i < COUNT; i++) {
+            buckets[frameHash(table[i].id, SHIFT, BITS)] = i;
+        }
+    }
+
+    // Calls the handler registered for the frame's ID; false if there is none
+    bool dispatch(const CANClass::rxMsgCAN &frame) const {
+        uint16_t id = frame.id();
+        uint8_t i = buckets[frameHash(id, SHIFT, BITS)];
+        if (i == 0xFF || table[i].id != id) {
+            return false;
+        }
+        table[i].handler(frame);
+        return true;
+    }
+
+    // IDs of all handlers, e.g. for CANClass::ComputeFilters()
+    void getIds(uint16_t *ids) const {
+        for (uint8_t i = 0; i < COUNT; i++) {
+            ids[i] = table[i].id;
+        }
+    }
+
+    static uint8_t count() { return COUNT; }
+
+private:
+    const FrameHandler *table;
+    uint8_t buckets[1 << BITS];
+};
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * C++ template for sending periodic and event triggered CAN frames from a table
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef FRAMESCHEDULE_H
+#define FRAMESCHEDULE_H
+
+#include <Arduino.h>
+#include <inttypes.h>
+
+/**
+ * A module declares the frames it sends on its own as a constexpr table:
+ *
+ *      constexpr ScheduledFrame txSchedule[] = {
+ *          {GENERAL_STATUS_CDC, CDC_STATUS_TX_BASETIME, 10, CDC_STATUS_TX_EVENT_GAP, &cdcStatusOnSchedule},
+ *          ...
+ *      };
+ *      FrameSchedule<COUNT> schedule(txSchedule, &sendScheduledFrame);
+ *
+ * and calls schedule.run() from its loop. A started entry is sent every
+ * period ms; trigger() sends it early as an event, but no sooner than
+ * minEventGap ms after the last one, and restarts its period. run() keeps
+ * the earliest deadline of all entries and returns after one compare until
+ * it has passed.
+ *
+ * The builder fills in the data bytes and returns true to have the frame
+ * sent, or does the sending itself (e.g. a group of frames) and returns false.
+ */
+
+typedef bool (*FrameBuilderFn)(uint8_t *data, bool event);
+typedef void (*FrameSendFn)(uint16_t id, uint8_t *data);
+
+struct ScheduledFrame {
+    uint16_t id;
+    uint16_t period;            // ms, 0 = sent on trigger() only
+    uint8_t tolerance;          // % of the period a send may come late
+    uint16_t minEventGap;       // ms from the last send before an event may go out
+    FrameBuilderFn build;
+};
+
+#define FRAME_SCHEDULE_IDLE     1000    // ms between run() passes with nothing started
+
+template <uint8_t COUNT>
+class FrameSchedule
+{
+    static_assert(COUNT >= 1 && COUNT <= 8, "FrameSchedule keeps its entries in 8 bit masks");
+
+public:
+    FrameSchedule(const ScheduledFrame *table, FrameSendFn send) : table(table), send(send), running(0), events(0), next(0) {
+        for (uint8_t i = 0; i < COUNT; i++) {
+            late[i] = 0;
+        }
+    }
+
+    // Sends entry i every period from now on, the first one right away
+    void start(uint8_t i) {
+        uint32_t now = millis();
+        running |= (1 << i);
+        due[i] = now;
+        sent[i] = now - table[i].minEventGap;
+        next = now;
+    }
+
+    void stop(uint8_t i) {
+        running &= ~(1 << i);
+        events &= ~(1 << i);
+    }
+
+    bool isRunning(uint8_t i) const { return running & (1 << i); }
+
+    // Sends started entry i as an event, as soon as its minEventGap allows
+    void trigger(uint8_t i) {
+        if (!isRunning(i)) {
+            return;
+        }
+        events |= (1 << i);
+        uint32_t at = sent[i] + table[i].minEventGap;
+        if ((int32_t)(at - next) < 0) {
+            next = at;
+        }
+    }
+
+    void run() {
+        uint32_t now = millis();
+        if ((int32_t)(now - next) < 0) {
+            return;
+        }
+
+        uint32_t soonest = now + FRAME_SCHEDULE_IDLE;
+        for (uint8_t i = 0; i < COUNT; i++) {
+            uint8_t bit = (1 << i);
+            if (!(running & bit)) {
+                continue;
+            }
+            const ScheduledFrame &frame = table[i];
+            bool event = (events & bit) && (int32_t)(now - (sent[i] + frame.minEventGap)) >= 0;
+            bool periodic = frame.period && (int32_t)(now - due[i]) >= 0;
+
+            if (event || periodic) {
+                if (!event && (now - due[i]) * 100 > (uint32_t)frame.period * frame.tolerance) {
+                    late[i]++;
+                }
+                uint8_t data[8];
+                if (frame.build(data, event)) {
+                    send(frame.id, data);
+                }
+                sent[i] = now;
+                due[i] = now + frame.period;
+                events &= ~bit;
+            }
+
+            if (frame.period && (int32_t)(due[i] - soonest) < 0) {
+                soonest = due[i];
+            }
+            if ((events & bit) && (int32_t)(sent[i] + frame.minEventGap - soonest) < 0) {
+                soonest = sent[i] + frame.minEventGap;
+            }
+        }
+        next = soonest;
+    }
+
+    // Periodic sends that came more than the entry's tolerance after their due time
+    uint16_t getLateCount(uint8_t i) const { return late[i]; }
+
+    static uint8_t count() { return COUNT; }
+
+private:
+    const ScheduledFrame *table;
+    FrameSendFn send;
+    uint8_t running;            // Bit i: entry i is started
+    uint8_t events;             // Bit i: entry i waits to go out as an event
+    uint32_t next;              // millis() of the earliest deadline
+    uint32_t due[COUNT];        // millis() the next periodic send is due
+    uint32_t sent[COUNT];       // millis() of the last send
+    uint16_t late[COUNT];
+};
+
+#endif
@@ -30,9 +30,10 @@ extern Timer time;
 
 void sendFrame(void *p) {
     Message* msg = (Message*)p;
-    CDC.sendCanFrame(msg->frameId, msg->frames[msg->framesSent]);
+    CDC.sendCanFrame(msg->frameId, msg->frames[msg->framesSent], msg->inFlash);
     msg->framesSent++;
     if (msg->framesSent < msg->frameCount) {
+        msg->nextAt = millis() + msg->interval;
         time.after(msg->interval,sendFrame,msg);
     }
     else {
@@ -40,21 +41,52 @@ void sendFrame(void *p) {
     }
 }
 
-void MessageSender::sendCanMessage(int frameId, unsigned char frames[][CAN_FRAME_LENGTH], int frameCount, unsigned long interval) {
+void MessageSender::sendCanMessage(int frameId, const unsigned char frames[][CAN_FRAME_LENGTH], int frameCount, unsigned long interval) {
+    start(frameId, frames, false, frameCount, interval, NOT_SENT);
+}
+
+void MessageSender::sendCanMessage_P(int frameId, const unsigned char frames[][CAN_FRAME_LENGTH], int frameCount, unsigned long interval, unsigned long firstSentAgo) {
+    start(frameId, frames, true, frameCount, interval, firstSentAgo);
+}
+
+void MessageSender::start(int frameId, const unsigned char frames[][CAN_FRAME_LENGTH], bool inFlash, int frameCount, unsigned long interval, unsigned long firstSentAgo) {
     for (int i = 0; i < MESSAGE_COUNT; i++) {
         if (messages[i].frameCount == 0) {
             messages[i].frameCount = frameCount;
             messages[i].frameId = frameId;
             messages[i].interval = interval;
-            for (int frameNum = 0; frameNum < frameCount; frameNum++) {
-                for (int c = 0; c < CAN_FRAME_LENGTH; c++) {
-                    messages[i].frames[frameNum][c] = frames[frameNum][c];
-                }
-            }
-            CDC.sendCanFrame(messages[i].frameId, messages[i].frames[0]);
+            messages[i].frames = frames;
+            messages[i].inFlash = inFlash;
             messages[i].framesSent = 1;
-            time.after(messages[i].interval,sendFrame,&messages[i]);
+            if (firstSentAgo == NOT_SENT) {
+                CDC.sendCanFrame(messages[i].frameId, messages[i].frames[0], messages[i].inFlash);
+                messages[i].nextAt = millis() + messages[i].interval;
+                time.after(messages[i].interval,sendFrame,&messages[i]);
+            }
+            else if (frameCount > 1) {
+                unsigned long wait = (firstSentAgo < interval) ? interval - firstSentAgo : 0;
+                messages[i].nextAt = millis() + wait;
+                time.after(wait,sendFrame,&messages[i]);
+            }
+            else {
+                messages[i].frameCount = 0;
+            }
             break;
         }
     }
 }
+
+unsigned long MessageSender::nextFrameIn() {
+    unsigned long now = millis();
+    unsigned long soonest = NOT_SENT;
+    for (int i = 0; i < MESSAGE_COUNT; i++) {
+        if (messages[i].frameCount != 0) {
+            long left = (long)(messages[i].nextAt - now);
+            unsigned long in = (left > 0) ? left : 0;
+            if (in < soonest) {
+                soonest = in;
+            }
+        }
+    }
+    return soonest;
+}
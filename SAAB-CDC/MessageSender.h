@@ -25,15 +25,30 @@
 #ifndef MESSAGESENDER_H
 #define MESSAGESENDER_H
 
+#include <Arduino.h>
+
 const int CAN_FRAME_LENGTH = 8;
 const int MESSAGE_COUNT = 3;
+const unsigned long NOT_SENT = 0xFFFFFFFF;
+
+// Copies a frame out of a template in RAM or, with inFlash, in PROGMEM
+inline void readCanFrame(unsigned char *to, const unsigned char *frame, bool inFlash) {
+    if (inFlash) {
+        memcpy_P(to, frame, CAN_FRAME_LENGTH);
+    }
+    else {
+        memcpy(to, frame, CAN_FRAME_LENGTH);
+    }
+}
 
 struct Message {
     int frameId;
-    unsigned char frames[4][CAN_FRAME_LENGTH];
+    const unsigned char (*frames)[CAN_FRAME_LENGTH];    // Not a copy; the caller's frames are read as each one goes out
+    bool inFlash;
     int frameCount;
     int framesSent;
     unsigned long interval;
+    unsigned long nextAt;       // millis() the next frame is due
 };
 
 class MessageSender {
@@ -44,7 +59,15 @@ public:
             messages[i].frameCount = 0;
         }
     }
-    void sendCanMessage(int frameId, unsigned char frames[][CAN_FRAME_LENGTH], int frameCount, unsigned long interval);
+    // frames must stay put until the last one has gone out
+    void sendCanMessage(int frameId, const unsigned char frames[][CAN_FRAME_LENGTH], int frameCount, unsigned long interval);
+    // Same, with frames in PROGMEM; with firstSentAgo the first frame already went out that many ms ago
+    void sendCanMessage_P(int frameId, const unsigned char frames[][CAN_FRAME_LENGTH], int frameCount, unsigned long interval, unsigned long firstSentAgo = NOT_SENT);
+    // ms until the next frame of any message is due, NOT_SENT if none is pending
+    unsigned long nextFrameIn();
+    
+private:
+    void start(int frameId, const unsigned char frames[][CAN_FRAME_LENGTH], bool inFlash, int frameCount, unsigned long interval, unsigned long firstSentAgo);
 };
 
 
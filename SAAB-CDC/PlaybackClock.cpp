@@ -0,0 +1,96 @@
+/*
+ * C++ Class for keeping the playback position of the current Bluetooth track
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "PlaybackClock.h"
+
+PlaybackClock::PlaybackClock() : known(false), playing(false), number(0), duration(0), base(0), since(0) {
+}
+
+/**
+ * A new track has started; the clock goes back to 0:00 and keeps running if we are playing
+ */
+
+void PlaybackClock::setTrack(int number, unsigned long duration) {
+    known = true;
+    this->number = (number > 0 && number < 100) ? number : 0;
+    this->duration = duration;
+    base = 0;
+    since = millis();
+}
+
+/**
+ * Stops or restarts the clock where it is
+ */
+
+void PlaybackClock::setPlaying(bool playing) {
+    if (playing == this->playing) {
+        return;
+    }
+    base = position();
+    since = millis();
+    this->playing = playing;
+}
+
+/**
+ * Forgets the track, e.g. when the phone goes away
+ */
+
+void PlaybackClock::clear() {
+    known = false;
+    playing = false;
+    base = 0;
+}
+
+/**
+ * Position in the current track in ms; stays at the end of it if the next track has not been reported yet
+ */
+
+unsigned long PlaybackClock::position() const {
+    unsigned long pos = base + (playing ? millis() - since : 0);
+    if (duration && pos > duration) {
+        pos = duration;
+    }
+    return pos;
+}
+
+uint8_t PlaybackClock::bcdTrack() const {
+    return (known && number) ? toBcd(number) : PLAYBACK_CLOCK_UNKNOWN;
+}
+
+uint8_t PlaybackClock::bcdMinute() const {
+    return known ? toBcd(position() / 60000) : PLAYBACK_CLOCK_UNKNOWN;
+}
+
+uint8_t PlaybackClock::bcdSecond() const {
+    return known ? toBcd((position() / 1000) % 60) : PLAYBACK_CLOCK_UNKNOWN;
+}
+
+/**
+ * Two BCD digits; anything past 99 shows as 99
+ */
+
+uint8_t PlaybackClock::toBcd(unsigned long value) {
+    if (value > 99) {
+        value = 99;
+    }
+    return ((value / 10) << 4) | (value % 10);
+}
@@ -0,0 +1,61 @@
+/*
+ * C++ Class for keeping the playback position of the current Bluetooth track
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef PLAYBACKCLOCK_H
+#define PLAYBACKCLOCK_H
+
+#include <Arduino.h>
+
+#define PLAYBACK_CLOCK_UNKNOWN  0xFF    // Sent in the track/minute/second bytes while we know nothing
+
+/**
+ * The RN52 tells us when a track starts (AD metadata after the track change
+ * event) and when it is paused or resumed (streaming state after GPIO2), but
+ * not where in the track it is. The clock is set on those events only and
+ * counts on with millis() in between, so the GENERAL_STATUS_CDC track,
+ * minute and second bytes can be filled in on every send without asking
+ * the RN52 anything.
+ */
+class PlaybackClock {
+public:
+    PlaybackClock();
+    void setTrack(int number, unsigned long duration);
+    void setPlaying(bool playing);
+    void clear();
+    bool isPlaying() const { return playing; }
+    unsigned long position() const;
+    uint8_t bcdTrack() const;
+    uint8_t bcdMinute() const;
+    uint8_t bcdSecond() const;
+
+private:
+    static uint8_t toBcd(unsigned long value);
+
+    bool known;
+    bool playing;
+    uint8_t number;
+    unsigned long duration;             // ms, 0 = unknown
+    unsigned long base;                 // Position in ms at 'since'
+    unsigned long since;                // millis() the clock last started or stopped
+};
+
+#endif
@@ -30,5 +30,7 @@
 #define CMD_RX_BUFFER_SIZE		64
 #define CMD_QUEUE_SIZE			12 // Leave enough room to queue the config cmds in initialize()
 #define CMD_TIMEOUT				3000
+#define TRACK_FIELD_SIZE		24 // Characters kept of each AD text field (title, artist, album)
+#define TRACK_KEY_SIZE			12 // Longest AD key we look at is "TrackNumber"
 
 #endif /* RN52CONFIGURATION_H */
@@ -37,8 +37,11 @@ namespace RN52 {
     
     RN52driver::RN52driver() :
     mode(DATA), enterCommandMode(false), enterDataMode(false), state(0), profile(0), a2dpConnected(false),
-    sppConnected(false), streamingAudio(false), sppTxBufferPos(0), cmdRxBufferPos(0), currentCommand(NULL), commandQueuePos(0)
-    {}
+    sppConnected(false), streamingAudio(false), sppTxBufferPos(0), cmdRxBufferPos(0), currentCommand(NULL), commandQueuePos(0),
+    trackValid(false), trackCount(0), trackLostCount(0), trackBytes(0)
+    {
+        startTrackData();
+    }
     
     int RN52driver::fromUART(const char c)
     {
@@ -116,14 +119,20 @@ namespace RN52 {
         return size;
     }
     
+    // buffer is in RAM, cmd one of the RN52strings in flash
     static bool isCmd(const char *buffer, const char *cmd) {
-        return strncmp(buffer, cmd, strlen(cmd)) == 0;
+        return strncmp_P(buffer, cmd, strlen_P(cmd)) == 0;
     }
     
     int RN52driver::parseCmdResponse(const char *data, int size)
     {
         int parsed = 0;
         while (parsed < size) {
+            if (mode == COMMAND && currentCommand == RN52_CMD_GET_TRACK_DATA) {
+                // AD replies with several lines that can be longer than cmdRxBuffer; take them apart as they come
+                parseTrackData(data[parsed++]);
+                continue;
+            }
             if (cmdRxBufferPos == CMD_RX_BUFFER_SIZE) {
                 onError(4, OVERFLOW);
                 return -1;
@@ -171,10 +180,10 @@ namespace RN52 {
                     // TODO handle other responses, depending on the command sent before
                     if (currentCommand == NULL) {
                         cmdRxBuffer[cmdRxBufferPos - 2] = 0;
-                    } else if (isCmd(currentCommand, RN52_CMD_QUERY)) {
+                    } else if (currentCommand == RN52_CMD_QUERY) {
                         parseQResponse(cmdRxBuffer);
                         currentCommand = NULL;
-                    } else if (isCmd(currentCommand, RN52_CMD_DETAILS)) {
+                    } else if (currentCommand == RN52_CMD_DETAILS) {
                         // multiple lines
                         //TODO set currentCommand to NULL after the 10th line of response
                         currentCommand = NULL;
@@ -210,7 +219,9 @@ namespace RN52 {
                     for(int i = 1; i < commandQueuePos; i++)
                         commandQueue[i - 1] = commandQueue[i];
                     commandQueuePos--;
-                    toUART(currentCommand, strlen(currentCommand));
+                    if (currentCommand == RN52_CMD_GET_TRACK_DATA)
+                        startTrackData();
+                    sendCommand(currentCommand);
                 } else if (!enterDataMode){
                     enterDataMode = true;
                     prepareDataMode();
@@ -220,6 +231,33 @@ namespace RN52 {
         return parsed;
     }
     
+    /**
+     * Writes one of the RN52strings to the RN52 straight from flash
+     */
+    
+    void RN52driver::sendCommand(const char *cmd) {
+        char c;
+        while ((c = pgm_read_byte(cmd++)) != 0)
+            toUART(&c, 1);
+    }
+    
+    /**
+     * Gives up on a command the RN52 did not answer in time; a lost AD response counts as no metadata
+     */
+    
+    void RN52driver::abortCurrentCommand() {
+        if (currentCommand == RN52_CMD_GET_TRACK_DATA)
+            trackLostCount++;
+        currentCommand = NULL;
+        mode = DATA;
+        cmdRxBufferPos = 0;
+        enterDataMode = false;
+        if (commandQueuePos > 0) {
+            // there's outgoing command requests (yet or again)
+            prepareCommandMode();
+        }
+    }
+    
     int RN52driver::queueCommand(const char *cmd) {
         if (commandQueuePos == CMD_QUEUE_SIZE) {
             onError(5, OVERFLOW);
@@ -235,8 +273,8 @@ namespace RN52 {
     }
     
     void RN52driver::parseQResponse(const char data[4]) {
-        int profile =
-        (getVal(data[0]) << 4 | getVal(data[1])) & 0x0f;
+        int events = getVal(data[0]) << 4 | getVal(data[1]);
+        int profile = events & 0x0f;
         int state =
         (getVal(data[2]) << 4 | getVal(data[3])) & 0x0f;
         
@@ -250,7 +288,8 @@ namespace RN52 {
         
         bool changed = (this->state != state) || (this->profile != profile);
         //bool profilesChanged = this->profile != profile;
-        bool streamingChanged = (this->state == 13 && state != 13) || (this->state != 3 && state == 13);
+        bool streamingChanged = (this->state == 13) != (state == 13);
+        streamingAudio = (state == 13);
         this->state = state;
         this->profile = profile;
         
@@ -263,6 +302,124 @@ namespace RN52 {
             onProfileChange(SPP, sppConnected);
         if (lastA2dpConnected != a2dpConnected)
             onProfileChange(A2DP, a2dpConnected);
+        
+        // Bit 5 of the first byte is the track change event (S% bit 12). The metadata is only fetched then,
+        // and once when A2DP comes up for the track that is already playing; it is never polled.
+        if (a2dpConnected && (!lastA2dpConnected || (events & 0x20)))
+            getTrackData();
+        else if (!a2dpConnected) {
+            trackValid = false;
+            if (lastA2dpConnected)
+                trackLostCount++;
+        }
+    }
+    
+    /**
+     * Clears the cache and the parser before AD goes out; a response that never completes leaves hasTrackData() false
+     */
+    
+    void RN52driver::startTrackData() {
+        memset(&track, 0, sizeof(track));
+        trackValid = false;
+        trackBytes = 0;
+        trackField = TRACK_KEY;
+        trackKeyPos = 0;
+        trackText = NULL;
+        trackTextPos = 0;
+    }
+    
+    /**
+     * Takes the AD response one character at a time:
+     *
+     *      AOK
+     *      Title=...
+     *      Artist=...
+     *      Album=...
+     *      TrackNumber=...
+     *      TrackCount=...
+     *      Genre=...
+     *      Time(ms)=...
+     *
+     * Only the key of a line is buffered; values go straight into the cache, so nothing longer
+     * than TRACK_KEY_SIZE is ever held. The response is done after the Time(ms) line, or after
+     * ERR/? if the phone has no metadata for us.
+     */
+    
+    void RN52driver::parseTrackData(const char c) {
+        trackBytes++;
+        if (c == '\r')
+            return;
+        
+        if (c == '\n') {
+            bool done = false;
+            if (trackField == TRACK_KEY) {
+                // A line without '='
+                trackKey[trackKeyPos] = 0;
+                done = isCmd(trackKey, PSTR("ERR")) || trackKey[0] == '?';
+            } else if (trackField == TRACK_TIME) {
+                trackValid = true;
+                trackCount++;
+                done = true;
+            }
+            trackField = TRACK_KEY;
+            trackKeyPos = 0;
+            if (done) {
+                currentCommand = NULL;
+                if (trackValid)
+                    onTrackData(track);
+                else
+                    trackLostCount++;
+            }
+            return;
+        }
+        
+        switch (trackField) {
+            case TRACK_KEY:
+                if (c != '=') {
+                    if (trackKeyPos < TRACK_KEY_SIZE - 1)
+                        trackKey[trackKeyPos++] = c;
+                    break;
+                }
+                trackKey[trackKeyPos] = 0;
+                trackText = NULL;
+                trackTextPos = 0;
+                if (strcmp_P(trackKey, RN52_TRACK_TITLE) == 0)
+                    trackText = track.title;
+                else if (strcmp_P(trackKey, RN52_TRACK_ARTIST) == 0)
+                    trackText = track.artist;
+                else if (strcmp_P(trackKey, RN52_TRACK_ALBUM) == 0)
+                    trackText = track.album;
+                
+                if (trackText != NULL) {
+                    trackText[0] = 0;
+                    trackField = TRACK_TEXT;
+                } else if (strcmp_P(trackKey, RN52_TRACK_NUMBER) == 0) {
+                    track.number = 0;
+                    trackField = TRACK_NUMBER;
+                } else if (strcmp_P(trackKey, RN52_TRACK_TIME) == 0) {
+                    track.duration = 0;
+                    trackField = TRACK_TIME;
+                } else {
+                    trackField = TRACK_SKIP;
+                }
+                break;
+            case TRACK_TEXT:
+                if (trackTextPos < TRACK_FIELD_SIZE) {
+                    trackText[trackTextPos++] = c;
+                    trackText[trackTextPos] = 0;
+                }
+                break;
+            case TRACK_NUMBER:
+                if (c >= '0' && c <= '9')
+                    track.number = track.number * 10 + (c - '0');
+                break;
+            case TRACK_TIME:
+                if (c >= '0' && c <= '9')
+                    track.duration = track.duration * 10 + (c - '0');
+                break;
+            case TRACK_SKIP:
+                break;
+        }
     }
     
     void RN52driver::prepareCommandMode() {
@@ -372,7 +529,7 @@ namespace RN52 {
     void RN52driver::set_discovery_mask() {
 #if (DEBUGMODE==1)
         Serial.print(F("Setting discovery mask to: "));
-        Serial.println(RN52_SET_DISCOVERY_MASK);
+        Serial.println((const __FlashStringHelper *)RN52_SET_DISCOVERY_MASK);
 #endif
         queueCommand(RN52_SET_DISCOVERY_MASK);
     }
@@ -380,7 +537,7 @@ namespace RN52 {
     void RN52driver::set_connection_mask() {
 #if (DEBUGMODE==1)
         Serial.print(F("Setting connection mask to: "));
-        Serial.println(RN52_SET_CONNECTION_MASK);
+        Serial.println((const __FlashStringHelper *)RN52_SET_CONNECTION_MASK);
 #endif
         queueCommand(RN52_SET_CONNECTION_MASK);
     }
@@ -389,7 +546,7 @@ namespace RN52 {
     void RN52driver::set_cod() {
 #if (DEBUGMODE==1)
         Serial.print(F("Setting class of device to: "));
-        Serial.println(RN52_SET_COD);
+        Serial.println((const __FlashStringHelper *)RN52_SET_COD);
 #endif
         queueCommand(RN52_SET_COD);
     }
@@ -398,7 +555,7 @@ namespace RN52 {
     void RN52driver::set_device_name() {
 #if (DEBUGMODE==1)
         Serial.print(F("Setting device name to: "));
-        Serial.println(RN52_SET_DEVICE_NAME);
+        Serial.println((const __FlashStringHelper *)RN52_SET_DEVICE_NAME);
 #endif
         queueCommand(RN52_SET_DEVICE_NAME);
     }
@@ -407,7 +564,7 @@ namespace RN52 {
     void RN52driver::set_baudrate() {
 #if (DEBUGMODE==1)
         Serial.print(F("Setting RN52 baudrate to: "));
-        Serial.println(RN52_SET_BAUDRATE_9600);
+        Serial.println((const __FlashStringHelper *)RN52_SET_BAUDRATE_9600);
 #endif
         queueCommand(RN52_SET_BAUDRATE_9600);
     }
@@ -423,7 +580,7 @@ namespace RN52 {
     void RN52driver::set_extended_features() {
 #if (DEBUGMODE==1)
         Serial.print(F("Setting extended features to: "));
-        Serial.println(RN52_SET_EXTENDED_FEATURES);
+        Serial.println((const __FlashStringHelper *)RN52_SET_EXTENDED_FEATURES);
 #endif
         queueCommand(RN52_SET_EXTENDED_FEATURES);
     }
@@ -431,7 +588,7 @@ namespace RN52 {
     void RN52driver::set_pair_timeout() {
 #if (DEBUGMODE==1)
         Serial.print(F("Setting pair timeout to: "));
-        Serial.println(RN52_SET_PAIR_TIMEOUT);
+        Serial.println((const __FlashStringHelper *)RN52_SET_PAIR_TIMEOUT);
 #endif
         queueCommand(RN52_SET_PAIR_TIMEOUT);
     }
@@ -443,6 +600,13 @@ namespace RN52 {
         queueCommand(RN52_CMD_REBOOT);
     }
     
+    void RN52driver::getTrackData() {
+        queueCommand(RN52_CMD_GET_TRACK_DATA);
+#if (DEBUGMODE==1)
+        Serial.println(F("DEBUG: Fetching track metadata from RN52."));
+#endif
+    }
+    
     void RN52driver::refreshState() {
         queueCommand(RN52_CMD_QUERY);
     }
@@ -29,6 +29,19 @@
 
 namespace RN52 {
     
+    /**
+     * Metadata of the current track, as last returned by AD. Text fields are
+     * cut off at TRACK_FIELD_SIZE characters; numbers are 0 if the phone did
+     * not send them.
+     */
+    struct TrackData {
+        char title[TRACK_FIELD_SIZE + 1];
+        char artist[TRACK_FIELD_SIZE + 1];
+        char album[TRACK_FIELD_SIZE + 1];
+        int number;
+        unsigned long duration;             // ms
+    };
+    
     class RN52driver {
     public:
         enum BtProfile { IAP, SPP, A2DP, HFP };
@@ -61,24 +74,21 @@ namespace RN52 {
         void reboot();
         void visible(bool visible);
         int sendAVCRP(AVCRP cmd);
-        const char *currentCommand;
+        void getTrackData();
+        const TrackData &trackData() { return track; }
+        bool hasTrackData() { return trackValid; }
+        unsigned char getTrackDataCount() { return trackCount; }
+        unsigned char getTrackLostCount() { return trackLostCount; }
+        int getTrackDataBytes() { return trackBytes; }
+        const char *currentCommand;         // One of the RN52strings, in flash
         
     protected:
         void refreshState();
-        int queueCommand(const char *cmd);
+        int queueCommand(const char *cmd);  // cmd is one of the RN52strings, queued by address
         int getQueueSize() { 
           return (commandQueuePos);
         }
-        void abortCurrentCommand() {
-            currentCommand = NULL;
-            mode = DATA;
-            cmdRxBufferPos = 0;
-            enterDataMode = false;
-            if (commandQueuePos > 0) {
-                // there's outgoing command requests (yet or again)
-                prepareCommandMode();
-            }
-        }
+        void abortCurrentCommand();
         
     private:
         Mode mode;
@@ -98,14 +108,30 @@ namespace RN52 {
         const char *commandQueue[CMD_QUEUE_SIZE];
         int commandQueuePos;
         
+        enum TrackField { TRACK_KEY, TRACK_TEXT, TRACK_NUMBER, TRACK_TIME, TRACK_SKIP };
+        TrackData track;
+        bool trackValid;
+        unsigned char trackCount;           // Bumped on every complete AD response
+        unsigned char trackLostCount;       // Bumped when A2DP drops and when AD fails or times out
+        int trackBytes;                     // UART bytes of the last AD response
+        TrackField trackField;
+        char trackKey[TRACK_KEY_SIZE];
+        int trackKeyPos;
+        char *trackText;
+        int trackTextPos;
+        
         void prepareCommandMode();
+        void sendCommand(const char *cmd);
         void prepareDataMode();
         int parseCmdResponse(const char *data, int size);
         void parseQResponse(const char data[4]);
+        void startTrackData();
+        void parseTrackData(const char c);
         
         virtual void onStateChange(int state, int profile) {};
         virtual void onProfileChange(BtProfile profile, bool connected) {};
         virtual void onStreaming(bool streaming) {};
+        virtual void onTrackData(const TrackData &track) {};
         virtual void toUART(const char* c, int len) = 0;
         virtual void fromSPP(const char* c, int len) = 0;
         virtual void setMode(Mode mode) = 0;
@@ -24,6 +24,9 @@
 
 #include <avr/io.h>
 #include "RN52handler.h"
+#include "CAN.h"
+
+#define DEBUGMODE  0
 
 RN52handler BT;
 
@@ -32,55 +35,154 @@ RN52handler BT;
  */
 
 void RN52handler::update() {
+    uint8_t intent;
+    if (intents.pop(intent)) {
+        runIntent(intent);
+    }
     driver.update();
 }
 
+/**
+ * The bt_ commands only post an intent and return; update() passes one per loop on to the driver
+ * That way a CAN frame handler never ends up in the RN52 driver, and the soft-UART writes the commands lead to
+ * (interrupts off for about 1 ms a byte) only happen when the main loop has time for them, see CDChandler::canWorkPending()
+ */
+
+void RN52handler::post(BtIntent intent) {
+    if (!intents.push(intent)) {
+        // The loop has not got to the RN52 side for BT_INTENT_QUEUE_SIZE intents; this one is lost, count it like a CAN rx buffer overflow
+        intentDropCount++;
+        lastDroppedIntent = intent;
+#if (DEBUGMODE==1)
+        Serial.print(F("BT intent queue full, dropped: "));
+        Serial.println(intent);
+#endif
+        return;
+    }
+    if (intents.available() > intentHighWater) {
+        intentHighWater = intents.available();
+    }
+}
+
+void RN52handler::runIntent(uint8_t intent) {
+    switch (intent) {
+        case BT_PLAY:
+            driver.sendAVCRP(RN52::RN52driver::PLAYPAUSE);
+            break;
+        case BT_PREV:
+            driver.sendAVCRP(RN52::RN52driver::PREV);
+            break;
+        case BT_NEXT:
+            driver.sendAVCRP(RN52::RN52driver::NEXT);
+            break;
+        case BT_VASSISTANT:
+            driver.sendAVCRP(RN52::RN52driver::VASSISTANT);
+            break;
+        case BT_VOLUP:
+            driver.sendAVCRP(RN52::RN52driver::VOLUP);
+            break;
+        case BT_VOLDOWN:
+            driver.sendAVCRP(RN52::RN52driver::VOLDOWN);
+            break;
+        case BT_VISIBLE:
+            driver.visible(true);
+            break;
+        case BT_INVISIBLE:
+            driver.visible(false);
+            break;
+        case BT_RECONNECT:
+            driver.reconnectLast();
+            break;
+        case BT_DISCONNECT:
+            driver.disconnect();
+            break;
+        case BT_SET_MAXVOL:
+            driver.set_max_volume();
+            break;
+        case BT_REBOOT:
+            driver.reboot();
+            break;
+        default:
+            break;
+    }
+}
+
 void RN52handler::bt_play() {
-    driver.sendAVCRP(RN52::RN52driver::PLAYPAUSE);
+    post(BT_PLAY);
 }
 
 void RN52handler::bt_prev() {
-    driver.sendAVCRP(RN52::RN52driver::PREV);
+    post(BT_PREV);
 }
 
 void RN52handler::bt_next() {
-    driver.sendAVCRP(RN52::RN52driver::NEXT);
+    post(BT_NEXT);
 }
 
 void RN52handler::bt_vassistant() {
-    driver.sendAVCRP(RN52::RN52driver::VASSISTANT);
+    post(BT_VASSISTANT);
 }
 
 void RN52handler::bt_volup() {
-    driver.sendAVCRP(RN52::RN52driver::VOLUP);
+    post(BT_VOLUP);
 }
 
 void RN52handler::bt_voldown() {
-    driver.sendAVCRP(RN52::RN52driver::VOLDOWN);
+    post(BT_VOLDOWN);
 }
 
 void RN52handler::bt_visible() {
-    driver.visible(true);
+    post(BT_VISIBLE);
 }
 
 void RN52handler::bt_invisible() {
-    driver.visible(false);
+    post(BT_INVISIBLE);
 }
 
 void RN52handler::bt_reconnect() {
-    driver.reconnectLast();
+    post(BT_RECONNECT);
 }
 
 void RN52handler::bt_disconnect() {
-    driver.disconnect();
+    post(BT_DISCONNECT);
 }
 
 void RN52handler::bt_set_maxvol() {
-    driver.set_max_volume();
+    post(BT_SET_MAXVOL);
 }
 
 void RN52handler::bt_reboot() {
-    driver.reboot();
+    post(BT_REBOOT);
+}
+
+/**
+ * Metadata of the current track, or NULL if the RN52 has not sent any (yet)
+ * The driver fetches it on its own when the track changes; bt_track_data_count() moves on every time it does
+ */
+
+const RN52::TrackData *RN52handler::bt_track_data() {
+    return driver.hasTrackData() ? &driver.trackData() : NULL;
+}
+
+unsigned char RN52handler::bt_track_data_count() {
+    return driver.getTrackDataCount();
+}
+
+/**
+ * Moves on every time there is no metadata to be had: A2DP dropped, or fetching it failed or timed out
+ * bt_track_data() is also NULL while a fetch is under way, that on its own says nothing about the track
+ */
+
+unsigned char RN52handler::bt_track_lost_count() {
+    return driver.getTrackLostCount();
+}
+
+/**
+ * True while A2DP audio is streaming, as of the last state query (these follow GPIO2 events, not polling)
+ */
+
+bool RN52handler::bt_streaming() {
+    return driver.isStreamingAudio();
 }
 
 
@@ -130,6 +232,33 @@ void RN52handler::monitor_serial_input() {
                 bt_reboot();
                 Serial.println(F("Rebooting the RN52"));
                 break;
+            case 'S':
+                CAN.printStatistics();
+                break;
+            case 'T':
+                if (bt_track_data()) {
+                    const RN52::TrackData &track = *bt_track_data();
+                    Serial.print(F("Track "));
+                    Serial.print(track.number);
+                    Serial.print(F(": "));
+                    Serial.print(track.artist);
+                    Serial.print(F(" - "));
+                    Serial.print(track.title);
+                    Serial.print(F(" ("));
+                    Serial.print(track.album);
+                    Serial.print(F("), "));
+                    Serial.print(track.duration / 1000);
+                    Serial.println(F(" s"));
+                }
+                else {
+                    Serial.println(F("No track metadata"));
+                }
+                Serial.print(F("Metadata fetches: "));
+                Serial.print(driver.getTrackDataCount());
+                Serial.print(F(", UART bytes of the last one: "));
+                Serial.println(driver.getTrackDataBytes());
+                printStatistics();
+                break;
             default:
                 Serial.print(F("Invalid command."));
 #if (DEBUGMODE==1) // Need the extended watchdog period to show this help.
@@ -145,6 +274,8 @@ void RN52handler::monitor_serial_input() {
                 Serial.println(F("R - Previous Track/Beginning of Track"));
                 Serial.println(F("A - Invoke Voice Assistant"));
                 Serial.println(F("B - Reboot the RN52 module"));
+                Serial.println(F("S - Show CAN driver statistics"));
+                Serial.println(F("T - Show current track metadata and BT intent statistics"));
                 Serial.println(F("H - Show this list of commands"));
 #endif
                 Serial.println(F(""));
@@ -158,6 +289,26 @@ void RN52handler::monitor_serial_input() {
     }
 }
 
+/**
+ * Intent queue counters for the 'T' command, in the style of CAN.printStatistics()
+ */
+
+void RN52handler::printStatistics() {
+    Serial.print(F("BT intent queue depth/high water/drops: "));
+    Serial.print(intents.available());
+    Serial.print(F("/"));
+    Serial.print(intentHighWater);
+    Serial.print(F("/"));
+    Serial.println(intentDropCount);
+    if (intentDropCount) {
+        Serial.print(F("Last dropped BT intent: "));
+        Serial.println(lastDroppedIntent);
+    }
+}
+
 void RN52handler::initialize() {
+    intentHighWater = 0;
+    intentDropCount = 0;
+    lastDroppedIntent = 0;
     driver.initialize();
 }
@@ -27,9 +27,38 @@
 
 #include <Arduino.h>
 #include "RN52impl.h"
+#include "RingBuffer.h"
+
+#define BT_INTENT_QUEUE_SIZE    8       // Power of two; more button presses than this before the loop gets to them are dropped
+
+/**
+ * What the bt_ commands ask of the RN52, one byte each in the intent queue
+ */
+
+enum BtIntent {
+    BT_PLAY,
+    BT_PREV,
+    BT_NEXT,
+    BT_VASSISTANT,
+    BT_VOLUP,
+    BT_VOLDOWN,
+    BT_VISIBLE,
+    BT_INVISIBLE,
+    BT_RECONNECT,
+    BT_DISCONNECT,
+    BT_SET_MAXVOL,
+    BT_REBOOT
+};
 
 class RN52handler {
     RN52impl driver;
+    RingBuffer<uint8_t, BT_INTENT_QUEUE_SIZE> intents;
+    uint8_t intentHighWater;                // Most intents waiting at once
+    uint16_t intentDropCount;               // Posted to a full queue and lost
+    uint8_t lastDroppedIntent;              // BtIntent of the latest of those
+    
+    void post(BtIntent intent);
+    void runIntent(uint8_t intent);
     
 public:
     void update();
@@ -46,7 +75,12 @@ public:
     void bt_disconnect();
     void bt_set_maxvol();
     void bt_reboot();
+    const RN52::TrackData *bt_track_data();
+    unsigned char bt_track_data_count();
+    unsigned char bt_track_lost_count();
+    bool bt_streaming();
     void monitor_serial_input();
+    void printStatistics();
     void initialize();
 };
 
@@ -79,7 +79,7 @@ void RN52impl::onError(int location, Error error){
 };
 
 void RN52impl::onGPIO2() {
-    queueCommand(RN52_CMD_QUERY);
+    refreshState();
 }
 
 void RN52impl::onProfileChange(BtProfile profile, bool connected) {
@@ -194,7 +194,7 @@ void RN52impl::initialize() {
         set_max_volume();
         set_pair_timeout();
         reboot();
-        queueCommand("G%\r"); // Was D.
+        queueCommand(RN52_CMD_GET_CONFIG); // Was D.
         processCmdQueue();
         Serial.println(F("Configured RN52"));
     }
@@ -0,0 +1,68 @@
+/*
+ * Command and reply strings for RovingNetworks RN-52 Bluetooth modules, in flash
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "RN52strings.h"
+
+// Action commands
+const char RN52_CMD_BEGIN[] PROGMEM             = "CMD\r\n";
+const char RN52_CMD_EXIT[] PROGMEM              = "END\r\n";
+const char RN52_CMD_QUERY[] PROGMEM             = "Q\r";
+const char RN52_CMD_DETAILS[] PROGMEM           = "D\r";
+const char RN52_CMD_RECONNECTLAST[] PROGMEM     = "B,06\r";
+const char RN52_CMD_DISCONNECT[] PROGMEM        = "K,06\r";
+const char RN52_CMD_REBOOT[] PROGMEM            = "R,1\r";
+const char RN52_CMD_VOLUP[] PROGMEM             = "AV+\r";
+const char RN52_CMD_VOLDOWN[] PROGMEM           = "AV-\r";
+const char RN52_CMD_DISCOVERY_ON[] PROGMEM      = "@,1\r";
+const char RN52_CMD_DISCOVERY_OFF[] PROGMEM     = "@,0\r";
+const char RN52_CMD_GET_CONFIG[] PROGMEM        = "G%\r";
+
+// RN52 settings commands
+const char RN52_SET_PAIR_TIMEOUT[] PROGMEM      = "S^,0\r";
+const char RN52_SET_DISCOVERY_MASK[] PROGMEM    = "SD,06\r";
+const char RN52_SET_CONNECTION_MASK[] PROGMEM   = "SK,06\r";
+const char RN52_SET_COD[] PROGMEM               = "SC,200420\r";
+const char RN52_SET_DEVICE_NAME[] PROGMEM       = "SN,BlueSaab\r";
+const char RN52_SET_BAUDRATE_9600[] PROGMEM     = "SU,01\r";
+const char RN52_SET_MAXVOL[] PROGMEM            = "SS,0F\r";
+const char RN52_SET_EXTENDED_FEATURES[] PROGMEM = "S%,1084\r";
+
+
+// AVRCP commands
+const char RN52_CMD_AVCRP_NEXT[] PROGMEM        = "AT+\r";
+const char RN52_CMD_AVCRP_PREV[] PROGMEM        = "AT-\r";
+const char RN52_CMD_AVCRP_VASSISTANT[] PROGMEM  = "P\r";
+const char RN52_CMD_AVCRP_PLAYPAUSE[] PROGMEM   = "AP\r";
+const char RN52_CMD_GET_TRACK_DATA[] PROGMEM    = "AD\r";
+
+// RN52 reply messages
+const char RN52_RX_OK[] PROGMEM                 = "AOK\r\n";
+const char RN52_RX_ERROR[] PROGMEM              = "ERR\r\n";
+const char RN52_RX_WHAT[] PROGMEM               = "?\r\n";
+const char RN52_RX_REBOOT[] PROGMEM             = "Reboot!";
+
+// AD (track metadata) response keys
+const char RN52_TRACK_TITLE[] PROGMEM           = "Title";
+const char RN52_TRACK_ARTIST[] PROGMEM          = "Artist";
+const char RN52_TRACK_ALBUM[] PROGMEM           = "Album";
+const char RN52_TRACK_NUMBER[] PROGMEM          = "TrackNumber";
+const char RN52_TRACK_TIME[] PROGMEM            = "Time(ms)";
@@ -25,42 +25,55 @@
 #ifndef RN52STRINGS_H_
 #define RN52STRINGS_H_
 
+#include <avr/pgmspace.h>
+
+// All of these live in flash: RN52driver queues them by address and compares/sends them with the _P functions.
+// They are defined once, in RN52strings.cpp, so every file sees the same address.
+
 // Action commands
-#define RN52_CMD_BEGIN              "CMD\r\n"
-#define RN52_CMD_EXIT               "END\r\n"
-#define RN52_CMD_QUERY              "Q\r"
-#define RN52_CMD_DETAILS            "D\r"
-#define RN52_CMD_RECONNECTLAST      "B,06\r"
-#define RN52_CMD_DISCONNECT         "K,06\r"
-#define RN52_CMD_REBOOT             "R,1\r"
-#define RN52_CMD_VOLUP              "AV+\r"
-#define RN52_CMD_VOLDOWN            "AV-\r"
-#define RN52_CMD_DISCOVERY_ON       "@,1\r"
-#define RN52_CMD_DISCOVERY_OFF      "@,0\r"
+extern const char RN52_CMD_BEGIN[] PROGMEM;
+extern const char RN52_CMD_EXIT[] PROGMEM;
+extern const char RN52_CMD_QUERY[] PROGMEM;
+extern const char RN52_CMD_DETAILS[] PROGMEM;
+extern const char RN52_CMD_RECONNECTLAST[] PROGMEM;
+extern const char RN52_CMD_DISCONNECT[] PROGMEM;
+extern const char RN52_CMD_REBOOT[] PROGMEM;
+extern const char RN52_CMD_VOLUP[] PROGMEM;
+extern const char RN52_CMD_VOLDOWN[] PROGMEM;
+extern const char RN52_CMD_DISCOVERY_ON[] PROGMEM;
+extern const char RN52_CMD_DISCOVERY_OFF[] PROGMEM;
+extern const char RN52_CMD_GET_CONFIG[] PROGMEM;        // Reads back the extended features (S%)
 
 // RN52 settings commands
-#define RN52_SET_PAIR_TIMEOUT       "S^,0\r"            // Shutdown module if pairing doesn't happen. 0 means don't enable this feature
-#define RN52_SET_DISCOVERY_MASK     "SD,06\r"           // A2DP/AVRCP + SPP profiles
-#define RN52_SET_CONNECTION_MASK    "SK,06\r"           // A2DP/AVRCP + SPP profiles
-#define RN52_SET_COD                "SC,200420\r"       // Sets "CoD" (Class of Device)
-#define RN52_SET_DEVICE_NAME        "SN,BlueSaab\r"     // Broadcasted and shown in audio source's settigns
-#define RN52_SET_BAUDRATE_9600      "SU,01\r"           // Enables serial communications on RN52 @ 9600bps
-#define RN52_SET_MAXVOL             "SS,0F\r"           // Sets the volume gain to MAX level 15 (default 11)
-#define RN52_SET_EXTENDED_FEATURES  "S%,0084\r"         // Discoverable on startup; Disable system tones
+extern const char RN52_SET_PAIR_TIMEOUT[] PROGMEM;      // Shutdown module if pairing doesn't happen. 0 means don't enable this feature
+extern const char RN52_SET_DISCOVERY_MASK[] PROGMEM;    // A2DP/AVRCP + SPP profiles
+extern const char RN52_SET_CONNECTION_MASK[] PROGMEM;   // A2DP/AVRCP + SPP profiles
+extern const char RN52_SET_COD[] PROGMEM;               // Sets "CoD" (Class of Device)
+extern const char RN52_SET_DEVICE_NAME[] PROGMEM;       // Broadcasted and shown in audio source's settigns
+extern const char RN52_SET_BAUDRATE_9600[] PROGMEM;     // Enables serial communications on RN52 @ 9600bps
+extern const char RN52_SET_MAXVOL[] PROGMEM;            // Sets the volume gain to MAX level 15 (default 11)
+extern const char RN52_SET_EXTENDED_FEATURES[] PROGMEM; // Discoverable on startup; Disable system tones; Track change event
 
 
 // AVRCP commands
-#define RN52_CMD_AVCRP_NEXT         "AT+\r"
-#define RN52_CMD_AVCRP_PREV         "AT-\r"
-#define RN52_CMD_AVCRP_VASSISTANT   "P\r"
-#define RN52_CMD_AVCRP_PLAYPAUSE    "AP\r"
-#define RN52_CMD_GET_TRACK_DATA     "AD\r"
+extern const char RN52_CMD_AVCRP_NEXT[] PROGMEM;
+extern const char RN52_CMD_AVCRP_PREV[] PROGMEM;
+extern const char RN52_CMD_AVCRP_VASSISTANT[] PROGMEM;
+extern const char RN52_CMD_AVCRP_PLAYPAUSE[] PROGMEM;
+extern const char RN52_CMD_GET_TRACK_DATA[] PROGMEM;
 
 // RN52 reply messages
-#define RN52_RX_OK                  "AOK\r\n"
-#define RN52_RX_ERROR               "ERR\r\n"
-#define RN52_RX_WHAT                "?\r\n"
-#define RN52_RX_REBOOT              "Reboot!"
+extern const char RN52_RX_OK[] PROGMEM;
+extern const char RN52_RX_ERROR[] PROGMEM;
+extern const char RN52_RX_WHAT[] PROGMEM;
+extern const char RN52_RX_REBOOT[] PROGMEM;
+
+// AD (track metadata) response keys
+extern const char RN52_TRACK_TITLE[] PROGMEM;
+extern const char RN52_TRACK_ARTIST[] PROGMEM;
+extern const char RN52_TRACK_ALBUM[] PROGMEM;
+extern const char RN52_TRACK_NUMBER[] PROGMEM;
+extern const char RN52_TRACK_TIME[] PROGMEM;            // Last line of the response
 
 
 #endif /* RN52STRINGS_H_ */
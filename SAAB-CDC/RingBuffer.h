@@ -0,0 +1,141 @@
+/*
+ * C++ template for single producer / single consumer ring buffers on AVR
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/**
+ * Queue between one producer (typically an interrupt handler) and one
+ * consumer (typically the main loop), no locking needed.
+ *
+ * head and tail are free running 8 bit counters, only ever written by the
+ * producer and the consumer respectively. Single byte loads and stores are
+ * atomic on AVR, so each side can read the other's index at any time.
+ * With a power of two size the slot index is a mask and the fill level a
+ * plain subtraction, where a % by any other size costs a call to the
+ * division routine on every push and pop.
+ *
+ * A full buffer keeps its contents and counts the rejected item instead.
+ */
+template <typename T, uint8_t SIZE>
+class RingBuffer
+{
+    static_assert(SIZE >= 2 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0,
+                  "RingBuffer SIZE must be a power of two from 2 to 128");
+
+public:
+    RingBuffer() : head(0), tail(0), overflows(0) {}
+
+    // Producer side
+    bool push(const T &item) {
+        uint8_t h = head;
+        if ((uint8_t)(h - tail) == SIZE) {
+            overflows++;
+            return false;
+        }
+        buffer[h & MASK] = item;
+        barrier();              // item complete before the consumer can see it
+        head = h + 1;
+        return true;
+    }
+
+    // Producer side, in place: fill the slot reserve() returns, then commit() it
+    T *reserve() {
+        uint8_t h = head;
+        if ((uint8_t)(h - tail) == SIZE) {
+            overflows++;
+            return 0;
+        }
+        return &buffer[h & MASK];
+    }
+
+    void commit() {
+        barrier();
+        head = head + 1;
+    }
+
+    // Consumer side
+    bool pop(T &item) {
+        uint8_t t = tail;
+        if (t == head) {
+            return false;
+        }
+        barrier();              // don't read the slot ahead of head
+        item = buffer[t & MASK];
+        barrier();              // slot copied out before the producer may reuse it
+        tail = t + 1;
+        return true;
+    }
+
+    // Consumer side, in place: front() is the oldest item, valid until pop()
+    const T &front() const {
+        barrier();
+        return buffer[tail & MASK];
+    }
+
+    void pop() {
+        barrier();
+        tail = tail + 1;
+    }
+
+    bool peek(T &item) const {
+        uint8_t t = tail;
+        if (t == head) {
+            return false;
+        }
+        barrier();
+        item = buffer[t & MASK];
+        return true;
+    }
+
+    uint8_t available() const { return (uint8_t)(head - tail); }
+    bool empty() const { return head == tail; }
+    bool full() const { return available() == SIZE; }
+    static uint8_t capacity() { return SIZE; }
+
+    // Only while the producer is stopped
+    void clear() { head = tail = 0; }
+
+    uint16_t getOverflowCount() const {
+        uint8_t oldSREG = SREG;
+        cli();
+        uint16_t count = overflows;
+        SREG = oldSREG;
+        return count;
+    }
+
+private:
+    enum { MASK = SIZE - 1 };
+
+    static inline void barrier() { __asm__ __volatile__("" ::: "memory"); }
+
+    T buffer[SIZE];
+    volatile uint8_t head;          // Next slot to write, producer only
+    volatile uint8_t tail;          // Next slot to read, consumer only
+    volatile uint16_t overflows;    // Producer only
+};
+
+#endif
@@ -56,7 +56,9 @@ void loop() {
 #endif
     time.update();
     CDC.handleCdcStatus();
-    BT.update();
+    if (!CDC.canWorkPending()) {
+        BT.update();                // Takes the bt_ intents the CAN handlers posted
+    }
     BT.monitor_serial_input();
     wdt_reset();
 }
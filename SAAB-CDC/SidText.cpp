@@ -0,0 +1,111 @@
+/*
+ * C++ Class for encoding text for the second row of the SID on SAAB I-Bus
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "SidText.h"
+
+/* Format of NODE_WRITE_TEXT_ON_DISPLAY frames:
+ [0]: Frame number; 0x40 marks the first one, low bits count down to 0
+ [1]: 0x96, SID
+ [2]: Row; 2 = 2nd row
+ [3-7]: Characters
+ The third frame carries the last two characters and three zeroes.
+ */
+static const unsigned char sidFrameHeader[SID_TEXT_FRAMES][3] = {
+    {0x42,0x96,0x02},
+    {0x01,0x96,0x02},
+    {0x00,0x96,0x02}
+};
+
+SidText::SidText() : length(0), offset(0), pause(0), encodes(0), changed(false), shown(0) {
+    text[0] = 0;
+    for (int group = 0; group < 2; group++) {
+        for (int i = 0; i < SID_TEXT_FRAMES; i++) {
+            memcpy(frames[group][i], sidFrameHeader[i], 3);
+        }
+    }
+    encodeWindow(frames[shown]);
+}
+
+/**
+ * Sets the text to show, the next nextFrames() encodes it; returns false if it is the one already shown
+ */
+
+bool SidText::setText(const char *newText) {
+    if (!newText || strncmp(newText, text, SID_TEXT_MAX_LENGTH) == 0) {
+        return false;
+    }
+    strncpy(text, newText, SID_TEXT_MAX_LENGTH);
+    text[SID_TEXT_MAX_LENGTH] = 0;
+    length = strlen(text);
+    offset = 0;
+    pause = SID_TEXT_SCROLL_PAUSE;
+    changed = true;
+    return true;
+}
+
+/**
+ * The frames to send now; a text longer than the row moves on by one character first.
+ * They stay as they are until the next but one call
+ */
+
+SidFrame *SidText::nextFrames() {
+    if (length > SID_TEXT_ROW_LENGTH) {
+        if (pause) {
+            pause--;
+        }
+        else {
+            if (offset < length - SID_TEXT_ROW_LENGTH) {
+                offset++;
+            }
+            else {
+                offset = 0;
+            }
+            if (offset == 0 || offset == length - SID_TEXT_ROW_LENGTH) {
+                pause = SID_TEXT_SCROLL_PAUSE;
+            }
+            changed = true;
+        }
+    }
+    if (changed) {
+        shown ^= 1;
+        encodeWindow(frames[shown]);
+        changed = false;
+    }
+    return frames[shown];
+}
+
+/**
+ * Copies the row's twelve characters from the current offset into a group; zeroes past the end of the text
+ */
+
+void SidText::encodeWindow(SidFrame *to) {
+    char row[15];
+    uint8_t n = length - offset;
+    n = n > SID_TEXT_ROW_LENGTH ? SID_TEXT_ROW_LENGTH : n;
+    memcpy(row, text + offset, n);
+    memset(row + n, 0, sizeof(row) - n);
+
+    memcpy(&to[0][3], row, 5);
+    memcpy(&to[1][3], row + 5, 5);
+    memcpy(&to[2][3], row + 10, 5);
+    encodes++;
+}
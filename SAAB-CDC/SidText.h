@@ -0,0 +1,70 @@
+/*
+ * C++ Class for encoding text for the second row of the SID on SAAB I-Bus
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef SIDTEXT_H
+#define SIDTEXT_H
+
+#include <Arduino.h>
+#include "MessageSender.h"
+
+#define SID_TEXT_ROW_LENGTH     12      // Characters the SID shows on a row
+#define SID_TEXT_MAX_LENGTH     32      // Longer text is cut off
+#define SID_TEXT_FRAMES         3       // Frames per text, 5 + 5 + 2 characters
+#define SID_TEXT_SCROLL_PAUSE   2       // Sends a scrolling text rests at either end
+
+typedef unsigned char SidFrame[CAN_FRAME_LENGTH];
+
+/**
+ * Keeps the SID text as the frame group that goes on the bus. A new text
+ * is encoded once, by the next nextFrames(); as long as it fits on the row
+ * every nextFrames() hands out the same group untouched, the SID only needs
+ * it again to keep the text up. Longer text scrolls by one character per
+ * nextFrames(): only the twelve character bytes are copied in from the new
+ * offset, the frame headers never change.
+ *
+ * There are two groups. MessageSender reads the frames as each one goes
+ * out, so a changed text or scroll step is written to the group not handed
+ * out last and the group on its way out is never touched. setText() in the
+ * middle of a group only takes effect with the next one.
+ */
+class SidText {
+public:
+    SidText();
+    bool setText(const char *text);
+    SidFrame *nextFrames();
+    const char *getText() const { return text; }
+    uint16_t getEncodeCount() const { return encodes; }
+
+private:
+    void encodeWindow(SidFrame *to);
+
+    char text[SID_TEXT_MAX_LENGTH + 1];
+    uint8_t length;
+    uint8_t offset;                     // First character on the row
+    uint8_t pause;                      // Sends left before the scrolling moves on
+    uint16_t encodes;                   // Times the character bytes were (re)written
+    bool changed;                       // Text or offset moved since frames[shown] was encoded
+    uint8_t shown;                      // Group nextFrames() handed out last
+    SidFrame frames[2][SID_TEXT_FRAMES];
+};
+
+#endif
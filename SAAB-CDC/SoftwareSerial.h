@@ -34,12 +34,13 @@ http://arduiniana.org.
 
 #include <inttypes.h>
 #include <Stream.h>
+#include "RingBuffer.h"
 
 /******************************************************************************
 * Definitions
 ******************************************************************************/
 
-#define _SS_MAX_RX_BUFF 64 // RX buffer size
+#define _SS_MAX_RX_BUFF 64 // RX buffer size, a power of two
 #ifndef GCC_VERSION
 #define GCC_VERSION (__GNUC__ * 10000 + __GNUC_MINOR__ * 100 + __GNUC_PATCHLEVEL__)
 #endif
@@ -66,9 +67,7 @@ private:
   uint16_t _inverse_logic:1;
 
   // static data
-  static char _receive_buffer[_SS_MAX_RX_BUFF]; 
-  static volatile uint8_t _receive_buffer_tail;
-  static volatile uint8_t _receive_buffer_head;
+  static RingBuffer<char, _SS_MAX_RX_BUFF> _receive_buffer;
   static SoftwareSerial *active_object;
 
   // private methods
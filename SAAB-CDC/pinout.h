@@ -18,6 +18,7 @@
 #define	MCP2515_CS		B,0
 //Mega pin 49
 #define	MCP2515_INT		L,0
+#define	MCP2515_INT_NUM		CAN_INT_NONE
 //Mega pin 19
 //#define	MCP2515_INT		D,2
 //---------------------------------------------------
@@ -30,6 +31,9 @@
 
 #define	MCP2515_CS		B,0
 #define	MCP2515_INT		D,2
+//Mega pin 19 is INT2
+#define	MCP2515_INT_VECT	INT2_vect
+#define	MCP2515_INT_NUM		2
 //---------------------------------------------------
 #else
 //---------------------------------------------------
@@ -39,6 +43,13 @@
 
 #define	MCP2515_CS		B,2
 #define	MCP2515_INT		D,2
+//Arduino pin 2 is INT0
+#define	MCP2515_INT_VECT	INT0_vect
+#define	MCP2515_INT_NUM		0
+//Optional second MCP2515, e.g. on the P-Bus. Pin 3 (INT1) is the RN52's
+//event pin, so its INT is polled from PBUS.available()
+//#define	MCP2515_PBUS_CS		D,7
+//#define	MCP2515_PBUS_INT	B,0
 //---------------------------------------------------
 #endif
 #endif
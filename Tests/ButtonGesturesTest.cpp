@@ -0,0 +1,334 @@
+/*
+ * Host tests replaying timestamped button frames through ButtonGestures
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include <vector>
+#include "TestCase.h"
+#include "ButtonGestures.h"
+
+#define WHEEL       0x290
+#define IHU         0x3C0
+
+#define RELEASE         400     // ms, release timeout of the IHU buttons
+#define WHEEL_RELEASE   1000
+
+struct Event
+{
+    uint32_t ms;
+    uint8_t button;
+    Gesture gesture;
+};
+
+static std::vector<Event> events;
+static uint32_t now;                // us, what run() and onFrame() were last given
+
+static void record(uint8_t button, Gesture gesture)
+{
+    Event event = {now / 1000, button, gesture};
+    events.push_back(event);
+}
+
+static void wheelNxt(Gesture gesture) { record(0, gesture); }
+static void ihuButton1(Gesture gesture) { record(1, gesture); }
+static void ihuSeekUp(Gesture gesture) { record(2, gesture); }
+
+constexpr ButtonGesture buttons[] = {
+    //Frame     Byte    Code    Sub byte    Sub code    Long    Repeat  Double  Release         Action
+    {WHEEL,     4,      0x04,   0,          0,          800,    0,      400,    WHEEL_RELEASE,  &wheelNxt},
+    {IHU,       1,      0x68,   2,          0x01,       800,    300,    0,      RELEASE,        &ihuButton1},
+    {IHU,       1,      0x45,   0,          0,          800,    0,      0,      RELEASE,        &ihuSeekUp}
+};
+
+struct Frame
+{
+    uint32_t ms;
+    uint16_t id;
+    uint8_t data[8];
+};
+
+/**
+ * Hands each frame to onFrame() at its timestamp and calls run() every
+ * 10 ms in between, as the main loop does, until the given time
+ */
+static void replay(ButtonGestures<3> &gestures, const Frame *frames, uint8_t count, uint32_t untilMs)
+{
+    uint8_t k = 0;
+    events.clear();
+    for (now = 0; now <= untilMs * 1000UL; now += 10000) {
+        while (k < count && frames[k].ms * 1000UL <= now) {
+            uint32_t run = now;
+            now = frames[k].ms * 1000UL;
+            gestures.onFrame(frames[k].id, frames[k].data, now);
+            now = run;
+            k++;
+        }
+        gestures.run(now);
+    }
+}
+
+static bool expect(const Event *expected, uint8_t count)
+{
+    bool same = events.size() == count;
+    for (uint8_t i = 0; same && i < count; i++) {
+        same = events[i].ms == expected[i].ms && events[i].button == expected[i].button && events[i].gesture == expected[i].gesture;
+    }
+    if (!same) {
+        for (size_t i = 0; i < events.size(); i++) {
+            fprintf(stderr, "  %u ms: button %u gesture %u\n", events[i].ms, events[i].button, events[i].gesture);
+        }
+    }
+    return same;
+}
+
+// Let go before longPress: SHORT, once the double press window has passed
+static void shortPress(void)
+{
+    ButtonGestures<3> gestures(buttons);
+    const Frame frames[] = {
+        {0,     WHEEL,  {0x80, 0, 0, 0, 0x04}},
+        {100,   WHEEL,  {0x00, 0, 0, 0, 0x04}},
+        {200,   WHEEL,  {0x80, 0, 0, 0, 0x00}},
+        {1000,  IHU,    {0x80, 0x45}},
+        {1200,  IHU,    {0x80, 0x00}},
+    };
+    replay(gestures, frames, 5, 2000);
+    
+    const Event expected[] = {
+        {610,   0,  GESTURE_SHORT},
+        {1200,  2,  GESTURE_SHORT},
+    };
+    CHECK(expect(expected, 2));
+}
+
+// Pressed again within doublePress of letting go: one DOUBLE, no SHORT
+static void doublePress(void)
+{
+    ButtonGestures<3> gestures(buttons);
+    const Frame frames[] = {
+        {0,     WHEEL,  {0x80, 0, 0, 0, 0x04}},
+        {100,   WHEEL,  {0x80, 0, 0, 0, 0x00}},
+        {300,   WHEEL,  {0x80, 0, 0, 0, 0x04}},
+        {400,   WHEEL,  {0x80, 0, 0, 0, 0x00}},
+        // too late for a double press
+        {1500,  WHEEL,  {0x80, 0, 0, 0, 0x04}},
+        {1600,  WHEEL,  {0x80, 0, 0, 0, 0x00}},
+        {2100,  WHEEL,  {0x80, 0, 0, 0, 0x04}},
+        {2200,  WHEEL,  {0x80, 0, 0, 0, 0x00}},
+    };
+    replay(gestures, frames, 8, 3000);
+    
+    const Event expected[] = {
+        {300,   0,  GESTURE_DOUBLE},
+        {2010,  0,  GESTURE_SHORT},
+        {2610,  0,  GESTURE_SHORT},
+    };
+    CHECK(expect(expected, 3));
+}
+
+// No frame telling us the button was let go: it counts as let go
+// its release time after the last frame that had it down
+static void releaseTimeout(void)
+{
+    ButtonGestures<3> gestures(buttons);
+    const Frame frames[] = {
+        {0,     IHU,    {0x80, 0x45}},
+        {200,   IHU,    {0x00, 0x45}},
+        // seek+ is let go after 200 ms, but the frame saying so is lost
+    };
+    replay(gestures, frames, 2, 600);
+    CHECK(gestures.isHeld(2));
+    CHECK_EQUAL(0, events.size());
+    
+    ButtonGestures<3> again(buttons);
+    replay(again, frames, 2, 1000);
+    CHECK(!again.isHeld(2));
+    const Event expected[] = {
+        {200 + RELEASE + 10, 2, GESTURE_SHORT},
+    };
+    CHECK(expect(expected, 1));
+}
+
+// Frames further apart than the timeout make a new press each
+static void slowFramesArePresses(void)
+{
+    ButtonGestures<3> gestures(buttons);
+    const Frame frames[] = {
+        {0,     IHU,    {0x00, 0x45}},
+        {500,   IHU,    {0x00, 0x45}},
+        {1000,  IHU,    {0x00, 0x45}},
+        {1300,  IHU,    {0x80, 0x00}},
+    };
+    replay(gestures, frames, 4, 1500);
+    
+    const Event expected[] = {
+        {410,   2,  GESTURE_SHORT},
+        {910,   2,  GESTURE_SHORT},
+        {1300,  2,  GESTURE_SHORT},
+    };
+    CHECK(expect(expected, 3));
+}
+
+// Held with frames every 140 ms: LONG at longPress, REPEAT every repeat
+// after that by the clock, not by the frames; nothing when let go
+static void longPressAndRepeat(void)
+{
+    ButtonGestures<3> gestures(buttons);
+    Frame frames[14];
+    for (uint8_t i = 0; i < 13; i++) {
+        Frame held = {i * 140U, IHU, {(uint8_t)(i ? 0x00 : 0x80), 0x68, 0x01}};
+        frames[i] = held;
+    }
+    Frame release = {1850, IHU, {0x80, 0x00}};
+    frames[13] = release;
+    replay(gestures, frames, 14, 2500);
+    
+    const Event expected[] = {
+        {800,   1,  GESTURE_LONG},
+        {1100,  1,  GESTURE_REPEAT},
+        {1400,  1,  GESTURE_REPEAT},
+        {1700,  1,  GESTURE_REPEAT},
+    };
+    CHECK(expect(expected, 4));
+}
+
+// Long press without repeat, the frames stop before the release timeout
+// would have let it go
+static void longPressEndsByTimeout(void)
+{
+    ButtonGestures<3> gestures(buttons);
+    const Frame frames[] = {
+        {0,     IHU,    {0x80, 0x45}},
+        {300,   IHU,    {0x00, 0x45}},
+        {600,   IHU,    {0x00, 0x45}},
+        {900,   IHU,    {0x00, 0x45}},
+    };
+    replay(gestures, frames, 4, 2000);
+    
+    const Event expected[] = {
+        {800,   2,  GESTURE_LONG},
+    };
+    CHECK(expect(expected, 1));
+    CHECK(!gestures.isHeld(2));
+}
+
+// A wheel press in the middle of a held IHU button touches neither
+static void buttonsKeepTheirOwnSlots(void)
+{
+    ButtonGestures<3> gestures(buttons);
+    const Frame frames[] = {
+        {0,     IHU,    {0x80, 0x68, 0x01}},
+        {100,   WHEEL,  {0x80, 0, 0, 0, 0x04}},
+        {150,   IHU,    {0x00, 0x68, 0x01}},
+        {200,   WHEEL,  {0x80, 0, 0, 0, 0x00}},
+        {300,   IHU,    {0x00, 0x68, 0x01}},
+        {450,   IHU,    {0x00, 0x68, 0x01}},
+        {600,   IHU,    {0x00, 0x68, 0x01}},
+        {750,   IHU,    {0x00, 0x68, 0x01}},
+        {850,   IHU,    {0x80, 0x00, 0x00}},
+    };
+    replay(gestures, frames, 9, 1500);
+    
+    const Event expected[] = {
+        {610,   0,  GESTURE_SHORT},
+        {800,   1,  GESTURE_LONG},
+    };
+    CHECK(expect(expected, 2));
+}
+
+// Frames just under the release time apart are one press, just over it
+// they are a press each; the wheel entry's longer release time keeps it held
+static void releaseTimeoutPerEntry(void)
+{
+    const uint32_t under = RELEASE - 10;
+    const uint32_t over = RELEASE + 20;
+    ButtonGestures<3> gestures(buttons);
+    const Frame held[] = {
+        {0,         IHU,    {0x80, 0x45}},
+        {under,     IHU,    {0x00, 0x45}},
+        {2 * under, IHU,    {0x00, 0x45}},
+        {3 * under, IHU,    {0x80, 0x00}},
+    };
+    replay(gestures, held, 4, 1500);
+    const Event longPress[] = {
+        {800,   2,  GESTURE_LONG},
+    };
+    CHECK(expect(longPress, 1));
+    
+    ButtonGestures<3> apart(buttons);
+    const Frame slow[] = {
+        {0,         IHU,    {0x80, 0x45}},
+        {over,      IHU,    {0x00, 0x45}},
+        {2 * over,  IHU,    {0x00, 0x45}},
+        {3 * over,  IHU,    {0x80, 0x00}},
+    };
+    replay(apart, slow, 4, 1500);
+    const Event presses[] = {
+        {RELEASE + 10,              2,  GESTURE_SHORT},
+        {over + RELEASE + 10,       2,  GESTURE_SHORT},
+        {2 * over + RELEASE + 10,   2,  GESTURE_SHORT},
+    };
+    CHECK(expect(presses, 3));
+    
+    ButtonGestures<3> wheel(buttons);
+    const Frame wheelSlow[] = {
+        {0,         WHEEL,  {0x80, 0, 0, 0, 0x04}},
+        {over,      WHEEL,  {0x00, 0, 0, 0, 0x04}},
+        {2 * over,  WHEEL,  {0x00, 0, 0, 0, 0x04}},
+        {3 * over,  WHEEL,  {0x80, 0, 0, 0, 0x00}},
+    };
+    replay(wheel, wheelSlow, 4, 1500);
+    const Event wheelLong[] = {
+        {800,   0,  GESTURE_LONG},
+    };
+    CHECK(expect(wheelLong, 1));
+}
+
+// An event frame with the same button starts a new press of it
+static void eventFrameStartsNewPress(void)
+{
+    ButtonGestures<3> gestures(buttons);
+    const Frame frames[] = {
+        {0,     IHU,    {0x80, 0x45}},
+        {150,   IHU,    {0x80, 0x45}},
+        {300,   IHU,    {0x80, 0x00}},
+    };
+    replay(gestures, frames, 3, 1000);
+    
+    const Event expected[] = {
+        {150,   2,  GESTURE_SHORT},
+        {300,   2,  GESTURE_SHORT},
+    };
+    CHECK(expect(expected, 2));
+}
+
+int main(void)
+{
+    RUN(shortPress);
+    RUN(doublePress);
+    RUN(releaseTimeout);
+    RUN(slowFramesArePresses);
+    RUN(longPressAndRepeat);
+    RUN(longPressEndsByTimeout);
+    RUN(buttonsKeepTheirOwnSlots);
+    RUN(releaseTimeoutPerEntry);
+    RUN(eventFrameStartsNewPress);
+    return testResult("ButtonGesturesTest");
+}
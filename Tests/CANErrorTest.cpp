@@ -0,0 +1,163 @@
+/*
+ * Host tests of the error monitor of CANClass
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "TestCase.h"
+#include "CANFixture.h"
+
+// The "tx aborts" figure of printStatistics()
+static long txAborts(void)
+{
+    const char *label = "CAN rx overflows/tx aborts/error passive/bus-off: ";
+    
+    Serial.output.clear();
+    CAN.printStatistics();
+    size_t at = Serial.output.find(label);
+    if (at == std::string::npos) {
+        return -1;
+    }
+    const char *slash = strchr(Serial.output.c_str() + at + strlen(label), '/');
+    return slash ? atol(slash + 1) : -1;
+}
+
+static uint8_t txreq(CANFixture &f)
+{
+    return ((f.chip.reg(TXB0CTRL) >> TXREQ) & 1) | (((f.chip.reg(TXB1CTRL) >> TXREQ) & 1) << 1) |
+           (((f.chip.reg(TXB2CTRL) >> TXREQ) & 1) << 2);
+}
+
+// With nobody to acknowledge, stale requests are aborted without the main
+// loop waiting for the frame on the wire; ABAT goes once that is done and
+// what was sent meanwhile waits in the queue until then
+static void staleRequestsAbortedWithoutWaiting(void)
+{
+    CANFixture f;
+    long aborts = txAborts();
+    CANClass::msgCAN message = CANFixture::frame(0x3C0, 8, 0);
+    
+    f.chip.setAcknowledge(false);
+    CAN.send(&message);
+    message.setHeader(0x3C1, 0, 8);
+    CAN.send(&message);
+    CHECK_EQUAL(0x03, txreq(f));
+    
+    f.stall((CAN_TX_STALE_MS + CAN_ERROR_CHECK_MS) * 1000UL);
+    uint64_t start = Host::nanos();
+    CAN.checkErrors();
+    // a handful of SPI transactions, no waiting for the bus
+    CHECK(Host::nanos() - start < 100000);
+    CHECK(f.chip.reg(CANCTRL) & (1 << ABAT));
+    CHECK_EQUAL(aborts + 2, txAborts());
+    
+    message.setHeader(0x3C2, 0, 8);
+    CHECK_EQUAL(0x00, CAN.send(&message));
+    CHECK_EQUAL(1, CAN.getTxQueueDepth());
+    CAN.update();
+    CHECK_EQUAL(1, CAN.getTxQueueDepth());
+    
+    // the frame on the wire fails once more, then ABAT is done with it
+    f.stall(2 * f.chip.frameNanos(8, false) / 1000);
+    CHECK_EQUAL(0x00, txreq(f));
+    start = Host::nanos();
+    CAN.checkErrors();
+    CHECK(Host::nanos() - start < 100000);
+    CHECK(!(f.chip.reg(CANCTRL) & (1 << ABAT)));
+    CHECK(f.chip.reg(TXB0CTRL) & (1 << ABTF));
+    CHECK(f.chip.reg(TXB1CTRL) & (1 << ABTF));
+    
+    f.chip.setAcknowledge(true);
+    CAN.update();
+    CHECK_EQUAL(0, CAN.getTxQueueDepth());
+    f.settle();
+    CHECK_EQUAL(1, f.chip.sent().size());
+    if (f.chip.sent().size() == 1) {
+        CHECK_EQUAL(0x3C2, f.chip.sent()[0].id);
+    }
+    CHECK_EQUAL(aborts + 2, txAborts());
+    CHECK_EQUAL(0, f.chip.protocolErrors);
+}
+
+// While ABAT is set the responder leaves requests to the main loop
+static const uint8_t reply[8] PROGMEM = {0x32, 0x00, 0x00, 0x03, 0x01, 0x02, 0x00, 0x00};
+
+static const uint8_t *responder(const CANClass::msgCAN &)
+{
+    return reply;
+}
+
+static void noFastReplyWhileAborting(void)
+{
+    CANFixture f;
+    CAN.setResponder(0x6A1, 0x6A2, &responder, reply);
+    CANClass::msgCAN message = CANFixture::frame(0x3C0, 8, 0);
+    
+    f.chip.setAcknowledge(false);
+    CAN.send(&message);
+    f.stall((CAN_TX_STALE_MS + CAN_ERROR_CHECK_MS) * 1000UL);
+    CAN.checkErrors();
+    CHECK(f.chip.reg(CANCTRL) & (1 << ABAT));
+    
+    f.chip.setAcknowledge(true);
+    uint8_t data[8] = {0x02};
+    f.chip.receive(0x6A1, data, 8);
+    f.settle();
+    
+    CHECK_EQUAL(1, CAN.available());
+    CHECK(!CAN.fastReplySent(CAN.front()));
+    CAN.pop();
+    // only the frame that was on the wire when ABAT was set
+    CHECK_EQUAL(1, f.chip.sent().size());
+    if (f.chip.sent().size() == 1) {
+        CHECK_EQUAL(0x3C0, f.chip.sent()[0].id);
+    }
+    CHECK_EQUAL(0, f.chip.protocolErrors);
+    
+    CAN.checkErrors();
+    CHECK(!(f.chip.reg(CANCTRL) & (1 << ABAT)));
+}
+
+// Nothing stale, nothing aborted
+static void pendingRequestsLeftAlone(void)
+{
+    CANFixture f;
+    long aborts = txAborts();
+    CANClass::msgCAN message = CANFixture::frame(0x3C0, 8, 0);
+    
+    f.chip.setAcknowledge(false);
+    CAN.send(&message);
+    f.stall(CAN_ERROR_CHECK_MS * 1000UL);
+    CAN.checkErrors();
+    CHECK(!(f.chip.reg(CANCTRL) & (1 << ABAT)));
+    CHECK_EQUAL(0x01, txreq(f));
+    CHECK_EQUAL(aborts, txAborts());
+    
+    f.chip.setAcknowledge(true);
+    f.settle();
+    CHECK_EQUAL(1, f.chip.sent().size());
+}
+
+int main(void)
+{
+    RUN(staleRequestsAbortedWithoutWaiting);
+    RUN(noFastReplyWhileAborting);
+    RUN(pendingRequestsLeftAlone);
+    return testResult("CANErrorTest");
+}
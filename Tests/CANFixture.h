@@ -0,0 +1,67 @@
+/*
+ * The I-Bus CANClass wired to an emulated MCP2515, for the host tests
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef CANFIXTURE_H
+#define CANFIXTURE_H
+
+#include "CAN.h"
+#include "MCP2515Emulator.h"
+
+/**
+ * CAN with an MCP2515Emulator on the pins of pinout.h: CS on B,2, INT on
+ * D,2 (INT0). The chip is begin()'d at 47.619 kbit/s and ready, frames
+ * received from the bus land in CAN's circular buffer from the interrupt
+ * handler as on the target.
+ */
+struct CANFixture
+{
+    MCP2515Emulator chip;
+    
+    CANFixture() : chip((Host::reset(), &PORTB), 2, &PORTD, 2) {
+        CAN.begin(47);
+        chip.counters = MCP2515Emulator::Counters();
+    }
+    
+    // Lets time pass in the main loop's absence, interrupts still come in
+    void stall(uint32_t us) {
+        Host::advanceMicros(us);
+    }
+    
+    // Until the bus has been idle for a frame time, so every frame is through
+    void settle(void) {
+        do {
+            Host::advanceMicros(100);
+        } while (!chip.busIdle());
+        Host::advanceMicros(chip.frameNanos(8, false) / 1000);
+    }
+    
+    static CANClass::msgCAN frame(uint16_t id, uint8_t length, uint8_t fill, bool rtr = false) {
+        CANClass::msgCAN message;
+        message.setHeader(id, rtr, length);
+        for (uint8_t i = 0; i < 8; i++) {
+            message.data[i] = fill + i;
+        }
+        return message;
+    }
+};
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Host tests of the id, RTR and DLC packing of CANClass::msgCAN
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "TestCase.h"
+#include "CANFixture.h"
+
+static_assert(sizeof(CANClass::msgCAN) == 10, "msgCAN is SIDH, SIDL and 8 data bytes");
+
+static const uint8_t payload[8] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+
+static bool sameData(const uint8_t *a, const uint8_t *b, uint8_t length)
+{
+    return memcmp(a, b, (length > 8) ? 8 : length) == 0;
+}
+
+// Every id, both RTR values and every DLC come back out of the two bytes
+static void headerRoundTrips(void)
+{
+    CANClass::msgCAN message;
+    bool ok = true;
+    
+    for (uint16_t id = 0; id <= 0x7FF; id++) {
+        for (uint8_t rtr = 0; rtr < 2; rtr++) {
+            for (uint8_t length = 0; length <= 8; length++) {
+                message.setHeader(id, rtr, length);
+                ok &= (message.id() == id && message.rtr() == rtr && message.length() == length);
+            }
+        }
+    }
+    CHECK(ok);
+    
+    // laid out as the MCP2515's SIDH/SIDL
+    message.setHeader(0x6A1, 1, 3);
+    CHECK_EQUAL(0xD4, message.sidh);
+    CHECK_EQUAL(0x33, message.sidl);
+}
+
+// Data frames of every length and a remote frame, each as the bus sent it
+static void receivedFramesKeepIdRtrAndDlc(void)
+{
+    CANFixture f;
+    
+    for (uint8_t length = 0; length <= 8; length++) {
+        f.chip.receive(0x290 + length, payload, length);
+        f.settle();
+        CHECK_EQUAL(1, CAN.available());
+        const CANClass::rxMsgCAN &message = CAN.front();
+        CHECK_EQUAL(0x290 + length, message.id());
+        CHECK_EQUAL(0, message.rtr());
+        CHECK_EQUAL(length, message.length());
+        CHECK(sameData(message.data, payload, length));
+        CAN.pop();
+    }
+    
+    f.chip.receive(0x6A1, NULL, 4, true);
+    f.settle();
+    CANClass::msgCAN remote;
+    CAN.read(&remote);
+    CHECK_EQUAL(0x6A1, remote.id());
+    CHECK_EQUAL(1, remote.rtr());
+    CHECK_EQUAL(4, remote.length());
+    CHECK_EQUAL(0, CAN.available());
+}
+
+// A DLC above 8 means 8 data bytes
+static void dlcAboveEightReadsEightBytes(void)
+{
+    CANFixture f;
+    
+    f.chip.receive(0x3C0, payload, 12);
+    f.settle();
+    
+    CHECK_EQUAL(1, CAN.available());
+    CHECK_EQUAL(8, CAN.front().length());
+    CHECK(sameData(CAN.front().data, payload, 8));
+    CAN.pop();
+}
+
+// The RTR bit goes into TXBnDLC, a remote frame carries no data
+static void remoteFramesGoOutAsRemote(void)
+{
+    CANFixture f;
+    CANClass::msgCAN request = CANFixture::frame(0x6A1, 0, 0, true);
+    CANClass::msgCAN sized = CANFixture::frame(0x6A2, 5, 0, true);
+    
+    CAN.send(&request);
+    CAN.send(&sized);
+    f.settle();
+    
+    CHECK_EQUAL(2, f.chip.sent().size());
+    for (size_t i = 0; i < f.chip.sent().size(); i++) {
+        const MCP2515Emulator::Frame &frame = f.chip.sent()[i];
+        CHECK(frame.rtr);
+        CHECK_EQUAL(frame.id == 0x6A1 ? 0 : 5, frame.length);
+    }
+}
+
+// What is sent comes back the same in loopback mode
+static void loopbackRoundTrip(void)
+{
+    CANFixture f;
+    
+    CAN.SetMode(LOOPBACK_MODE);
+    for (uint8_t n = 0; n < 10; n++) {
+        CANClass::msgCAN sent = CANFixture::frame(0x400 + n, (n < 9) ? n : 2, 0x20 + n, n == 9);
+        CAN.send(&sent);
+        f.settle();
+        
+        CHECK_EQUAL(1, CAN.available());
+        const CANClass::rxMsgCAN &message = CAN.front();
+        CHECK_EQUAL(sent.id(), message.id());
+        CHECK_EQUAL(sent.rtr(), message.rtr());
+        CHECK_EQUAL(sent.length(), message.length());
+        CHECK(message.rtr() || sameData(message.data, sent.data, message.length()));
+        CAN.pop();
+    }
+    CHECK_EQUAL(10, f.chip.sent().size());
+    CAN.SetMode(NORMAL_MODE);
+}
+
+int main(void)
+{
+    RUN(headerRoundTrips);
+    RUN(receivedFramesKeepIdRtrAndDlc);
+    RUN(dlcAboveEightReadsEightBytes);
+    RUN(remoteFramesGoOutAsRemote);
+    RUN(loopbackRoundTrip);
+    return testResult("CANFrameTest");
+}
@@ -0,0 +1,227 @@
+/*
+ * Host tests of the fast responder and of two MCP2515 on one SPI bus
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "TestCase.h"
+#include "CANFixture.h"
+
+// Where pinout.h has the optional P-Bus MCP2515, polled as INT1 is the RN52's
+#define TEST_PBUS_CS    D,7
+#define TEST_PBUS_INT   B,0
+
+static const uint8_t replyPreload[8] PROGMEM = {0x32, 0x00, 0x00, 0x16, 0x01, 0x02, 0x00, 0x00};
+static const uint8_t replyActive[8] PROGMEM = {0x32, 0x00, 0x00, 0x03, 0x01, 0x02, 0x00, 0x00};
+static uint8_t responderCalls;
+
+// Answers requests with data[0] 0x02, keeps quiet on the others
+static const uint8_t *responder(const CANClass::msgCAN &request)
+{
+    responderCalls++;
+    return (request.data[0] == 0x02) ? replyActive : 0;
+}
+
+static void request(CANFixture &f, uint8_t kind)
+{
+    uint8_t data[8] = {kind, 0, 0, 0, 0, 0, 0, 0};
+    f.chip.receive(0x6A1, data, 8);
+}
+
+static uint16_t txb2Id(CANFixture &f)
+{
+    return ((uint16_t)f.chip.reg(TXB2SIDH) << 3) | (f.chip.reg(TXB2SIDL) >> 5);
+}
+
+// The reply goes out of TXB2 from the interrupt handler, right behind the
+// request and however long the main loop is busy elsewhere
+static void replySentFromInterruptHandler(void)
+{
+    CANFixture f;
+    CAN.setResponder(0x6A1, 0x6A2, &responder, replyPreload);
+    CHECK_EQUAL(0x6A2, txb2Id(f));
+    CHECK_EQUAL(TX_PRIORITY_HIGHEST, f.chip.reg(TXB2CTRL) & 0x03);
+    responderCalls = 0;
+    
+    uint64_t start = Host::nanos();
+    request(f, 0x02);
+    f.stall(5000);
+    
+    CHECK_EQUAL(1, responderCalls);
+    CHECK_EQUAL(1, f.chip.sent().size());
+    if (f.chip.sent().size() == 1) {
+        const MCP2515Emulator::Frame &reply = f.chip.sent()[0];
+        CHECK_EQUAL(0x6A2, reply.id);
+        CHECK_EQUAL(8, reply.length);
+        CHECK_EQUAL(0x03, reply.data[3]);
+        // request, SPI work of well under a bit time and the reply
+        CHECK(reply.end - start < 2 * f.chip.frameNanos(8, false) + 200000);
+    }
+    CHECK_EQUAL(1, CAN.available());
+    CHECK(CAN.fastReplySent(CAN.front()));
+    CAN.pop();
+}
+
+// No reply data, no reply; the main loop sees the request was not answered
+static void noReplyWhenResponderDeclines(void)
+{
+    CANFixture f;
+    CAN.setResponder(0x6A1, 0x6A2, &responder, replyPreload);
+    
+    request(f, 0x03);
+    f.settle();
+    
+    CHECK_EQUAL(0, f.chip.sent().size());
+    CHECK_EQUAL(1, CAN.available());
+    CHECK(!CAN.fastReplySent(CAN.front()));
+    CAN.pop();
+}
+
+// send() keeps off TXB2, a third frame waits in the queue instead
+static void sendLeavesTxb2ToTheResponder(void)
+{
+    CANFixture f;
+    CAN.setResponder(0x6A1, 0x6A2, &responder, replyPreload);
+    
+    CANClass::msgCAN message = CANFixture::frame(0x3C0, 8, 0);
+    CHECK_EQUAL(0x01, CAN.send(&message));
+    message.setHeader(0x3C1, 0, 8);
+    CHECK_EQUAL(0x02, CAN.send(&message));
+    message.setHeader(0x3C2, 0, 8);
+    CHECK_EQUAL(0x00, CAN.send(&message));
+    CHECK_EQUAL(1, CAN.getTxQueueDepth());
+    CHECK_EQUAL(0x6A2, txb2Id(f));
+    
+    // a request in between is still answered from TXB2
+    request(f, 0x02);
+    for (uint8_t i = 0; i < 100; i++) {
+        CAN.update();
+        Host::advanceMicros(100);
+    }
+    f.settle();
+    
+    CHECK_EQUAL(4, f.chip.sent().size());
+    CHECK_EQUAL(0, CAN.getTxQueueDepth());
+    CHECK_EQUAL(0x6A2, txb2Id(f));
+    CHECK_EQUAL(1, CAN.available());
+    CHECK(CAN.fastReplySent(CAN.front()));
+    CAN.pop();
+}
+
+// While TXB2 still waits for the bus with one reply the next request is left
+// to the main loop's slow path
+static void busyTxb2FallsBackToSlowPath(void)
+{
+    CANFixture f;
+    CAN.setResponder(0x6A1, 0x6A2, &responder, replyPreload);
+    
+    // nobody acknowledges the reply, so it keeps trying
+    f.chip.setAcknowledge(false);
+    request(f, 0x02);
+    f.stall(5000);
+    request(f, 0x02);
+    f.stall(5000);
+    
+    CHECK_EQUAL(2, CAN.available());
+    CHECK(CAN.fastReplySent(CAN.front()));
+    CAN.pop();
+    CHECK(!CAN.fastReplySent(CAN.front()));
+    CAN.pop();
+    CHECK(f.chip.reg(TXB2CTRL) & (1 << TXREQ));
+    
+    f.chip.setAcknowledge(true);
+    f.settle();
+    CHECK_EQUAL(1, f.chip.sent().size());
+    CHECK_EQUAL(0, Host::collisions());
+}
+
+// The I-Bus controller on INT0 and a polled P-Bus one share the SPI bus under
+// full load on both: nothing lost, no interrupt handler while the other one
+// has CS low
+static void twoControllersUnderFullLoad(void)
+{
+    CANFixture f;
+    MCP2515Emulator pchip(&PORTD, 7, &PORTB, 0, 500000);
+    CANClass pbus(CAN_PINS(TEST_PBUS_CS, TEST_PBUS_INT, CAN_INT_NONE));
+    pbus.begin(500);
+    
+    const uint16_t frames = 400;
+    uint64_t until = Host::nanos() + frames * f.chip.frameNanos(8, false);
+    uint64_t iBusAt = Host::nanos(), pBusAt = Host::nanos();
+    uint16_t iBusSent = 0, pBusSent = 0, iBusNext = 0, pBusNext = 0;
+    uint16_t loss = 0;
+    CANClass::msgCAN message;
+    
+    while (Host::nanos() < until || !f.chip.busIdle() || !pchip.busIdle() || CAN.available() || pbus.available()) {
+        // the other nodes take half of each bus, our own frames the rest
+        if (Host::nanos() < until && Host::nanos() >= iBusAt) {
+            uint8_t data[8] = {(uint8_t)iBusSent, (uint8_t)(iBusSent >> 8)};
+            f.chip.receive(0x290, data, 8);
+            iBusSent++;
+            iBusAt += 2 * f.chip.frameNanos(8, false);
+        }
+        if (Host::nanos() < until && Host::nanos() >= pBusAt) {
+            uint8_t data[8] = {(uint8_t)pBusSent, (uint8_t)(pBusSent >> 8)};
+            pchip.receive(0x1A0, data, 8);
+            pBusSent++;
+            pBusAt += 2 * pchip.frameNanos(8, false);
+        }
+        
+        // the main loop: both buffers drained, something sent on each bus
+        while (CAN.available()) {
+            CAN.read(&message);
+            loss += (message.data[0] | (message.data[1] << 8)) != iBusNext++;
+        }
+        while (pbus.available()) {
+            pbus.read(&message);
+            loss += (message.data[0] | (message.data[1] << 8)) != pBusNext++;
+        }
+        if (Host::nanos() < until && !CAN.getTxQueueDepth()) {
+            message = CANFixture::frame(0x3C0, 8, (uint8_t)iBusNext);
+            CAN.send(&message);
+        }
+        if (Host::nanos() < until && !pbus.getTxQueueDepth()) {
+            message = CANFixture::frame(0x4A0, 8, (uint8_t)pBusNext);
+            pbus.send(&message);
+        }
+        CAN.update();
+        pbus.update();
+        Host::advanceMicros(100);
+    }
+    
+    CHECK(iBusSent >= frames / 2);
+    CHECK(pBusSent >= frames * 5);
+    CHECK_EQUAL(iBusSent, iBusNext);
+    CHECK_EQUAL(pBusSent, pBusNext);
+    CHECK_EQUAL(0, loss);
+    CHECK(f.chip.sent().size() >= frames / 3);
+    CHECK(pchip.sent().size() >= frames * 3);
+    CHECK_EQUAL(0, f.chip.protocolErrors + pchip.protocolErrors);
+    CHECK_EQUAL(0, Host::collisions());
+}
+
+int main(void)
+{
+    RUN(replySentFromInterruptHandler);
+    RUN(noReplyWhenResponderDeclines);
+    RUN(sendLeavesTxb2ToTheResponder);
+    RUN(busyTxb2FallsBackToSlowPath);
+    RUN(twoControllersUnderFullLoad);
+    return testResult("CANResponderTest");
+}
@@ -0,0 +1,286 @@
+/*
+ * Host tests of the interrupt driven receive path of CANClass
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "TestCase.h"
+#include "CANFixture.h"
+
+// Full I-Bus load: 8 byte frames back to back, 111 bits each at 47.619 kbit/s
+static const uint32_t FRAME_US = 111 * 21;
+
+static void sendBackToBack(CANFixture &f, uint16_t first, uint16_t count)
+{
+    for (uint16_t n = first; n < first + count; n++) {
+        uint8_t data[8] = {(uint8_t)n, (uint8_t)(n >> 8), 2, 3, 4, 5, 6, 7};
+        f.chip.receive(0x100 + (n & 0x3FF), data, 8);
+    }
+}
+
+// The frame number sendBackToBack() put in data[0..1]
+static uint16_t sequence(const CANClass::rxMsgCAN &frame)
+{
+    return frame.data[0] | (frame.data[1] << 8);
+}
+
+// The ring's overflow count as printStatistics() has it, it goes on across begin()
+static long rxOverflows(void)
+{
+    const char *label = "CAN rx buffer overflows: ";
+    
+    Serial.output.clear();
+    CAN.printStatistics();
+    size_t at = Serial.output.find(label);
+    return (at == std::string::npos) ? -1 : atol(Serial.output.c_str() + at + strlen(label));
+}
+
+// reserve() hands out the slot without publishing it, only commit() does
+static void reserveCommitPublishesInOrder(void)
+{
+    RingBuffer<uint8_t, 4> ring;
+    
+    uint8_t *slot = ring.reserve();
+    CHECK(slot != 0);
+    *slot = 1;
+    CHECK_EQUAL(0, ring.available());
+    ring.commit();
+    CHECK_EQUAL(1, ring.available());
+    
+    for (uint8_t i = 2; i <= 4; i++) {
+        *ring.reserve() = i;
+        ring.commit();
+    }
+    CHECK(ring.full());
+    CHECK(ring.reserve() == 0);
+    CHECK_EQUAL(1, ring.getOverflowCount());
+    
+    // a full ring keeps what it has
+    for (uint8_t i = 1; i <= 4; i++) {
+        CHECK_EQUAL(i, ring.front());
+        ring.pop();
+    }
+    CHECK(ring.empty());
+}
+
+// Free running indices: every slot is usable, the count wraps with them
+static void ringWrapsAndKeepsWhenFull(void)
+{
+    RingBuffer<uint8_t, 4> ring;
+    uint8_t item = 0;
+    
+    for (uint16_t n = 0; n < 300; n++) {
+        CHECK(ring.push((uint8_t)n));
+        CHECK_EQUAL(1, ring.available());
+        CHECK(ring.pop(item));
+        CHECK_EQUAL((uint8_t)n, item);
+    }
+    for (uint8_t i = 1; i <= 4; i++) {
+        CHECK(ring.push(i));
+    }
+    CHECK(ring.full());
+    CHECK(!ring.push(5));
+    CHECK_EQUAL(1, ring.getOverflowCount());
+    
+    // a full ring keeps what it has
+    for (uint8_t i = 1; i <= 4; i++) {
+        CHECK(ring.pop(item));
+        CHECK_EQUAL(i, item);
+    }
+    CHECK(ring.empty());
+    CHECK(!ring.pop(item));
+}
+
+// Frames go from both RX buffers into the ring from INT0, oldest first
+static void interruptDrainsBothBuffersInOrder(void)
+{
+    CANFixture f;
+    
+    sendBackToBack(f, 0, 6);
+    f.settle();
+    
+    CHECK_EQUAL(6, CAN.available());
+    CHECK(!CAN.CheckNew());
+    uint32_t last = 0;
+    for (uint16_t i = 0; i < 6; i++) {
+        const CANClass::rxMsgCAN &frame = CAN.front();
+        CHECK_EQUAL(0x100 + i, frame.id());
+        CHECK_EQUAL(i, sequence(frame));
+        CHECK_EQUAL(8, frame.length());
+        CHECK(frame.timestamp > last);
+        last = frame.timestamp;
+        CAN.pop();
+    }
+    CHECK_EQUAL(0, f.chip.reg(EFLG));
+    CHECK_EQUAL(0, Host::collisions());
+}
+
+// front() stays put while the interrupt handler fills the slots behind it
+static void frontStaysValidWhileInterruptsCommit(void)
+{
+    CANFixture f;
+    
+    sendBackToBack(f, 0, 1);
+    f.settle();
+    const CANClass::rxMsgCAN &held = CAN.front();
+    CHECK_EQUAL(0x100, held.id());
+    
+    sendBackToBack(f, 1, 7);
+    f.settle();
+    CHECK_EQUAL(8, CAN.available());
+    CHECK_EQUAL(0x100, held.id());
+    CHECK_EQUAL(0, sequence(held));
+    
+    for (uint16_t i = 0; i < 8; i++) {
+        CHECK_EQUAL(i, sequence(CAN.front()));
+        CAN.pop();
+    }
+}
+
+// A second of full load, the main loop stalled for 15 ms at a time: the ring
+// and the two RX buffers cover it, nothing is lost, nothing reordered
+static void noLossAtFullLoadWithStalledLoop(void)
+{
+    CANFixture f;
+    const uint16_t count = 1000000UL / FRAME_US;
+    uint16_t next = 0;
+    
+    sendBackToBack(f, 0, count);
+    while (next < count) {
+        f.stall(15000);
+        while (CAN.available()) {
+            const CANClass::rxMsgCAN &frame = CAN.front();
+            CHECK_EQUAL(next, sequence(frame));
+            CHECK_EQUAL(0x100 + (next & 0x3FF), frame.id());
+            next = sequence(frame) + 1;
+            CAN.pop();
+        }
+        CHECK(Host::nanos() < 2000000000ULL);
+        if (Host::nanos() > 2000000000ULL) {
+            break;
+        }
+    }
+    CHECK_EQUAL(count, next);
+    CHECK_EQUAL(0, f.chip.reg(EFLG) & ((1 << RX1OVR) | (1 << RX0OVR)));
+    CHECK_EQUAL(0, Host::collisions());
+}
+
+// SoftwareSerial sends a byte (1.04 ms at 9600 baud) with interrupts off; a
+// whole RN52 command of them in a row costs nothing either
+static void noLossWhileSoftwareSerialHoldsInterrupts(void)
+{
+    CANFixture f;
+    const uint16_t count = 200;
+    uint16_t next = 0;
+    
+    sendBackToBack(f, 0, count);
+    while (next < count) {
+        for (uint8_t i = 0; i < 12; i++) {
+            uint8_t oldSREG = SREG;
+            cli();
+            Host::advance(1042000);
+            SREG = oldSREG;
+            Host::advance(10000);
+        }
+        while (CAN.available()) {
+            CHECK_EQUAL(next, sequence(CAN.front()));
+            next = sequence(CAN.front()) + 1;
+            CAN.pop();
+        }
+        if (Host::nanos() > 2000000000ULL) {
+            break;
+        }
+    }
+    CHECK_EQUAL(count, next);
+    CHECK_EQUAL(0, f.chip.reg(EFLG));
+}
+
+// Stalled past what the ring holds: the newest frames are dropped and
+// counted, the ones already queued stay intact and in order
+static void overrunKeepsOldestAndCounts(void)
+{
+    CANFixture f;
+    long overflows = rxOverflows();
+    
+    sendBackToBack(f, 0, 14);
+    f.settle();
+    
+    // 8 in the ring; the handler releases INT by dropping the rest
+    CHECK_EQUAL(RX_CAN_BUFFER_SIZE, CAN.available());
+    CHECK(!CAN.CheckNew());
+    for (uint16_t i = 0; i < RX_CAN_BUFFER_SIZE; i++) {
+        CHECK_EQUAL(i, sequence(CAN.front()));
+        CAN.pop();
+    }
+    
+    CHECK_EQUAL(overflows + 6, rxOverflows());
+    
+    // and the path is free again
+    sendBackToBack(f, 20, 1);
+    f.settle();
+    CHECK_EQUAL(1, CAN.available());
+    CHECK_EQUAL(20, sequence(CAN.front()));
+}
+
+// The masks and filters of ComputeFilters() keep other IDs out of the ring, RXM 00 on both buffers
+static void filtersPassOnlySubscribedIds(void)
+{
+    CANFixture f;
+    const uint16_t ids[] = {0x6A1, 0x3C0, 0x290, 0x368};
+    uint16_t filters[6], masks[2];
+    uint8_t data[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    
+    CHECK_EQUAL(0, CANClass::ComputeFilters(ids, 4, filters, masks));
+    CAN.SetFilters(filters, masks);
+    CHECK_EQUAL(0, f.chip.mode());
+    CHECK_EQUAL(1 << BUKT, f.chip.reg(RXB0CTRL) & ((1 << RXM1) | (1 << RXM0) | (1 << BUKT)));
+    CHECK_EQUAL(0, f.chip.reg(RXB1CTRL) & ((1 << RXM1) | (1 << RXM0)));
+    CHECK_EQUAL(0, f.chip.protocolErrors);
+    
+    const uint16_t foreign[] = {0x000, 0x290 ^ 1, 0x368 ^ 0x100, 0x3C8, 0x6A2, 0x7FF};
+    for (uint8_t i = 0; i < sizeof(foreign) / sizeof(foreign[0]); i++) {
+        f.chip.receive(foreign[i], data, 8);
+    }
+    f.settle();
+    CHECK_EQUAL(0, CAN.available());
+    
+    for (uint8_t i = 0; i < 4; i++) {
+        f.chip.receive(ids[i], data, 8);
+    }
+    f.settle();
+    CHECK_EQUAL(4, CAN.available());
+    for (uint8_t i = 0; i < 4; i++) {
+        CHECK_EQUAL(ids[i], CAN.front().id());
+        CAN.pop();
+    }
+    CHECK_EQUAL(0, f.chip.reg(EFLG));
+}
+
+int main(void)
+{
+    RUN(reserveCommitPublishesInOrder);
+    RUN(ringWrapsAndKeepsWhenFull);
+    RUN(interruptDrainsBothBuffersInOrder);
+    RUN(frontStaysValidWhileInterruptsCommit);
+    RUN(noLossAtFullLoadWithStalledLoop);
+    RUN(noLossWhileSoftwareSerialHoldsInterrupts);
+    RUN(overrunKeepsOldestAndCounts);
+    RUN(filtersPassOnlySubscribedIds);
+    return testResult("CANRxTest");
+}
@@ -0,0 +1,219 @@
+/*
+ * Host tests of the in place transmit path and tx queue of CANClass
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "TestCase.h"
+#include "CANFixture.h"
+
+// The main loop: update() between slices of time until the bus is quiet
+static void runLoop(CANFixture &f)
+{
+    for (uint16_t i = 0; i < 2000 && !(f.chip.busIdle() && CAN.getTxQueueDepth() == 0); i++) {
+        CAN.update();
+        Host::advanceMicros(100);
+    }
+    f.settle();
+}
+
+static uint8_t sendInPlace(uint16_t id, uint8_t fill, uint8_t priority = TX_PRIORITY_LOW)
+{
+    CANClass::msgCAN *slot = CAN.txSlot();
+    slot->setHeader(id, 0, 8);
+    for (uint8_t i = 0; i < 8; i++) {
+        slot->data[i] = fill + i;
+    }
+    return CAN.sendTxSlot(priority);
+}
+
+// The slot is sent as filled in, straight from the queue entry
+static void txSlotIsSentAsFilled(void)
+{
+    CANFixture f;
+    
+    CHECK_EQUAL(0x01, sendInPlace(0x3C8, 0x40));
+    runLoop(f);
+    
+    CHECK_EQUAL(1, f.chip.sent().size());
+    const MCP2515Emulator::Frame &frame = f.chip.sent()[0];
+    CHECK_EQUAL(0x3C8, frame.id);
+    CHECK_EQUAL(8, frame.length);
+    CHECK(!frame.rtr);
+    for (uint8_t i = 0; i < 8; i++) {
+        CHECK_EQUAL(0x40 + i, frame.data[i]);
+    }
+}
+
+// One buffer each while they last, the priority goes to TXP
+static void freeBuffersTakeFramesWithTheirPriority(void)
+{
+    CANFixture f;
+    
+    CHECK_EQUAL(0x01, sendInPlace(0x100, 0, TX_PRIORITY_LOW));
+    CHECK_EQUAL(0x02, sendInPlace(0x101, 0, TX_PRIORITY_HIGHEST));
+    CHECK_EQUAL(0x04, sendInPlace(0x102, 0, TX_PRIORITY_MEDIUM));
+    CHECK_EQUAL(0x00, sendInPlace(0x103, 0, TX_PRIORITY_LOW));
+    
+    CHECK_EQUAL(TX_PRIORITY_LOW, f.chip.reg(TXB0CTRL) & 0x03);
+    CHECK_EQUAL(TX_PRIORITY_HIGHEST, f.chip.reg(TXB1CTRL) & 0x03);
+    CHECK_EQUAL(TX_PRIORITY_MEDIUM, f.chip.reg(TXB2CTRL) & 0x03);
+    CHECK_EQUAL(1, CAN.getTxQueueDepth());
+    
+    runLoop(f);
+    CHECK_EQUAL(4, f.chip.sent().size());
+    CHECK_EQUAL(0, CAN.getTxQueueDepth());
+}
+
+// Queued frames leave highest priority first, in order of sending within one
+static void queueDrainsByPriorityThenOrder(void)
+{
+    CANFixture f;
+    
+    // TXB0 is on the wire, TXB1/TXB2 wait behind it
+    for (uint8_t n = 0; n < 3; n++) {
+        sendInPlace(0x200 + n, 0);
+    }
+    sendInPlace(0x300, 0, TX_PRIORITY_LOW);
+    sendInPlace(0x301, 0, TX_PRIORITY_HIGH);
+    sendInPlace(0x302, 0, TX_PRIORITY_MEDIUM);
+    sendInPlace(0x303, 0, TX_PRIORITY_LOW);
+    sendInPlace(0x304, 0, TX_PRIORITY_HIGH);
+    CHECK_EQUAL(5, CAN.getTxQueueDepth());
+    CHECK_EQUAL(5, CAN.getTxQueueHighWater());
+    
+    runLoop(f);
+    
+    std::vector<uint16_t> queued;
+    for (size_t i = 0; i < f.chip.sent().size(); i++) {
+        if (f.chip.sent()[i].id >= 0x300) {
+            queued.push_back(f.chip.sent()[i].id);
+        }
+    }
+    CHECK_EQUAL(8, f.chip.sent().size());
+    CHECK_EQUAL(5, queued.size());
+    if (queued.size() == 5) {
+        CHECK_EQUAL(0x301, queued[0]);
+        CHECK_EQUAL(0x304, queued[1]);
+        CHECK_EQUAL(0x302, queued[2]);
+        CHECK_EQUAL(0x300, queued[3]);
+        CHECK_EQUAL(0x303, queued[4]);
+    }
+}
+
+// A full queue drops the newest of its least important frames for a more
+// important one, and the new frame itself when nothing is less important
+static void fullQueueDropsNewestLeastImportant(void)
+{
+    CANFixture f;
+    uint16_t drops = CAN.getTxDropCount();
+    
+    for (uint8_t n = 0; n < 3; n++) {
+        sendInPlace(0x200 + n, 0);
+    }
+    for (uint8_t n = 0; n < TX_CAN_QUEUE_SIZE; n++) {
+        sendInPlace(0x300 + n, 0, (n == 2 || n == 5) ? TX_PRIORITY_LOW : TX_PRIORITY_MEDIUM);
+    }
+    CHECK_EQUAL(TX_CAN_QUEUE_SIZE, CAN.getTxQueueDepth());
+    
+    CHECK_EQUAL(0x00, sendInPlace(0x3F0, 0, TX_PRIORITY_HIGH));
+    CHECK_EQUAL(drops + 1, CAN.getTxDropCount());
+    CHECK_EQUAL(0xFF, sendInPlace(0x3F1, 0, TX_PRIORITY_LOW));
+    CHECK_EQUAL(drops + 2, CAN.getTxDropCount());
+    CHECK_EQUAL(TX_CAN_QUEUE_SIZE, CAN.getTxQueueDepth());
+    
+    runLoop(f);
+    bool sent302 = false, sent305 = false, sent3F0 = false, sent3F1 = false;
+    for (size_t i = 0; i < f.chip.sent().size(); i++) {
+        uint16_t id = f.chip.sent()[i].id;
+        sent302 |= (id == 0x302);
+        sent305 |= (id == 0x305);
+        sent3F0 |= (id == 0x3F0);
+        sent3F1 |= (id == 0x3F1);
+    }
+    CHECK(sent302);
+    CHECK(!sent305);
+    CHECK(sent3F0);
+    CHECK(!sent3F1);
+    // TXB2 wins the tie with TXB1 as TXB0 finishes; the high priority frame
+    // is the first from the queue and by its TXP overtakes what is in TXB1
+    CHECK_EQUAL(0x200, f.chip.sent()[0].id);
+    CHECK_EQUAL(0x202, f.chip.sent()[1].id);
+    CHECK_EQUAL(0x3F0, f.chip.sent()[2].id);
+    CHECK_EQUAL(0x201, f.chip.sent().back().id);
+}
+
+// A free buffer that still holds the frame's header is taken over the first
+// free one, so only the changed data bytes cross the SPI bus
+static void slotWithSameHeaderIsReused(void)
+{
+    CANFixture f;
+    
+    sendInPlace(0x290, 0x10);
+    sendInPlace(0x3C0, 0x20);
+    sendInPlace(0x6A2, 0x30);
+    runLoop(f);
+    f.chip.clearSent();
+    
+    uint32_t loads = f.chip.counters.instructions[MCP2515Emulator::INSTRUCTION_WRITE_TX];
+    uint32_t bytes = f.chip.counters.bytes;
+    CANClass::msgCAN *slot = CAN.txSlot();
+    slot->setHeader(0x6A2, 0, 8);
+    for (uint8_t i = 0; i < 8; i++) {
+        slot->data[i] = 0x30 + i;
+    }
+    slot->data[5] = 0x99;
+    CHECK_EQUAL(0x04, CAN.sendTxSlot());
+    
+    // READ STATUS, WRITE of D5, RTS
+    CHECK_EQUAL(loads, f.chip.counters.instructions[MCP2515Emulator::INSTRUCTION_WRITE_TX]);
+    CHECK_EQUAL(2 + 3 + 1, f.chip.counters.bytes - bytes);
+    
+    runLoop(f);
+    CHECK_EQUAL(1, f.chip.sent().size());
+    CHECK_EQUAL(0x6A2, f.chip.sent()[0].id);
+    CHECK_EQUAL(0x99, f.chip.sent()[0].data[5]);
+    CHECK_EQUAL(0x34, f.chip.sent()[0].data[4]);
+}
+
+// txSlot() moves what waits into free buffers before it hands out the slot
+static void txSlotFlushesWaitingFrames(void)
+{
+    CANFixture f;
+    
+    for (uint8_t n = 0; n < 4; n++) {
+        sendInPlace(0x200 + n, 0);
+    }
+    CHECK_EQUAL(1, CAN.getTxQueueDepth());
+    f.settle();
+    CAN.txSlot();
+    CHECK_EQUAL(0, CAN.getTxQueueDepth());
+    CHECK_EQUAL(0, Host::collisions());
+}
+
+int main(void)
+{
+    RUN(txSlotIsSentAsFilled);
+    RUN(freeBuffersTakeFramesWithTheirPriority);
+    RUN(queueDrainsByPriorityThenOrder);
+    RUN(fullQueueDropsNewestLeastImportant);
+    RUN(slotWithSameHeaderIsReused);
+    RUN(txSlotFlushesWaitingFrames);
+    return testResult("CANTxTest");
+}
@@ -0,0 +1,234 @@
+/*
+ * Host tests of the deadlines FrameSchedule sends its frames at
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include <vector>
+#include "TestCase.h"
+#include "HostHardware.h"
+#include "FrameSchedule.h"
+
+enum {
+    STATUS,
+    REQUEST,
+    GROUP
+};
+
+struct Sent
+{
+    uint32_t ms;
+    uint16_t id;
+    bool event;
+};
+
+static std::vector<Sent> sent;
+static uint16_t builds;
+static uint32_t origin;             // millis() at reset(), the host clock goes on across tests
+
+static bool build(uint8_t *data, bool event)
+{
+    builds++;
+    data[0] = event ? 0x80 : 0x00;
+    return true;
+}
+
+// Sends a group of its own, like the SID text
+static bool buildGroup(uint8_t *data, bool event)
+{
+    builds++;
+    Sent frame = {(uint32_t)(millis() - origin), 0x328, event};
+    sent.push_back(frame);
+    return false;
+}
+
+static void send(uint16_t id, uint8_t *data)
+{
+    Sent frame = {(uint32_t)(millis() - origin), id, data[0] == 0x80};
+    sent.push_back(frame);
+}
+
+constexpr ScheduledFrame frames[] = {
+    //ID        Period  Tolerance %     Event gap   Builder
+    {0x3C8,     950,    10,             50,         &build},
+    {0x345,     1000,   10,             0,          &build},
+    {0x328,     0,      0,              100,        &buildGroup}
+};
+
+static void reset(void)
+{
+    Host::reset();
+    origin = millis();
+    sent.clear();
+    builds = 0;
+}
+
+// The main loop: run() once a ms until ms after reset()
+static void loopUntil(FrameSchedule<3> &schedule, uint32_t ms)
+{
+    while (millis() - origin < ms) {
+        schedule.run();
+        Host::advanceMicros(1000);
+    }
+}
+
+static bool expect(const Sent *expected, uint8_t count)
+{
+    bool same = sent.size() == count;
+    for (uint8_t i = 0; same && i < count; i++) {
+        same = sent[i].ms == expected[i].ms && sent[i].id == expected[i].id && sent[i].event == expected[i].event;
+    }
+    if (!same) {
+        for (size_t i = 0; i < sent.size(); i++) {
+            fprintf(stderr, "  %u ms: %03X%s\n", sent[i].ms, sent[i].id, sent[i].event ? " event" : "");
+        }
+    }
+    return same;
+}
+
+// Each started entry goes out right away, then every period; run() only
+// builds a frame at its deadline
+static void periodicDeadlines(void)
+{
+    reset();
+    FrameSchedule<3> schedule(frames, &send);
+    schedule.start(STATUS);
+    schedule.start(REQUEST);
+    loopUntil(schedule, 3001);
+    
+    const Sent expected[] = {
+        {0,     0x3C8,  false},
+        {0,     0x345,  false},
+        {950,   0x3C8,  false},
+        {1000,  0x345,  false},
+        {1900,  0x3C8,  false},
+        {2000,  0x345,  false},
+        {2850,  0x3C8,  false},
+        {3000,  0x345,  false},
+    };
+    CHECK(expect(expected, 8));
+    CHECK_EQUAL(8, builds);
+    CHECK_EQUAL(0, schedule.getLateCount(STATUS));
+}
+
+// trigger() sends an event once minEventGap has passed since the last send,
+// and the period starts over from it
+static void triggerWaitsForEventGap(void)
+{
+    reset();
+    FrameSchedule<3> schedule(frames, &send);
+    schedule.start(STATUS);
+    loopUntil(schedule, 20);
+    schedule.trigger(STATUS);
+    loopUntil(schedule, 500);
+    schedule.trigger(STATUS);
+    loopUntil(schedule, 1500);
+    
+    const Sent expected[] = {
+        {0,     0x3C8,  false},
+        {50,    0x3C8,  true},
+        {500,   0x3C8,  true},
+        {1450,  0x3C8,  false},
+    };
+    CHECK(expect(expected, 4));
+}
+
+// An entry without a period only goes out on trigger(), not on start();
+// its builder may send the frames itself
+static void triggerOnlyEntry(void)
+{
+    reset();
+    FrameSchedule<3> schedule(frames, &send);
+    schedule.start(GROUP);
+    loopUntil(schedule, 300);
+    schedule.trigger(GROUP);
+    schedule.trigger(GROUP);
+    loopUntil(schedule, 350);
+    schedule.trigger(GROUP);
+    loopUntil(schedule, 2500);
+    
+    const Sent expected[] = {
+        {300,   0x328,  true},
+        {400,   0x328,  true},
+    };
+    CHECK(expect(expected, 2));
+    CHECK_EQUAL(2, builds);
+}
+
+// trigger() on an entry that is not started is ignored, also once it is
+// started later; stop() drops a pending event
+static void triggerOnStoppedIgnored(void)
+{
+    reset();
+    FrameSchedule<3> schedule(frames, &send);
+    schedule.trigger(REQUEST);
+    loopUntil(schedule, 2000);
+    CHECK_EQUAL(0, sent.size());
+    CHECK_EQUAL(0, builds);
+    
+    schedule.start(REQUEST);
+    loopUntil(schedule, 2001);
+    schedule.stop(REQUEST);
+    schedule.trigger(REQUEST);
+    loopUntil(schedule, 5000);
+    
+    schedule.start(STATUS);
+    loopUntil(schedule, 5010);
+    schedule.trigger(STATUS);
+    schedule.stop(STATUS);
+    loopUntil(schedule, 7000);
+    
+    const Sent expected[] = {
+        {2000,  0x345,  false},
+        {5000,  0x3C8,  false},
+    };
+    CHECK(expect(expected, 2));
+    CHECK(!schedule.isRunning(REQUEST));
+}
+
+// A loop pass that comes later than the tolerance counts the send as late
+static void lateSendsCounted(void)
+{
+    reset();
+    FrameSchedule<3> schedule(frames, &send);
+    schedule.start(REQUEST);
+    loopUntil(schedule, 1);
+    Host::advanceMicros(1080000UL);
+    loopUntil(schedule, 1200);
+    Host::advanceMicros(1200000UL);
+    loopUntil(schedule, 2500);
+    
+    const Sent expected[] = {
+        {0,     0x345,  false},
+        {1081,  0x345,  false},
+        {2400,  0x345,  false},
+    };
+    CHECK(expect(expected, 3));
+    CHECK_EQUAL(1, schedule.getLateCount(REQUEST));
+}
+
+int main(void)
+{
+    RUN(periodicDeadlines);
+    RUN(triggerWaitsForEventGap);
+    RUN(triggerOnlyEntry);
+    RUN(triggerOnStoppedIgnored);
+    RUN(lateSendsCounted);
+    return testResult("FrameScheduleTest");
+}
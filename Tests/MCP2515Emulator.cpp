@@ -0,0 +1,678 @@
+/*
+ * MCP2515 register level emulator for host tests of the CAN driver
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "MCP2515Emulator.h"
+
+// Registers and bits as in the MCP2515 data sheet (DS20001801), kept apart
+// from CAN.h so the driver is checked against the chip, not against itself
+#define R_BFPCTRL       0x0C
+#define R_TXRTSCTRL     0x0D
+#define R_CANSTAT       0x0E
+#define R_CANCTRL       0x0F
+#define R_TEC           0x1C
+#define R_REC           0x1D
+#define R_CNF3          0x28
+#define R_CNF2          0x29
+#define R_CNF1          0x2A
+#define R_CANINTE       0x2B
+#define R_CANINTF       0x2C
+#define R_EFLG          0x2D
+#define R_TXBCTRL(n)    (0x30 + ((n) << 4))
+#define R_RXBCTRL(n)    (0x60 + ((n) << 4))
+
+#define CANCTRL_ABAT    0x10
+#define TXB_ABTF        0x40
+#define TXB_MLOA        0x20
+#define TXB_TXERR       0x10
+#define TXB_TXREQ       0x08
+#define RXB_RXRTR       0x08
+#define RXB0_BUKT       0x04
+#define RXB0_BUKT1      0x02
+#define INTF_RX0IF      0x01
+#define INTF_RX1IF      0x02
+#define INTF_TX0IF      0x04
+#define INTF_ERRIF      0x20
+#define INTF_MERRF      0x80
+#define EFLG_RX1OVR     0x80
+#define EFLG_RX0OVR     0x40
+#define EFLG_TXBO       0x20
+#define EFLG_TXEP       0x10
+#define EFLG_RXEP       0x08
+#define EFLG_TXWAR      0x04
+#define EFLG_RXWAR      0x02
+#define EFLG_EWARN      0x01
+
+#define MODE_NORMAL     0
+#define MODE_SLEEP      1
+#define MODE_LOOPBACK   2
+#define MODE_LISTEN     3
+#define MODE_CONFIG     4
+
+// Filter n's SIDH, RXF3..5 sit in the second register block
+static uint8_t filterAddress(uint8_t n)
+{
+    return (n < 3) ? (n << 2) : 0x10 + ((n - 3) << 2);
+}
+
+MCP2515Emulator::MCP2515Emulator(volatile uint8_t *csPort, uint8_t csBit, volatile uint8_t *intPort, uint8_t intBit,
+                                 uint32_t bitrate) :
+    Host::SpiDevice(csPort, csBit),
+    protocolErrors(0),
+    intPin(intPort - 2),
+    intBit(intBit),
+    bitNanos(1000000000UL / bitrate),
+    acknowledge(true),
+    instruction(INSTRUCTION_UNKNOWN),
+    position(0),
+    address(0),
+    bitMask(0),
+    rxBuffer(0),
+    onWire(WIRE_IDLE),
+    wireEnd(0),
+    busFree(0),
+    time(Host::nanos())
+{
+    memset(&counters, 0, sizeof(counters));
+    reset();
+}
+
+// ----------------------------------------------------------------------------
+// Bus side
+
+void MCP2515Emulator::receive(uint16_t id, const uint8_t *data, uint8_t length, bool rtr)
+{
+    Frame frame;
+    
+    memset(&frame, 0, sizeof(frame));
+    frame.id = id & 0x7FF;
+    frame.rtr = rtr;
+    frame.length = length;
+    if (!rtr && data) {
+        memcpy(frame.data, data, (length > 8) ? 8 : length);
+    }
+    receive(frame);
+}
+
+void MCP2515Emulator::receive(const Frame &frame)
+{
+    waiting.push_back(frame);
+    if (onWire == WIRE_IDLE) {
+        startNext();
+    }
+}
+
+void MCP2515Emulator::setAcknowledge(bool acknowledge)
+{
+    this->acknowledge = acknowledge;
+}
+
+void MCP2515Emulator::setErrorCounters(uint8_t tec, uint8_t rec)
+{
+    uint8_t eflg = registers[R_EFLG] & (EFLG_RX1OVR | EFLG_RX0OVR);
+    
+    if (tec >= 96 || rec >= 96) eflg |= EFLG_EWARN;
+    if (rec >= 96) eflg |= EFLG_RXWAR;
+    if (tec >= 96) eflg |= EFLG_TXWAR;
+    if (rec >= 128) eflg |= EFLG_RXEP;
+    if (tec >= 128) eflg |= EFLG_TXEP;
+    // TEC past 255 is bus-off, the 8 bit register can't tell, so 255 stands for it
+    if (tec == 255) eflg |= EFLG_TXBO;
+    
+    registers[R_TEC] = tec;
+    registers[R_REC] = rec;
+    registers[R_EFLG] = eflg;
+}
+
+uint32_t MCP2515Emulator::frameNanos(uint8_t length, bool rtr) const
+{
+    // SOF, 11 bit id, RTR, IDE, r0, DLC, data, CRC, delimiters, ACK, EOF, intermission
+    uint8_t bytes = rtr ? 0 : ((length > 8) ? 8 : length);
+    return (47 + 8 * bytes) * bitNanos;
+}
+
+bool MCP2515Emulator::intAsserted(void) const
+{
+    return registers[R_CANINTF] & registers[R_CANINTE];
+}
+
+// ----------------------------------------------------------------------------
+// SPI
+
+void MCP2515Emulator::select(void)
+{
+    position = 0;
+    instruction = INSTRUCTION_UNKNOWN;
+    counters.transactions++;
+}
+
+uint8_t MCP2515Emulator::transfer(uint8_t mosi)
+{
+    uint8_t miso = 0xFF;
+    
+    counters.bytes++;
+    position++;
+    
+    if (position == 1) {
+        if (mosi == 0xC0) {
+            instruction = INSTRUCTION_RESET;
+        }
+        else if (mosi == 0x03) {
+            instruction = INSTRUCTION_READ;
+        }
+        else if (mosi == 0x02) {
+            instruction = INSTRUCTION_WRITE;
+        }
+        else if (mosi == 0x05) {
+            instruction = INSTRUCTION_BIT_MODIFY;
+        }
+        else if (mosi == 0xA0) {
+            instruction = INSTRUCTION_READ_STATUS;
+        }
+        else if (mosi == 0xB0) {
+            instruction = INSTRUCTION_RX_STATUS;
+        }
+        else if ((mosi & 0xF9) == 0x90) {
+            // 1001 0nm0: RXBn, m = start at D0
+            instruction = INSTRUCTION_READ_RX;
+            rxBuffer = (mosi >> 2) & 1;
+            address = R_RXBCTRL((mosi >> 2) & 1) + ((mosi & 0x02) ? 6 : 1);
+        }
+        else if ((mosi & 0xF8) == 0x40 && (mosi & 0x06) != 0x06) {
+            // 0100 0abc: TXB(ab), c = start at D0
+            instruction = INSTRUCTION_WRITE_TX;
+            address = R_TXBCTRL((mosi >> 1) & 3) + ((mosi & 0x01) ? 6 : 1);
+        }
+        else if ((mosi & 0xF8) == 0x80) {
+            instruction = INSTRUCTION_RTS;
+        }
+        else {
+            instruction = INSTRUCTION_UNKNOWN;
+            protocolErrors++;
+        }
+        counters.instructions[instruction]++;
+        counters.instructionBytes[instruction]++;
+        
+        if (instruction == INSTRUCTION_RESET) {
+            reset();
+        }
+        else if (instruction == INSTRUCTION_RTS) {
+            for (uint8_t n = 0; n < 3; n++) {
+                if (mosi & (1 << n)) {
+                    write(R_TXBCTRL(n), TXB_TXREQ, TXB_TXREQ);
+                }
+            }
+        }
+        return miso;
+    }
+    
+    counters.instructionBytes[instruction]++;
+    
+    switch (instruction) {
+        case INSTRUCTION_READ:
+            if (position == 2) {
+                address = mosi & 0x7F;
+            }
+            else {
+                miso = reg(((address & 0x0F) == 0x0F) ? R_CANCTRL : ((address & 0x0F) == 0x0E) ? R_CANSTAT : address);
+                address = (address + 1) & 0x7F;
+            }
+            break;
+            
+        case INSTRUCTION_WRITE:
+            if (position == 2) {
+                address = mosi & 0x7F;
+            }
+            else {
+                write(address, mosi);
+                address = (address + 1) & 0x7F;
+            }
+            break;
+            
+        case INSTRUCTION_READ_RX:
+            miso = registers[address];
+            address = (address + 1) & 0x7F;
+            break;
+            
+        case INSTRUCTION_WRITE_TX:
+            write(address, mosi);
+            address = (address + 1) & 0x7F;
+            break;
+            
+        case INSTRUCTION_READ_STATUS:
+            miso = readStatus();
+            break;
+            
+        case INSTRUCTION_RX_STATUS:
+            miso = rxStatus();
+            break;
+            
+        case INSTRUCTION_BIT_MODIFY:
+            if (position == 2) {
+                address = mosi & 0x7F;
+            }
+            else if (position == 3) {
+                bitMask = mosi;
+            }
+            else if (position == 4) {
+                uint8_t low = address & 0x0F;
+                bool modifiable = (address == R_BFPCTRL || address == R_TXRTSCTRL || low == 0x0F ||
+                                   (address >= R_CNF3 && address <= R_EFLG) ||
+                                   (low == 0x00 && address >= R_TXBCTRL(0) && address <= R_RXBCTRL(1)));
+                write(address, mosi, modifiable ? bitMask : 0xFF);
+            }
+            else {
+                protocolErrors++;
+            }
+            break;
+            
+        default:
+            break;
+    }
+    return miso;
+}
+
+void MCP2515Emulator::deselect(void)
+{
+    if (instruction == INSTRUCTION_READ_RX) {
+        // RXnIF is cleared when CS goes high after READ RX BUFFER
+        registers[R_CANINTF] &= ~(INTF_RX0IF << rxBuffer);
+        updateInt();
+    }
+    instruction = INSTRUCTION_UNKNOWN;
+}
+
+void MCP2515Emulator::advanceTo(uint64_t nanos)
+{
+    for (;;) {
+        if (onWire != WIRE_IDLE && wireEnd <= nanos) {
+            time = wireEnd;
+            finish();
+        }
+        else {
+            break;
+        }
+    }
+    time = nanos;
+}
+
+// ----------------------------------------------------------------------------
+// Registers
+
+void MCP2515Emulator::reset(void)
+{
+    memset(registers, 0, sizeof(registers));
+    registers[R_CANSTAT] = MODE_CONFIG << 5;
+    registers[R_CANCTRL] = 0x87;
+    rxFilterHit[0] = rxFilterHit[1] = 0;
+    if (onWire < 3) {
+        // a reset in the middle of our own frame ends it there
+        onWire = WIRE_IDLE;
+        busFree = time;
+    }
+    updateInt();
+}
+
+void MCP2515Emulator::write(uint8_t address, uint8_t value, uint8_t mask)
+{
+    uint8_t low = address & 0x0F;
+    
+    if (low == 0x0F) {
+        address = R_CANCTRL;
+    }
+    if (low == 0x0E || address == R_TEC || address == R_REC) {
+        return;
+    }
+    
+    // Filters, masks, bit timing and TXRTSCTRL only take writes in configuration mode
+    if (mode() != MODE_CONFIG &&
+        (address < R_BFPCTRL || (address >= 0x10 && address < R_TEC) || (address >= 0x20 && address <= R_CNF1) ||
+         address == R_TXRTSCTRL)) {
+        return;
+    }
+    
+    if (address >= R_TXBCTRL(0) && address < R_RXBCTRL(0)) {
+        uint8_t n = (address >> 4) - 3;
+        if (low == 0x00) {
+            mask &= TXB_TXREQ | 0x03;
+        }
+        else if (low <= 0x0D && (registers[R_TXBCTRL(n)] & TXB_TXREQ)) {
+            // the buffer must not change while it waits for the bus
+            protocolErrors++;
+            return;
+        }
+    }
+    else if (address >= R_RXBCTRL(0)) {
+        if (low != 0x00) {
+            return;
+        }
+        mask &= (address == R_RXBCTRL(0)) ? 0x64 : 0x60;
+        // RXM 01 and 10 are reserved on current parts
+        uint8_t rxm = ((registers[address] & ~mask) | (value & mask)) & 0x60;
+        if (rxm == 0x20 || rxm == 0x40) {
+            protocolErrors++;
+        }
+    }
+    else if (address == R_EFLG) {
+        mask &= EFLG_RX1OVR | EFLG_RX0OVR;
+    }
+    
+    uint8_t old = registers[address];
+    uint8_t now = (old & ~mask) | (value & mask);
+    registers[address] = now;
+    
+    if (address == R_CANCTRL) {
+        registers[R_CANSTAT] = (registers[R_CANSTAT] & 0x1F) | (now & 0xE0);
+        if (now & CANCTRL_ABAT) {
+            abortPending();
+        }
+    }
+    else if (address == R_RXBCTRL(0)) {
+        registers[address] = (now & RXB0_BUKT) ? (now | RXB0_BUKT1) : (now & ~RXB0_BUKT1);
+    }
+    else if (low == 0x00 && address >= R_TXBCTRL(0) && address < R_RXBCTRL(0)) {
+        uint8_t n = (address >> 4) - 3;
+        if ((now & TXB_TXREQ) && !(old & TXB_TXREQ)) {
+            registers[address] &= ~(TXB_ABTF | TXB_MLOA | TXB_TXERR);
+            if (registers[R_CANCTRL] & CANCTRL_ABAT) {
+                abortPending();
+            }
+        }
+        else if (!(now & TXB_TXREQ) && (old & TXB_TXREQ) && onWire != n) {
+            registers[address] |= TXB_ABTF;
+        }
+    }
+    
+    updateInt();
+    if (onWire == WIRE_IDLE) {
+        startNext();
+    }
+}
+
+uint8_t MCP2515Emulator::readStatus(void) const
+{
+    uint8_t intf = registers[R_CANINTF];
+    uint8_t status = intf & (INTF_RX0IF | INTF_RX1IF);
+    
+    for (uint8_t n = 0; n < 3; n++) {
+        if (registers[R_TXBCTRL(n)] & TXB_TXREQ) {
+            status |= 0x04 << (2 * n);
+        }
+        if (intf & (INTF_TX0IF << n)) {
+            status |= 0x08 << (2 * n);
+        }
+    }
+    return status;
+}
+
+uint8_t MCP2515Emulator::rxStatus(void) const
+{
+    uint8_t intf = registers[R_CANINTF];
+    uint8_t status = 0;
+    int8_t buffer = -1;
+    
+    if (intf & INTF_RX0IF) {
+        status |= 0x40;
+        buffer = 0;
+    }
+    if (intf & INTF_RX1IF) {
+        status |= 0x80;
+        if (buffer < 0) {
+            buffer = 1;
+        }
+    }
+    // filter match and type are those of RXB0 when both hold a frame
+    if (buffer >= 0) {
+        if (registers[R_RXBCTRL(buffer)] & RXB_RXRTR) {
+            status |= 0x08;
+        }
+        status |= rxFilterHit[buffer];
+    }
+    return status;
+}
+
+void MCP2515Emulator::setFlags(uint8_t address, uint8_t bits)
+{
+    registers[address] |= bits;
+    updateInt();
+}
+
+void MCP2515Emulator::updateInt(void)
+{
+    if (intAsserted()) {
+        *intPin &= ~(1 << intBit);
+    }
+    else {
+        *intPin |= (1 << intBit);
+    }
+}
+
+// ABAT: every buffer still waiting is aborted, the one on the wire finishes its frame
+void MCP2515Emulator::abortPending(void)
+{
+    for (uint8_t n = 0; n < 3; n++) {
+        uint8_t &ctrl = registers[R_TXBCTRL(n)];
+        if ((ctrl & TXB_TXREQ) && onWire != n) {
+            ctrl = (ctrl & ~TXB_TXREQ) | TXB_ABTF;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Receive
+
+bool MCP2515Emulator::accepts(uint8_t filter, uint8_t mask, uint16_t id) const
+{
+    uint8_t f = filterAddress(filter);
+    uint8_t m = 0x20 + (mask << 2);
+    uint16_t filterId = ((uint16_t)registers[f] << 3) | (registers[f + 1] >> 5);
+    uint16_t maskId = ((uint16_t)registers[m] << 3) | (registers[m + 1] >> 5);
+    
+    // a filter with EXIDE set only takes extended frames
+    return !(registers[f + 1] & 0x08) && ((id ^ filterId) & maskId) == 0;
+}
+
+void MCP2515Emulator::store(const Frame &frame)
+{
+    uint8_t rxm0 = (registers[R_RXBCTRL(0)] >> 5) & 0x03;
+    uint8_t rxm1 = (registers[R_RXBCTRL(1)] >> 5) & 0x03;
+    int8_t hit = -1;
+    
+    // RXM 11 takes any frame, 10 only extended ones, otherwise the filters decide
+    if (rxm0 == 3) {
+        hit = 0;
+    }
+    else if (rxm0 != 2) {
+        for (uint8_t f = 0; f < 2 && hit < 0; f++) {
+            if (accepts(f, 0, frame.id)) {
+                hit = f;
+            }
+        }
+    }
+    if (hit >= 0) {
+        if (!(registers[R_CANINTF] & INTF_RX0IF)) {
+            storeIn(0, frame, hit);
+        }
+        else if (registers[R_RXBCTRL(0)] & RXB0_BUKT) {
+            if (!(registers[R_CANINTF] & INTF_RX1IF)) {
+                storeIn(1, frame, 6 + hit);
+            }
+            else {
+                registers[R_EFLG] |= EFLG_RX1OVR;
+                setFlags(R_CANINTF, INTF_ERRIF);
+            }
+        }
+        else {
+            registers[R_EFLG] |= EFLG_RX0OVR;
+            setFlags(R_CANINTF, INTF_ERRIF);
+        }
+        return;
+    }
+    
+    if (rxm1 == 3) {
+        hit = 2;
+    }
+    else if (rxm1 != 2) {
+        for (uint8_t f = 2; f < 6 && hit < 0; f++) {
+            if (accepts(f, 1, frame.id)) {
+                hit = f;
+            }
+        }
+    }
+    if (hit >= 0) {
+        if (!(registers[R_CANINTF] & INTF_RX1IF)) {
+            storeIn(1, frame, hit);
+        }
+        else {
+            registers[R_EFLG] |= EFLG_RX1OVR;
+            setFlags(R_CANINTF, INTF_ERRIF);
+        }
+    }
+}
+
+// filterHit is the RX STATUS code: 0..5 for RXF0..5, 6 and 7 for RXF0/1 rolled over into RXB1
+void MCP2515Emulator::storeIn(uint8_t buffer, const Frame &frame, uint8_t filterHit)
+{
+    uint8_t base = R_RXBCTRL(buffer);
+    // FILHIT is bit 0 of RXB0CTRL, bits 2..0 of RXB1CTRL
+    uint8_t ctrl = registers[base] & ~(RXB_RXRTR | ((buffer == 0) ? 0x01 : 0x07));
+    
+    ctrl |= frame.rtr ? RXB_RXRTR : 0;
+    ctrl |= (filterHit >= 6) ? filterHit - 6 : filterHit;
+    registers[base] = ctrl;
+    registers[base + 1] = frame.id >> 3;
+    // SRR marks a standard remote frame
+    registers[base + 2] = (uint8_t)(frame.id << 5) | (frame.rtr ? 0x10 : 0);
+    registers[base + 3] = 0;
+    registers[base + 4] = 0;
+    registers[base + 5] = frame.length & 0x0F;
+    if (!frame.rtr) {
+        memcpy(&registers[base + 6], frame.data, (frame.length > 8) ? 8 : frame.length);
+    }
+    rxFilterHit[buffer] = filterHit;
+    setFlags(R_CANINTF, INTF_RX0IF << buffer);
+}
+
+// ----------------------------------------------------------------------------
+// Transmit
+
+MCP2515Emulator::Frame MCP2515Emulator::txFrame(uint8_t buffer) const
+{
+    uint8_t base = R_TXBCTRL(buffer);
+    Frame frame;
+    
+    memset(&frame, 0, sizeof(frame));
+    frame.id = ((uint16_t)registers[base + 1] << 3) | (registers[base + 2] >> 5);
+    frame.rtr = registers[base + 5] & 0x40;
+    frame.length = registers[base + 5] & 0x0F;
+    if (!frame.rtr) {
+        memcpy(frame.data, &registers[base + 6], (frame.length > 8) ? 8 : frame.length);
+    }
+    return frame;
+}
+
+// Arbitration at the start of the next frame: of our own buffers the one with
+// the highest TXP, then the highest number, competes against the other nodes
+void MCP2515Emulator::startNext(void)
+{
+    int8_t own = -1;
+    
+    if ((mode() == MODE_NORMAL || mode() == MODE_LOOPBACK) && !(registers[R_EFLG] & EFLG_TXBO)) {
+        for (int8_t n = 2; n >= 0; n--) {
+            uint8_t ctrl = registers[R_TXBCTRL(n)];
+            if ((ctrl & TXB_TXREQ) && (own < 0 || (ctrl & 0x03) > (registers[R_TXBCTRL(own)] & 0x03))) {
+                own = n;
+            }
+        }
+    }
+    
+    if (own < 0 && waiting.empty()) {
+        return;
+    }
+    
+    uint64_t start = (busFree > time) ? busFree : time;
+    
+    if (own >= 0 && mode() == MODE_NORMAL && !waiting.empty()) {
+        Frame ours = txFrame(own);
+        const Frame &theirs = waiting.front();
+        // lower id wins, a data frame wins over a remote frame of the same id
+        if (theirs.id < ours.id || (theirs.id == ours.id && !theirs.rtr && ours.rtr)) {
+            registers[R_TXBCTRL(own)] |= TXB_MLOA;
+            own = -1;
+        }
+    }
+    
+    if (own >= 0) {
+        onWire = own;
+        wireFrame = txFrame(own);
+    }
+    else {
+        onWire = WIRE_REMOTE;
+        wireFrame = waiting.front();
+    }
+    wireEnd = start + frameNanos(wireFrame.length, wireFrame.rtr);
+}
+
+void MCP2515Emulator::finish(void)
+{
+    uint8_t wire = onWire;
+    Frame frame = wireFrame;
+    
+    onWire = WIRE_IDLE;
+    busFree = wireEnd;
+    frame.end = wireEnd;
+    
+    if (wire == WIRE_REMOTE) {
+        waiting.pop_front();
+        if (mode() == MODE_NORMAL || mode() == MODE_LISTEN) {
+            store(frame);
+        }
+    }
+    else if (!acknowledge && mode() != MODE_LOOPBACK) {
+        // nobody acknowledged: error frame, TEC up to error passive, then try again
+        uint8_t &ctrl = registers[R_TXBCTRL(wire)];
+        uint8_t tec = registers[R_TEC];
+        ctrl |= TXB_TXERR;
+        setErrorCounters((tec < 128) ? tec + 8 : tec, registers[R_REC]);
+        registers[R_CANINTF] |= INTF_MERRF;
+        if (registers[R_CANCTRL] & CANCTRL_ABAT) {
+            ctrl = (ctrl & ~TXB_TXREQ) | TXB_ABTF;
+        }
+        // the frame was handed out to the wire, a cleared TXREQ ends the retries
+        else if (!(ctrl & TXB_TXREQ)) {
+            ctrl |= TXB_ABTF;
+        }
+    }
+    else {
+        registers[R_TXBCTRL(wire)] &= ~TXB_TXREQ;
+        if (registers[R_TEC]) {
+            setErrorCounters(registers[R_TEC] - 1, registers[R_REC]);
+        }
+        transmitted.push_back(frame);
+        if (mode() == MODE_LOOPBACK) {
+            store(frame);
+        }
+        setFlags(R_CANINTF, INTF_TX0IF << wire);
+    }
+    
+    updateInt();
+    startNext();
+}
@@ -0,0 +1,156 @@
+/*
+ * MCP2515 register level emulator for host tests of the CAN driver
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef MCP2515EMULATOR_H
+#define MCP2515EMULATOR_H
+
+#include <inttypes.h>
+#include <deque>
+#include <vector>
+#include "HostHardware.h"
+
+/**
+ * Plays an MCP2515 on the host SPI bus, as far as the CAN driver uses it:
+ *
+ *  - the SPI instructions RESET, READ, WRITE, READ RX BUFFER, LOAD TX BUFFER,
+ *    RTS, READ STATUS, RX STATUS and BIT MODIFY, including sequential reads
+ *    and writes, RXnIF cleared when CS goes high after READ RX BUFFER, and
+ *    BIT MODIFY falling back to a plain write on registers that don't
+ *    support it,
+ *  - the register file with its read-only bits, the configuration-only
+ *    registers and the operation modes,
+ *  - RXB0/RXB1 with acceptance filters, masks and rollover (BUKT), overflow
+ *    into EFLG,
+ *  - TXB0..TXB2 with TXREQ, TXP, arbitration against other nodes (MLOA),
+ *    missing acknowledge (TXERR, TEC), ABAT and ABTF, TXnIF,
+ *  - the INT pin, low while any enabled interrupt flag is set.
+ *
+ * The other nodes are the test: receive() puts their frames on the bus,
+ * sent() lists what the MCP2515 transmitted. Frames take their time on the
+ * wire at the configured bitrate, without stuff bits, and come in back to
+ * back. Every SPI byte is counted per instruction.
+ */
+class MCP2515Emulator : public Host::SpiDevice
+{
+public:
+    struct Frame
+    {
+        uint16_t id;
+        bool rtr;
+        uint8_t length;
+        uint8_t data[8];
+        uint64_t end;           // ns, when the frame was complete on the bus
+    };
+    
+    enum Instruction {
+        INSTRUCTION_RESET,
+        INSTRUCTION_READ,
+        INSTRUCTION_WRITE,
+        INSTRUCTION_READ_RX,
+        INSTRUCTION_WRITE_TX,
+        INSTRUCTION_RTS,
+        INSTRUCTION_READ_STATUS,
+        INSTRUCTION_RX_STATUS,
+        INSTRUCTION_BIT_MODIFY,
+        INSTRUCTION_UNKNOWN,
+        INSTRUCTION_COUNT
+    };
+    
+    struct Counters
+    {
+        uint32_t bytes;
+        uint32_t transactions;
+        uint32_t instructions[INSTRUCTION_COUNT];
+        uint32_t instructionBytes[INSTRUCTION_COUNT];
+    };
+    
+    // intPort/intBit: PORTx and bit of the pin the INT output drives, PINx is 2 below
+    MCP2515Emulator(volatile uint8_t *csPort, uint8_t csBit, volatile uint8_t *intPort, uint8_t intBit,
+                    uint32_t bitrate = 47619);
+    
+    // Bus side
+    void receive(uint16_t id, const uint8_t *data, uint8_t length, bool rtr = false);
+    void receive(const Frame &frame);
+    void setAcknowledge(bool acknowledge);
+    void setErrorCounters(uint8_t tec, uint8_t rec);
+    const std::vector<Frame> &sent(void) const { return transmitted; }
+    void clearSent(void) { transmitted.clear(); }
+    bool busIdle(void) const { return onWire == WIRE_IDLE && waiting.empty(); }
+    uint32_t frameNanos(uint8_t length, bool rtr) const;
+    
+    // Chip side
+    uint8_t reg(uint8_t address) const { return registers[address & 0x7F]; }
+    uint8_t mode(void) const { return registers[0x0E] >> 5; }
+    bool intAsserted(void) const;
+    
+    Counters counters;
+    uint32_t protocolErrors;    // instructions the chip would not understand
+    
+    // SpiDevice
+    virtual void select(void);
+    virtual uint8_t transfer(uint8_t mosi);
+    virtual void deselect(void);
+    virtual void advanceTo(uint64_t nanos);
+    
+private:
+    enum { WIRE_IDLE = 0xFF, WIRE_REMOTE = 0xFE };
+    
+    void reset(void);
+    void write(uint8_t address, uint8_t value, uint8_t mask = 0xFF);
+    void setFlags(uint8_t address, uint8_t bits);
+    uint8_t readStatus(void) const;
+    uint8_t rxStatus(void) const;
+    void updateInt(void);
+    void abortPending(void);
+    bool accepts(uint8_t filter, uint8_t mask, uint16_t id) const;
+    void store(const Frame &frame);
+    void storeIn(uint8_t buffer, const Frame &frame, uint8_t filterHit);
+    void startNext(void);
+    void finish(void);
+    Frame txFrame(uint8_t buffer) const;
+    
+    volatile uint8_t *intPin;
+    uint8_t intBit;
+    uint32_t bitNanos;
+    bool acknowledge;
+    
+    uint8_t registers[0x80];
+    uint8_t rxFilterHit[2];         // RX STATUS filter match of RXB0/RXB1
+    
+    // SPI transaction
+    Instruction instruction;
+    uint8_t position;               // bytes of the transaction so far
+    uint8_t address;
+    uint8_t bitMask;
+    uint8_t rxBuffer;               // READ RX BUFFER: RXBn to release at the end
+    
+    // Bus
+    std::deque<Frame> waiting;      // from receive(), in order
+    std::vector<Frame> transmitted;
+    uint8_t onWire;                 // TXBn, WIRE_REMOTE or WIRE_IDLE
+    Frame wireFrame;
+    uint64_t wireEnd;
+    uint64_t busFree;               // ns the bus went idle
+    uint64_t time;
+};
+
+#endif
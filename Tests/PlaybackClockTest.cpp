@@ -0,0 +1,143 @@
+/*
+ * Host tests of the BCD track and time bytes PlaybackClock hands out
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "TestCase.h"
+#include "HostHardware.h"
+#include "PlaybackClock.h"
+
+// In steps of a second, advanceMicros() only takes 71 minutes at a time
+static void advanceMs(uint32_t ms)
+{
+    for (; ms >= 1000; ms -= 1000) {
+        Host::advanceMicros(1000000UL);
+    }
+    Host::advanceMicros(ms * 1000);
+}
+
+// Nothing is known before the first setTrack(), and again after clear()
+static void unknownBeforeSetTrack(void)
+{
+    PlaybackClock clock;
+    
+    clock.setPlaying(true);
+    advanceMs(5000);
+    CHECK_EQUAL(PLAYBACK_CLOCK_UNKNOWN, clock.bcdTrack());
+    CHECK_EQUAL(PLAYBACK_CLOCK_UNKNOWN, clock.bcdMinute());
+    CHECK_EQUAL(PLAYBACK_CLOCK_UNKNOWN, clock.bcdSecond());
+    
+    clock.setTrack(7, 0);
+    CHECK_EQUAL(0x07, clock.bcdTrack());
+    CHECK_EQUAL(0x00, clock.bcdMinute());
+    CHECK_EQUAL(0x00, clock.bcdSecond());
+    
+    clock.clear();
+    CHECK(!clock.isPlaying());
+    CHECK_EQUAL(PLAYBACK_CLOCK_UNKNOWN, clock.bcdTrack());
+    CHECK_EQUAL(PLAYBACK_CLOCK_UNKNOWN, clock.bcdMinute());
+    CHECK_EQUAL(PLAYBACK_CLOCK_UNKNOWN, clock.bcdSecond());
+}
+
+// The clock stands while paused and goes on from there when resumed
+static void pauseAndResume(void)
+{
+    PlaybackClock clock;
+    
+    clock.setPlaying(true);
+    clock.setTrack(12, 0);
+    advanceMs(83500);
+    CHECK_EQUAL(0x12, clock.bcdTrack());
+    CHECK_EQUAL(0x01, clock.bcdMinute());
+    CHECK_EQUAL(0x23, clock.bcdSecond());
+    
+    clock.setPlaying(false);
+    advanceMs(30000);
+    CHECK_EQUAL(0x01, clock.bcdMinute());
+    CHECK_EQUAL(0x23, clock.bcdSecond());
+    
+    // a second pause report does not move it either
+    clock.setPlaying(false);
+    clock.setPlaying(true);
+    advanceMs(37000);
+    CHECK_EQUAL(0x02, clock.bcdMinute());
+    CHECK_EQUAL(0x00, clock.bcdSecond());
+    CHECK_EQUAL(120500, clock.position());
+    
+    // a new track starts at 0:00 and keeps running
+    clock.setTrack(13, 0);
+    advanceMs(9000);
+    CHECK_EQUAL(0x13, clock.bcdTrack());
+    CHECK_EQUAL(0x00, clock.bcdMinute());
+    CHECK_EQUAL(0x09, clock.bcdSecond());
+}
+
+// Past the end of the track the clock waits there for the next one
+static void clampedToDuration(void)
+{
+    PlaybackClock clock;
+    
+    clock.setPlaying(true);
+    clock.setTrack(3, 185000);
+    advanceMs(184000);
+    CHECK_EQUAL(0x03, clock.bcdMinute());
+    CHECK_EQUAL(0x04, clock.bcdSecond());
+    advanceMs(60000);
+    CHECK_EQUAL(185000, clock.position());
+    CHECK_EQUAL(0x03, clock.bcdMinute());
+    CHECK_EQUAL(0x05, clock.bcdSecond());
+    
+    // pausing at the end keeps it at the end
+    clock.setPlaying(false);
+    clock.setPlaying(true);
+    advanceMs(1000);
+    CHECK_EQUAL(185000, clock.position());
+}
+
+// Two BCD digits: track numbers outside 1..99 are unknown, minutes stop at 99
+static void capsAtTwoDigits(void)
+{
+    PlaybackClock clock;
+    
+    clock.setTrack(100, 0);
+    CHECK_EQUAL(PLAYBACK_CLOCK_UNKNOWN, clock.bcdTrack());
+    clock.setTrack(0, 0);
+    CHECK_EQUAL(PLAYBACK_CLOCK_UNKNOWN, clock.bcdTrack());
+    clock.setTrack(99, 0);
+    CHECK_EQUAL(0x99, clock.bcdTrack());
+    
+    clock.setPlaying(true);
+    advanceMs(99UL * 60000 + 59000);
+    CHECK_EQUAL(0x99, clock.bcdMinute());
+    CHECK_EQUAL(0x59, clock.bcdSecond());
+    // 101:02, the seconds go on
+    advanceMs(2UL * 60000 + 3000);
+    CHECK_EQUAL(0x99, clock.bcdMinute());
+    CHECK_EQUAL(0x02, clock.bcdSecond());
+}
+
+int main(void)
+{
+    RUN(unknownBeforeSetTrack);
+    RUN(pauseAndResume);
+    RUN(clampedToDuration);
+    RUN(capsAtTwoDigits);
+    return testResult("PlaybackClockTest");
+}
@@ -0,0 +1,231 @@
+/*
+ * Host tests of the RN52 intent queue, and a timing model of the main loop that gates it
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "TestCase.h"
+#include "HostHardware.h"
+#include "CDC.h"
+#include "RN52handler.h"
+#include "RN52strings.h"
+#include "SoftwareSerial.h"
+
+Timer time;
+
+// "a/b/c" after label in the last printStatistics(), -1 each if it is not there
+static bool intentStatistics(RN52handler &bt, long &depth, long &highWater, long &drops)
+{
+    const char *label = "BT intent queue depth/high water/drops: ";
+    
+    Serial.output.clear();
+    bt.printStatistics();
+    size_t at = Serial.output.find(label);
+    depth = highWater = drops = -1;
+    if (at == std::string::npos) {
+        return false;
+    }
+    const char *text = Serial.output.c_str() + at + strlen(label);
+    depth = atol(text);
+    text = strchr(text, '/') + 1;
+    highWater = atol(text);
+    drops = atol(strchr(text, '/') + 1);
+    return true;
+}
+
+static void burstPastTheQueueIsCounted(void)
+{
+    RN52handler bt;
+    long depth, highWater, drops;
+    
+    bt.initialize();
+    for (uint8_t i = 0; i < BT_INTENT_QUEUE_SIZE; i++) {
+        bt.bt_next();
+    }
+    bt.bt_volup();
+    bt.bt_voldown();
+    bt.bt_prev();
+    bt.bt_play();
+    
+    CHECK(intentStatistics(bt, depth, highWater, drops));
+    CHECK_EQUAL(BT_INTENT_QUEUE_SIZE, depth);
+    CHECK_EQUAL(BT_INTENT_QUEUE_SIZE, highWater);
+    CHECK_EQUAL(4, drops);
+    CHECK(Serial.output.find("Last dropped BT intent: 0") != std::string::npos);    // BT_PLAY
+}
+
+static void updatePassesOneIntentPerLoop(void)
+{
+    RN52handler bt;
+    long depth, highWater, drops;
+    
+    bt.initialize();
+    bt.bt_next();
+    bt.bt_next();
+    bt.bt_prev();
+    for (long left = 2; left >= 0; left--) {
+        bt.update();
+        CHECK(intentStatistics(bt, depth, highWater, drops));
+        CHECK_EQUAL(left, depth);
+    }
+    CHECK_EQUAL(3, highWater);
+    CHECK_EQUAL(0, drops);
+    CHECK(Serial.output.find("Last dropped") == std::string::npos);
+}
+
+// Time the soft-UART keeps interrupts off for one byte
+static uint32_t softUartByteNanos(void)
+{
+    SoftwareSerial uart(UART_RX_PIN, UART_TX_PIN);
+    uart.begin(9600);
+    uint64_t start = Host::nanos();
+    uart.write('A');
+    return (uint32_t)(Host::nanos() - start);
+}
+
+static void softUartByteIsAMillisecond(void)
+{
+    uint32_t nanos = softUartByteNanos();
+    CHECK(nanos > 1000000 && nanos < 1100000);      // 10 bits at 9600 baud
+}
+
+// The command each intent ends up writing, indexed by BtIntent
+static const char *const intentCommands[] = {
+    RN52_CMD_AVCRP_PLAYPAUSE,   // BT_PLAY
+    RN52_CMD_AVCRP_PREV,        // BT_PREV
+    RN52_CMD_AVCRP_NEXT,        // BT_NEXT
+    RN52_CMD_AVCRP_VASSISTANT,  // BT_VASSISTANT
+    RN52_CMD_VOLUP,             // BT_VOLUP
+    RN52_CMD_VOLDOWN,           // BT_VOLDOWN
+    RN52_CMD_DISCOVERY_ON,      // BT_VISIBLE
+    RN52_CMD_DISCOVERY_OFF,     // BT_INVISIBLE
+    RN52_CMD_RECONNECTLAST,     // BT_RECONNECT
+    RN52_CMD_DISCONNECT,        // BT_DISCONNECT
+    RN52_SET_MAXVOL,            // BT_SET_MAXVOL
+    RN52_CMD_REBOOT             // BT_REBOOT
+};
+#define INTENT_COUNT    (sizeof(intentCommands) / sizeof(intentCommands[0]))
+
+static void everyCommandFitsTheGuard(void)
+{
+    uint32_t byteNanos = softUartByteNanos();
+    
+    CHECK_EQUAL(BT_REBOOT + 1, INTENT_COUNT);
+    for (uint8_t i = 0; i < INTENT_COUNT; i++) {
+        CHECK(strlen_P(intentCommands[i]) * byteNanos < BT_CAN_GUARD * 1000000UL);
+    }
+}
+
+/**
+ * The main loop as far as timing goes: each pass sends the '6A2' frames that are due, then, unless the gate holds it
+ * back (CDChandler::canWorkPending()), passes one intent to the RN52, whose command keeps the loop for its soft-UART
+ * bytes. Intents come in bursts of up to maxBurst, a few hundred ms apart.
+ */
+
+struct LoopModel
+{
+    uint32_t posted;
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t worstLateness;         // us, of a '6A2' follow-up frame
+};
+
+static LoopModel runLoop(bool gated, uint8_t maxBurst, uint32_t seconds)
+{
+    const uint32_t loopNanos = 200000;              // everything else a pass does
+    const uint32_t byteNanos = softUartByteNanos();
+    RingBuffer<uint8_t, BT_INTENT_QUEUE_SIZE> intents;
+    LoopModel model = {0, 0, 0, 0};
+    uint64_t now = 0;
+    uint64_t nextRequest = 0;
+    uint64_t due[NODE_STATUS_TX_MSG_SIZE];
+    uint8_t sent = NODE_STATUS_TX_MSG_SIZE;
+    uint32_t seed = 1;
+    uint8_t intent;
+    
+    while (now < seconds * 1000000000ULL) {
+        if (now >= nextRequest) {
+            // '6A1' once a second; the first reply goes out from the interrupt handler, the rest one interval apart
+            for (uint8_t i = 1; i < NODE_STATUS_TX_MSG_SIZE; i++) {
+                due[i] = nextRequest + i * NODE_STATUS_TX_INTERVAL * 1000000ULL;
+            }
+            sent = 1;
+            nextRequest += 1000000000ULL;
+        }
+        if (sent < NODE_STATUS_TX_MSG_SIZE && now >= due[sent]) {
+            uint32_t lateness = (uint32_t)((now - due[sent]) / 1000);
+            if (lateness > model.worstLateness) {
+                model.worstLateness = lateness;
+            }
+            sent++;
+        }
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 2000 == 0) {
+            for (uint8_t burst = 1 + (seed >> 8) % maxBurst; burst; burst--) {
+                model.posted++;
+                if (!intents.push((seed >> 4) % INTENT_COUNT)) {
+                    model.dropped++;
+                }
+            }
+        }
+        bool hold = gated && sent < NODE_STATUS_TX_MSG_SIZE && due[sent] - now < BT_CAN_GUARD * 1000000ULL;
+        if (!hold && intents.pop(intent)) {
+            model.written++;
+            now += strlen_P(intentCommands[intent]) * byteNanos;
+        }
+        now += loopNanos;
+    }
+    while (intents.pop(intent)) {                   // still waiting at the end
+        model.written++;
+    }
+    return model;
+}
+
+static void gateKeepsRepliesInTheirWindow(void)
+{
+    LoopModel inline_ = runLoop(false, BT_INTENT_QUEUE_SIZE, 600);
+    LoopModel gated = runLoop(true, BT_INTENT_QUEUE_SIZE, 600);
+    
+    // Within the +/- 10% of NODE_STATUS_TX_INTERVAL with room to spare, and better than running the RN52 side inline
+    CHECK(gated.worstLateness < 1000);
+    CHECK(inline_.worstLateness > gated.worstLateness);
+    CHECK(inline_.worstLateness < NODE_STATUS_TX_INTERVAL * 100);
+    CHECK(gated.written > 0);
+    CHECK_EQUAL(0, gated.dropped);                  // holding back for BT_CAN_GUARD ms never fills the queue
+}
+
+static void burstsPastTheQueueAreDropped(void)
+{
+    LoopModel gated = runLoop(true, BT_INTENT_QUEUE_SIZE + 4, 600);
+    
+    // Each one that did not fit is counted, none just goes missing
+    CHECK(gated.dropped > 0);
+    CHECK_EQUAL(gated.posted, gated.written + gated.dropped);
+}
+
+int main(void)
+{
+    RUN(burstPastTheQueueIsCounted);
+    RUN(updatePassesOneIntentPerLoop);
+    RUN(softUartByteIsAMillisecond);
+    RUN(everyCommandFitsTheGuard);
+    RUN(gateKeepsRepliesInTheirWindow);
+    RUN(burstsPastTheQueueAreDropped);
+    return testResult("RN52handlerTest");
+}
@@ -0,0 +1,99 @@
+/*
+ * Request to reply latency of a '6A1' node status request, measured on the MCP2515 emulator
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include <stdio.h>
+#include "CANFixture.h"
+
+/*
+ The Makefile builds this twice, as ResponderBenchmark with the driver's
+ CAN_FAST_RESPONDER default and as ResponderBenchmarkInline with
+ CAN_FAST_RESPONDER 0. The same REQUESTS '6A1' requests come in, one every
+ REQUEST_GAP_US, while a main loop model handles its frames the way
+ CDChandler does: it sends the '6A2' reply itself unless fastReplySent().
+ Each loop pass is busy for 0..LOOP_PASS_MAX_US on other work (SID text,
+ RN52), drawn from a fixed pseudo random sequence so both builds see the
+ same loop. Latency is from the end of the request on the bus to the end
+ of its reply.
+ */
+
+#define REQUESTS            100
+#define REQUEST_GAP_US      50000UL
+#define LOOP_PASS_MAX_US    5000
+
+static const uint8_t reply[8] PROGMEM = {0x32, 0x00, 0x00, 0x03, 0x01, 0x02, 0x00, 0x00};
+
+static const uint8_t *responder(const CANClass::msgCAN &request)
+{
+    return reply;
+}
+
+int main(void)
+{
+    CANFixture f;
+    CAN.setResponder(0x6A1, 0x6A2, &responder, reply);
+    
+    uint32_t seed = 1;
+    uint64_t sum = 0;
+    uint64_t min = ~0ULL;
+    uint64_t max = 0;
+    uint16_t fast = 0;
+    
+    for (uint16_t n = 0; n < REQUESTS; n++) {
+        uint8_t data[8] = {0x02, 0, 0, 0x02, 0, 0, 0, 0};
+        uint64_t requestEnd = Host::nanos() + f.chip.frameNanos(8, false);
+        uint64_t next = requestEnd + REQUEST_GAP_US * 1000ULL;
+        f.chip.clearSent();
+        f.chip.receive(0x6A1, data, 8);
+        
+        while (Host::nanos() < next) {
+            while (CAN.available()) {
+                if (CAN.fastReplySent(CAN.front())) {
+                    fast++;
+                }
+                else {
+                    CANClass::msgCAN message;
+                    message.setHeader(0x6A2, 0, 8);
+                    memcpy_P(message.data, reply, 8);
+                    CAN.send(&message);
+                }
+                CAN.pop();
+            }
+            CAN.update();
+            seed = seed * 1103515245 + 12345;
+            Host::advanceMicros((seed >> 16) % LOOP_PASS_MAX_US);
+        }
+        
+        if (f.chip.sent().size() != 1) {
+            printf("request %u: %u replies\n", n, (unsigned)f.chip.sent().size());
+            return 1;
+        }
+        uint64_t latency = f.chip.sent()[0].end - requestEnd;
+        sum += latency;
+        min = (latency < min) ? latency : min;
+        max = (latency > max) ? latency : max;
+    }
+    
+    printf("6A1 -> 6A2, CAN_FAST_RESPONDER %d: %u requests, %u answered from the interrupt, "
+           "latency min %.2f ms, avg %.2f ms, max %.2f ms\n",
+           CAN_FAST_RESPONDER, REQUESTS, fast, min / 1e6, (double)sum / REQUESTS / 1e6, max / 1e6);
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Host tests of the SID text frame groups
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include "TestCase.h"
+#include "SidText.h"
+
+// The twelve characters a group carries, as the SID puts them together
+static std::string row(const SidFrame *frames)
+{
+    std::string text;
+    for (uint8_t i = 0; i < SID_TEXT_FRAMES; i++) {
+        for (uint8_t c = 3; c < CAN_FRAME_LENGTH && text.size() < SID_TEXT_ROW_LENGTH; c++) {
+            if (frames[i][c]) {
+                text += (char)frames[i][c];
+            }
+        }
+    }
+    return text;
+}
+
+// A group goes out as MessageSender sends it: one frame at a time, each read
+// when it is due, with something happening between the frames
+static std::string sendGroup(SidText &sid, void (*between)(SidText &sid, uint8_t frame))
+{
+    const SidFrame *frames = sid.nextFrames();
+    SidFrame sent[SID_TEXT_FRAMES];
+    for (uint8_t i = 0; i < SID_TEXT_FRAMES; i++) {
+        memcpy(sent[i], frames[i], CAN_FRAME_LENGTH);
+        if (between) {
+            between(sid, i);
+        }
+    }
+    return row(sent);
+}
+
+static void headersStay(SidText &sid)
+{
+    const SidFrame *frames = sid.nextFrames();
+    CHECK_EQUAL(0x42, frames[0][0]);
+    CHECK_EQUAL(0x01, frames[1][0]);
+    CHECK_EQUAL(0x00, frames[2][0]);
+    for (uint8_t i = 0; i < SID_TEXT_FRAMES; i++) {
+        CHECK_EQUAL(0x96, frames[i][1]);
+        CHECK_EQUAL(0x02, frames[i][2]);
+    }
+}
+
+// The same text costs no encoding, a new one is encoded once
+static void shortTextEncodedOnce(void)
+{
+    SidText sid;
+    
+    sid.setText("BLUESAAB");
+    uint16_t encodes = sid.getEncodeCount();
+    CHECK_STRING("BLUESAAB", sendGroup(sid, 0));
+    CHECK_EQUAL(encodes + 1, sid.getEncodeCount());
+    CHECK(!sid.setText("BLUESAAB"));
+    CHECK_STRING("BLUESAAB", sendGroup(sid, 0));
+    CHECK_EQUAL(encodes + 1, sid.getEncodeCount());
+    headersStay(sid);
+}
+
+// A minute of groups, one per SID_CONTROL_TX_BASETIME: a text that fits on
+// the row is encoded once
+static void encodesPerMinute(void)
+{
+    SidText sid;
+    
+    sid.setText("BLUESAAB 12!");
+    uint16_t encodes = sid.getEncodeCount();
+    for (uint8_t n = 0; n < 60; n++) {
+        sid.nextFrames();
+    }
+    CHECK_EQUAL(encodes + 1, sid.getEncodeCount());
+    
+    // scrolling: each step encodes, so does the jump back to the start,
+    // the groups resting at either end do not
+    const char *text = "Artist Name - Track Title";
+    uint8_t steps = strlen(text) - SID_TEXT_ROW_LENGTH;
+    sid.setText(text);
+    sid.nextFrames();
+    sid.nextFrames();
+    for (uint8_t cycle = 0; cycle < 3; cycle++) {
+        encodes = sid.getEncodeCount();
+        for (uint8_t n = 0; n < steps + 2 * SID_TEXT_SCROLL_PAUSE + 1; n++) {
+            sid.nextFrames();
+        }
+        CHECK_EQUAL(encodes + steps + 1, sid.getEncodeCount());
+    }
+}
+
+static void changeText(SidText &sid, uint8_t frame)
+{
+    if (frame == 0) {
+        sid.setText("Other Title");
+    }
+}
+
+// A text change between the frames of a group does not tear it; the new
+// text goes out whole with the next group
+static void textChangeMidGroup(void)
+{
+    SidText sid;
+    
+    sid.setText("Some Artist");
+    CHECK_STRING("Some Artist", sendGroup(sid, &changeText));
+    CHECK_STRING("Other Title", sendGroup(sid, 0));
+    CHECK_STRING("Other Title", sendGroup(sid, 0));
+    headersStay(sid);
+}
+
+static void changeTextTwice(SidText &sid, uint8_t frame)
+{
+    sid.setText(frame == 1 ? "Second" : "First");
+}
+
+static void textChangesEveryFrame(void)
+{
+    SidText sid;
+    
+    sid.setText("Start Text");
+    CHECK_STRING("Start Text", sendGroup(sid, &changeTextTwice));
+    CHECK_STRING("First", sendGroup(sid, 0));
+}
+
+static void newLongText(SidText &sid, uint8_t frame)
+{
+    if (frame == 1) {
+        sid.setText("Artist Name - Track Title");
+    }
+}
+
+// A scrolling text moves on by one character per group, each group whole
+static void scrollingText(void)
+{
+    SidText sid;
+    const char *text = "Artist Name - Track Title";
+    uint8_t last = strlen(text) - SID_TEXT_ROW_LENGTH;
+    
+    sid.setText("Short");
+    sendGroup(sid, &newLongText);
+    
+    std::string shown[40];
+    for (uint8_t n = 0; n < 40; n++) {
+        shown[n] = sendGroup(sid, 0);
+    }
+    // rests at the start, one character per group, rests at the end, back to the start
+    for (uint8_t n = 0; n < SID_TEXT_SCROLL_PAUSE; n++) {
+        CHECK_STRING(std::string(text, SID_TEXT_ROW_LENGTH), shown[n]);
+    }
+    for (uint8_t offset = 1; offset <= last; offset++) {
+        CHECK_STRING(std::string(text + offset, SID_TEXT_ROW_LENGTH), shown[SID_TEXT_SCROLL_PAUSE - 1 + offset]);
+    }
+    for (uint8_t n = 1; n <= SID_TEXT_SCROLL_PAUSE; n++) {
+        CHECK_STRING(std::string(text + last, SID_TEXT_ROW_LENGTH), shown[SID_TEXT_SCROLL_PAUSE - 1 + last + n]);
+    }
+    CHECK_STRING(std::string(text, SID_TEXT_ROW_LENGTH), shown[2 * SID_TEXT_SCROLL_PAUSE + last]);
+    headersStay(sid);
+}
+
+// With a scrolling text every call encodes, and still the group handed out
+// by the previous call stays as it was
+static void scrollingLeavesPreviousGroup(void)
+{
+    SidText sid;
+    
+    sid.setText("Artist Name - Track Title");
+    for (uint8_t n = 0; n < SID_TEXT_SCROLL_PAUSE + 1; n++) {
+        sid.nextFrames();
+    }
+    const SidFrame *first = sid.nextFrames();
+    SidFrame copy[SID_TEXT_FRAMES];
+    memcpy(copy, first, sizeof(copy));
+    const SidFrame *second = sid.nextFrames();
+    
+    CHECK(first != second);
+    CHECK(memcmp(copy, first, sizeof(copy)) == 0);
+    CHECK(row(first) != row(second));
+}
+
+int main(void)
+{
+    RUN(shortTextEncodedOnce);
+    RUN(encodesPerMinute);
+    RUN(textChangeMidGroup);
+    RUN(textChangesEveryFrame);
+    RUN(scrollingText);
+    RUN(scrollingLeavesPreviousGroup);
+    return testResult("SidTextTest");
+}
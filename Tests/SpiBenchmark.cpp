@@ -0,0 +1,275 @@
+/*
+ * SPI cost of the CAN driver operations, measured on the MCP2515 emulator
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include <stdio.h>
+#include "CANFixture.h"
+
+/*
+ Every operation runs on a fresh CANClass/MCP2515 pair at 47.619 kbit/s and
+ reports, per call:
+ 	bytes   SPI bytes clocked, instruction and address bytes included
+ 	CS      SPI transactions (CS low to high)
+ 	SPI us  time those bytes keep the SPI bus busy at the begin() clock
+ 	        (F_CPU/2 = 8 MHz, 1 us a byte)
+ 	wall us host clock from the call to its return, _delay_us() included
+ send() is measured without the TX interrupt its frame raises later, that
+ one is listed on its own like the RX interrupt per received frame.
+ The emulator counts its bytes, so they don't depend on CAN_SPI_STATISTICS.
+ */
+
+static const uint16_t ids[] = {0x290, 0x3C0, 0x3C8, 0x6A1, 0x6A2};
+
+struct Cost
+{
+    uint32_t bytes;
+    uint32_t transactions;
+    uint64_t start;
+    
+    Cost(MCP2515Emulator &chip) : chip(chip) {
+        bytes = chip.counters.bytes;
+        transactions = chip.counters.transactions;
+        start = Host::nanos();
+    }
+    
+    // interrupts are measured across the wait for them, their wall time means nothing
+    void print(const char *operation, uint32_t calls = 1, bool interrupt = false) {
+        uint32_t b = chip.counters.bytes - bytes;
+        uint32_t t = chip.counters.transactions - transactions;
+        uint64_t wall = Host::nanos() - start;
+        printf("%-44s %7.1f %5.1f %8.1f ", operation, (double)b / calls, (double)t / calls,
+               (double)b * Host::spiByteNanos() / 1000 / calls);
+        if (interrupt) {
+            printf("%8s\n", "-");
+        }
+        else {
+            printf("%8.1f\n", (double)wall / 1000 / calls);
+        }
+    }
+    
+    MCP2515Emulator &chip;
+};
+
+static void benchmarkSend(void)
+{
+    CANFixture f;
+    CANClass::msgCAN message = CANFixture::frame(0x6A2, 8, 0x10);
+    
+    {
+        Cost cost(f.chip);
+        CAN.send(&message);
+        cost.print("send() 8 bytes, new header");
+    }
+    {
+        Cost cost(f.chip);
+        f.settle();
+        cost.print("  TX interrupt of that frame", 1, true);
+    }
+    message.data[3] ^= 0xFF;
+    {
+        Cost cost(f.chip);
+        CAN.send(&message);
+        cost.print("send() same id, 1 data byte changed");
+    }
+    f.settle();
+    message.data[0] ^= 0xFF;
+    message.data[7] ^= 0xFF;
+    {
+        Cost cost(f.chip);
+        CAN.send(&message);
+        cost.print("send() same id, bytes 0 and 7 changed");
+    }
+    f.settle();
+    {
+        Cost cost(f.chip);
+        CAN.send(&message);
+        cost.print("send() unchanged frame");
+    }
+    f.settle();
+    {
+        CANClass::msgCAN rtr = CANFixture::frame(0x6A1, 0, 0, true);
+        Cost cost(f.chip);
+        CAN.send(&rtr);
+        cost.print("send() remote frame");
+    }
+    f.settle();
+    {
+        CANClass::msgCAN frames[3] = {CANFixture::frame(0x3C8, 8, 0), CANFixture::frame(0x3C0, 8, 0),
+                                      CANFixture::frame(0x290, 8, 0)};
+        for (uint8_t i = 0; i < 3; i++) {
+            CAN.send(&frames[i]);
+        }
+        message.data[1] ^= 0xFF;
+        Cost cost(f.chip);
+        CAN.send(&message);
+        cost.print("send() all buffers busy, queued");
+        Cost update(f.chip);
+        CAN.update();
+        update.print("update() while still busy");
+    }
+}
+
+static void benchmarkRead(void)
+{
+    CANFixture f;
+    CANClass::msgCAN message;
+    CANClass::msgCAN messages[2];
+    uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    
+    // the interrupt handler would take the frames first
+    EIMSK &= ~(1 << MCP2515_INT_NUM);
+    
+    f.chip.receive(0x290, data, 8);
+    f.settle();
+    {
+        Cost cost(f.chip);
+        CAN.ReadFromDevice(&message);
+        cost.print("ReadFromDevice() 8 bytes");
+    }
+    f.chip.receive(0x6A1, data, 2);
+    f.settle();
+    {
+        Cost cost(f.chip);
+        CAN.ReadFromDevice(&message);
+        cost.print("ReadFromDevice() 2 bytes");
+    }
+    {
+        Cost cost(f.chip);
+        CAN.ReadFromDevice(&message);
+        cost.print("ReadFromDevice() nothing waiting");
+    }
+    f.chip.receive(0x290, data, 8);
+    f.chip.receive(0x3C0, data, 8);
+    f.settle();
+    {
+        Cost cost(f.chip);
+        CAN.ReadAllFromDevice(messages);
+        cost.print("ReadAllFromDevice() 2 x 8 bytes", 2);
+    }
+    
+    EIMSK |= (1 << MCP2515_INT_NUM);
+    {
+        Cost cost(f.chip);
+        for (uint8_t i = 0; i < 6; i++) {
+            f.chip.receive(ids[i % 5], data, 8);
+        }
+        f.settle();
+        cost.print("RX interrupt per 8 byte frame", 6, true);
+        while (CAN.available()) {
+            CAN.read(&message);
+        }
+    }
+}
+
+static void benchmarkMode(void)
+{
+    CANFixture f;
+    {
+        Cost cost(f.chip);
+        CAN.SetMode(LISTEN_ONLY_MODE);
+        cost.print("SetMode(LISTEN_ONLY_MODE)");
+    }
+    {
+        Cost cost(f.chip);
+        CAN.SetMode(NORMAL_MODE);
+        cost.print("SetMode(NORMAL_MODE)");
+    }
+}
+
+static void benchmarkFilters(void)
+{
+    CANFixture f;
+    uint16_t filters[6];
+    uint16_t masks[2];
+    
+    CANClass::ComputeFilters(ids, 5, filters, masks);
+    {
+        Cost cost(f.chip);
+        CAN.SetFilters(filters, masks);
+        cost.print("SetFilters()");
+    }
+}
+
+// The CDC's own periodic frames sent unchanged for a minute: the status
+// frame every CDC_STATUS_TX_BASETIME (950 ms) and the SID request every
+// SID_CONTROL_TX_BASETIME (1000 ms). Only the send() calls are counted.
+static void benchmarkRepeatSends(void)
+{
+    CANFixture f;
+    CANClass::msgCAN status = CANFixture::frame(0x3C8, 8, 0xE0);
+    CANClass::msgCAN request = CANFixture::frame(0x345, 8, 0x1F);
+    uint32_t bytes = 0;
+    uint16_t frames = 0;
+    
+    for (uint32_t ms = 0; ms < 60000UL; ms++) {
+        if (ms % 950 == 0 || ms % 1000 == 0) {
+            uint32_t before = f.chip.counters.bytes;
+            if (ms % 950 == 0) {
+                CAN.send(&status);
+                frames++;
+            }
+            if (ms % 1000 == 0) {
+                CAN.send(&request);
+                frames++;
+            }
+            bytes += f.chip.counters.bytes - before;
+        }
+        Host::advanceMicros(1000);
+    }
+    printf("send() repeat 3C8/950 ms + 345/1000 ms: %u frames, %.1f bytes per frame, %u bytes per minute\n",
+           frames, (double)bytes / frames, bytes);
+}
+
+static void benchmarkMonitor(void)
+{
+    CANFixture f;
+    
+    Host::advanceMicros(CAN_ERROR_CHECK_MS * 1000UL);
+    {
+        Cost cost(f.chip);
+        CAN.checkErrors();
+        cost.print("checkErrors() pass");
+    }
+    {
+        Cost cost(f.chip);
+        CAN.checkErrors();
+        cost.print("checkErrors() between passes");
+    }
+    {
+        Cost cost(f.chip);
+        CAN.update();
+        cost.print("update() empty queue");
+    }
+}
+
+int main(void)
+{
+    printf("CAN_TX_CACHE %d\n", CAN_TX_CACHE);
+    printf("%-44s %7s %5s %8s %8s\n", "operation", "bytes", "CS", "SPI us", "wall us");
+    benchmarkSend();
+    benchmarkRead();
+    benchmarkMode();
+    benchmarkFilters();
+    benchmarkMonitor();
+    printf("\n");
+    benchmarkRepeatSends();
+    return 0;
+}
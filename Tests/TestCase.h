@@ -0,0 +1,89 @@
+/*
+ * Minimal checks for the host tests
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef TESTCASE_H
+#define TESTCASE_H
+
+#include <stdio.h>
+#include <string>
+
+/**
+ * Each test program is a list of void functions run with RUN() from main(),
+ * which returns testResult(). A failed CHECK reports and lets the test go
+ * on, so one run shows everything that is off.
+ */
+
+static int testChecksFailed;
+static int testsFailed;
+static int testsRun;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            testChecksFailed++; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { \
+        long long _expected = (long long)(expected); \
+        long long _actual = (long long)(actual); \
+        if (_expected != _actual) { \
+            fprintf(stderr, "%s:%d: CHECK_EQUAL(%s, %s) failed: expected %lld, got %lld\n", \
+                    __FILE__, __LINE__, #expected, #actual, _expected, _actual); \
+            testChecksFailed++; \
+        } \
+    } while (0)
+
+#define CHECK_STRING(expected, actual) \
+    do { \
+        std::string _expected(expected); \
+        std::string _actual(actual); \
+        if (_expected != _actual) { \
+            fprintf(stderr, "%s:%d: CHECK_STRING(%s, %s) failed: expected \"%s\", got \"%s\"\n", \
+                    __FILE__, __LINE__, #expected, #actual, _expected.c_str(), _actual.c_str()); \
+            testChecksFailed++; \
+        } \
+    } while (0)
+
+#define RUN(test)   runTest(test, #test)
+
+static inline void runTest(void (*test)(void), const char *name)
+{
+    int before = testChecksFailed;
+    
+    test();
+    testsRun++;
+    if (testChecksFailed != before) {
+        testsFailed++;
+        fprintf(stderr, "FAIL %s\n", name);
+    }
+}
+
+static inline int testResult(const char *program)
+{
+    printf("%s: %d of %d tests passed\n", program, testsRun - testsFailed, testsRun);
+    return testsFailed ? 1 : 0;
+}
+
+#endif
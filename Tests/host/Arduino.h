@@ -0,0 +1,138 @@
+/*
+ * Host stand-in for the parts of the Arduino core the sketch uses
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH        0x1
+#define LOW         0x0
+#define INPUT       0x0
+#define OUTPUT      0x1
+
+#define A0          14
+#define A1          15
+#define A2          16
+#define A3          17
+
+#define DEC         10
+#define HEX         16
+#define BIN         2
+
+#define NOT_AN_INTERRUPT    -1
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Digital pins are plain levels, analogRead() returns what a test put there
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+class __FlashStringHelper;
+#define F(string)   (reinterpret_cast<const __FlashStringHelper *>(string))
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    
+    size_t print(const __FlashStringHelper *str) { return write((const char *)str); }
+    size_t print(const char *str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    
+    template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    template <typename T> size_t println(T value, int base) { size_t n = print(value, base); return n + println(); }
+    size_t println(void) { return write("\r\n"); }
+    
+    int getWriteError() { return writeError; }
+    void clearWriteError() { writeError = 0; }
+    
+protected:
+    void setWriteError(int error = 1) { writeError = error; }
+    
+private:
+    int writeError = 0;
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+    virtual void flush(void) {}
+};
+
+// Output is collected in output, input is taken from input
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    void end(void) {}
+    size_t write(uint8_t c) { output += (char)c; return 1; }
+    using Print::write;
+    int available(void) { return (int)input.size(); }
+    int read(void);
+    int peek(void) { return input.empty() ? -1 : (uint8_t)input[0]; }
+    operator bool() { return true; }
+    
+    std::string output;
+    std::string input;
+};
+
+extern HardwareSerial Serial;
+
+#define digitalPinToBitMask(pin)        ((uint8_t)1)
+#define digitalPinToPort(pin)           ((uint8_t)1)
+#define portOutputRegister(port)        (&PORTD)
+#define portInputRegister(port)         (&PIND)
+#define digitalPinToPCICR(pin)          (&PCICR)
+#define digitalPinToPCICRbit(pin)       2
+#define digitalPinToPCMSK(pin)          (&PCMSK2)
+#define digitalPinToPCMSKbit(pin)       0
+
+#endif
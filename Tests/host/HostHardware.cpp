@@ -0,0 +1,338 @@
+/*
+ * Host side of the stand-in ATmega328P: clock, SPI bus and external interrupts
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#include <stdio.h>
+#include "HostHardware.h"
+
+volatile uint8_t hostIo[0x100];
+HostSpdr hostSpdr;
+HostSpsr hostSpsr;
+HostEimsk hostEimsk;
+HardwareSerial Serial;
+
+extern "C" void __vector_1(void) __attribute__((weak));
+extern "C" void __vector_2(void) __attribute__((weak));
+
+namespace Host {
+
+static std::vector<SpiDevice *> &devices(void)
+{
+    static std::vector<SpiDevice *> list;
+    return list;
+}
+
+static uint64_t now;
+static uint8_t miso;
+static uint32_t bytes;
+static uint32_t handled;
+static uint32_t collided;
+static bool inInterrupt;
+static uint8_t pins[20];
+static int analogValue[8];
+
+SpiDevice::SpiDevice(volatile uint8_t *csPort, uint8_t csBit) : csPort(csPort), csBit(csBit), selected(false)
+{
+    devices().push_back(this);
+}
+
+SpiDevice::~SpiDevice()
+{
+    for (size_t i = 0; i < devices().size(); i++) {
+        if (devices()[i] == this) {
+            devices().erase(devices().begin() + i);
+            break;
+        }
+    }
+}
+
+void reset(void)
+{
+    SREG = _BV(SREG_I);
+    hostIo[0x3D] = 0;
+    EICRA = 0;
+    miso = 0xFF;
+    bytes = 0;
+    handled = 0;
+    collided = 0;
+    inInterrupt = false;
+    Serial.output.clear();
+    Serial.input.clear();
+}
+
+uint64_t nanos(void)
+{
+    return now;
+}
+
+void advance(uint32_t nanos)
+{
+    now += nanos;
+    for (size_t i = 0; i < devices().size(); i++) {
+        devices()[i]->advanceTo(now);
+    }
+    interrupts();
+}
+
+void advanceMicros(uint32_t us)
+{
+    // in steps, so interrupts come in between as they would
+    while (us) {
+        uint32_t step = (us > 100) ? 100 : us;
+        advance(step * 1000);
+        us -= step;
+    }
+}
+
+uint32_t spiByteNanos(void)
+{
+    static const uint8_t divider[4] = {4, 16, 64, 128};
+    uint32_t clock = F_CPU / divider[SPCR & (_BV(SPR1) | _BV(SPR0))];
+    
+    if (hostIo[0x4D] & _BV(SPI2X)) {
+        clock *= 2;
+    }
+    return 8000000000ULL / clock;
+}
+
+uint32_t spiByteCount(void)
+{
+    return bytes;
+}
+
+void sync(void)
+{
+    for (size_t i = 0; i < devices().size(); i++) {
+        SpiDevice *device = devices()[i];
+        if (device->selected && (*device->csPort & _BV(device->csBit))) {
+            device->selected = false;
+            device->deselect();
+        }
+    }
+}
+
+uint8_t clock(uint8_t mosi)
+{
+    uint8_t result = 0xFF;
+    uint8_t count = 0;
+    
+    sync();
+    for (size_t i = 0; i < devices().size(); i++) {
+        SpiDevice *device = devices()[i];
+        if (!(*device->csPort & _BV(device->csBit))) {
+            if (!device->selected) {
+                device->selected = true;
+                device->select();
+            }
+            result = device->transfer(mosi);
+            count++;
+        }
+    }
+    if (count > 1) {
+        collided++;
+    }
+    bytes++;
+    advance(spiByteNanos());
+    return result;
+}
+
+void interrupts(void)
+{
+    static void (* const vectors[2])(void) = {__vector_1, __vector_2};
+    // INT0 is PD2, INT1 PD3
+    static const uint8_t pin[2] = {2, 3};
+    
+    if (inInterrupt) {
+        return;
+    }
+    sync();
+    
+    uint8_t n = 0;
+    
+    for (uint8_t guard = 0; guard < 100; guard++) {
+        for (n = 0; n < 2; n++) {
+            if (vectors[n] && (SREG & _BV(SREG_I)) && (hostIo[0x3D] & _BV(n)) &&
+                !(EICRA & (0x03 << (2 * n))) && !(PIND & _BV(pin[n]))) {
+                break;
+            }
+        }
+        if (n == 2) {
+            return;
+        }
+        for (size_t i = 0; i < devices().size(); i++) {
+            if (devices()[i]->isSelected()) {
+                collided++;
+            }
+        }
+        // the handler runs with I cleared, reti sets it again
+        inInterrupt = true;
+        SREG &= ~_BV(SREG_I);
+        vectors[n]();
+        SREG |= _BV(SREG_I);
+        inInterrupt = false;
+        handled++;
+    }
+    fprintf(stderr, "INT%d stays low after 100 handler runs\n", n);
+    abort();
+}
+
+uint32_t interruptCount(void)
+{
+    return handled;
+}
+
+uint32_t collisions(void)
+{
+    return collided;
+}
+
+void setAnalog(uint8_t pin, int value)
+{
+    analogValue[pin & 7] = value;
+}
+
+int pinLevel(uint8_t pin)
+{
+    return pins[pin % 20];
+}
+
+void setPinLevel(uint8_t pin, int level)
+{
+    pins[pin % 20] = level;
+}
+
+int analog(uint8_t pin)
+{
+    return analogValue[pin & 7];
+}
+
+}
+
+HostSpdr &HostSpdr::operator=(uint8_t data)
+{
+    Host::miso = Host::clock(data);
+    return *this;
+}
+
+HostSpdr::operator uint8_t() const
+{
+    return Host::miso;
+}
+
+HostSpsr &HostSpsr::operator=(uint8_t data)
+{
+    hostIo[0x4D] = data;
+    return *this;
+}
+
+HostSpsr::operator uint8_t() const
+{
+    // a byte is complete as soon as SPDR is written
+    return hostIo[0x4D] | _BV(SPIF);
+}
+
+HostEimsk &HostEimsk::operator=(uint8_t data)
+{
+    hostIo[0x3D] = data;
+    Host::sync();
+    Host::interrupts();
+    return *this;
+}
+
+unsigned long millis(void)
+{
+    return (unsigned long)(Host::nanos() / 1000000);
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long)(Host::nanos() / 1000);
+}
+
+void delay(unsigned long ms)
+{
+    Host::advanceMicros(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    Host::advanceMicros(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    Host::setPinLevel(pin, value);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return Host::pinLevel(pin);
+}
+
+int analogRead(uint8_t pin)
+{
+    return Host::analog(pin);
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--) {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::print(long n, int base)
+{
+    if (n < 0 && base == DEC) {
+        return print('-') + print((unsigned long)-n, base);
+    }
+    return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    char buffer[8 * sizeof(long) + 1];
+    char *str = &buffer[sizeof(buffer) - 1];
+    
+    *str = '\0';
+    do {
+        char c = n % base;
+        n /= base;
+        *--str = (c < 10) ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(str);
+}
+
+int HardwareSerial::read(void)
+{
+    if (input.empty()) {
+        return -1;
+    }
+    uint8_t c = input[0];
+    input.erase(0, 1);
+    return c;
+}
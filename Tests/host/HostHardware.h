@@ -0,0 +1,100 @@
+/*
+ * Host side of the stand-in ATmega328P: clock, SPI bus and external interrupts
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef HOST_HARDWARE_H
+#define HOST_HARDWARE_H
+
+#include <inttypes.h>
+#include <vector>
+#include <Arduino.h>
+
+namespace Host {
+
+/**
+ * A chip on the SPI bus, selected while its CS pin is low. The host calls
+ * select() on the first byte clocked with CS low, transfer() for every byte
+ * and deselect() as soon as it sees CS high again; a transaction always ends
+ * before the driver restores EIMSK in mcp2515_unselect(), so that is where
+ * the host looks. advanceTo() lets the chip's own clock follow the host's.
+ */
+class SpiDevice
+{
+public:
+    SpiDevice(volatile uint8_t *csPort, uint8_t csBit);
+    virtual ~SpiDevice();
+    
+    bool isSelected(void) const { return selected; }
+    
+    virtual void select(void) {}
+    virtual uint8_t transfer(uint8_t mosi) = 0;
+    virtual void deselect(void) {}
+    virtual void advanceTo(uint64_t nanos) {}
+    
+private:
+    friend void sync(void);
+    friend uint8_t clock(uint8_t mosi);
+    
+    volatile uint8_t *csPort;
+    uint8_t csBit;
+    bool selected;
+};
+
+// Counters back to 0, interrupts enabled but the external ones masked;
+// the clock keeps running and the CS pins stay where they are
+void reset(void);
+
+// Host time in ns; micros() and millis() follow it
+uint64_t nanos(void);
+void advance(uint32_t nanos);
+void advanceMicros(uint32_t us);
+
+// Time one SPI byte takes with the clock SPCR and SPSR set up
+uint32_t spiByteNanos(void);
+uint32_t spiByteCount(void);
+
+// Ends transactions of devices whose CS went high
+void sync(void);
+
+// Clocks a byte out on MOSI, returns MISO; 0xFF with nobody selected
+uint8_t clock(uint8_t mosi);
+
+/**
+ * Runs the INT0/INT1 handlers whose pin is low (level triggered), as long as
+ * SREG and EIMSK allow it. Called after every SPI byte, every EIMSK change
+ * and every advance(), which are the points where the main loop could be
+ * interrupted.
+ */
+void interrupts(void);
+
+// Handlers that ran since reset(); an interrupt while a device had CS low is counted in collisions
+uint32_t interruptCount(void);
+uint32_t collisions(void);
+
+// What digitalRead() and analogRead() return
+int pinLevel(uint8_t pin);
+void setPinLevel(uint8_t pin, int level);
+int analog(uint8_t pin);
+void setAnalog(uint8_t pin, int value);
+
+}
+
+#endif
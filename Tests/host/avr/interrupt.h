@@ -0,0 +1,43 @@
+/*
+ * Host stand-in for <avr/interrupt.h>
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+// External interrupts INT0/INT1 have vectors 1 and 2 on the ATmega328P;
+// HostHardware calls them while their pin is low, see Host::interrupts()
+#define INT0_vect           __vector_1
+#define INT1_vect           __vector_2
+#define PCINT0_vect         __vector_3
+#define PCINT1_vect         __vector_4
+#define PCINT2_vect         __vector_5
+
+#define ISR(vector, ...)    extern "C" void vector(void); void vector(void)
+#define ISR_ALIASOF(vector)
+#define ISR_NOBLOCK
+
+static inline void cli(void) { SREG &= ~_BV(SREG_I); }
+static inline void sei(void) { SREG |= _BV(SREG_I); }
+
+#endif
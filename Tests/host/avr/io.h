@@ -0,0 +1,118 @@
+/*
+ * Host stand-in for <avr/io.h>: the ATmega328P registers the sketch touches
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <inttypes.h>
+
+/*
+ Plain registers live at their data memory address in hostIo[], so the
+ driver's PINx = PORTx - 2 and DDRx = PORTx - 1 arithmetic holds. The ones
+ with side effects on real hardware are objects: writing SPDR clocks a byte
+ through the SPI device whose CS is low, SPSR always reads SPIF, and every
+ change of EIMSK gives pending external interrupts a chance to run, see
+ HostHardware.h.
+ */
+extern volatile uint8_t hostIo[0x100];
+
+class HostSpdr
+{
+public:
+    HostSpdr &operator=(uint8_t data);
+    operator uint8_t() const;
+};
+
+class HostSpsr
+{
+public:
+    HostSpsr &operator=(uint8_t data);
+    operator uint8_t() const;
+};
+
+class HostEimsk
+{
+public:
+    HostEimsk &operator=(uint8_t data);
+    HostEimsk &operator&=(uint8_t data) { return *this = (uint8_t)(hostIo[0x3D] & data); }
+    HostEimsk &operator|=(uint8_t data) { return *this = (uint8_t)(hostIo[0x3D] | data); }
+    operator uint8_t() const { return hostIo[0x3D]; }
+};
+
+extern HostSpdr hostSpdr;
+extern HostSpsr hostSpsr;
+extern HostEimsk hostEimsk;
+
+#define PINB        hostIo[0x23]
+#define DDRB        hostIo[0x24]
+#define PORTB       hostIo[0x25]
+#define PINC        hostIo[0x26]
+#define DDRC        hostIo[0x27]
+#define PORTC       hostIo[0x28]
+#define PIND        hostIo[0x29]
+#define DDRD        hostIo[0x2A]
+#define PORTD       hostIo[0x2B]
+#define EIFR        hostIo[0x3C]
+#define EIMSK       hostEimsk
+#define SPCR        hostIo[0x4C]
+#define SPSR        hostSpsr
+#define SPDR        hostSpdr
+#define SREG        hostIo[0x5F]
+#define PCICR       hostIo[0x68]
+#define EICRA       hostIo[0x69]
+#define PCMSK0      hostIo[0x6B]
+#define PCMSK1      hostIo[0x6C]
+#define PCMSK2      hostIo[0x6D]
+
+// SPCR
+#define SPIE    7
+#define SPE     6
+#define DORD    5
+#define MSTR    4
+#define CPOL    3
+#define CPHA    2
+#define SPR1    1
+#define SPR0    0
+
+// SPSR
+#define SPIF    7
+#define WCOL    6
+#define SPI2X   0
+
+// EIMSK, EIFR, EICRA
+#define INT0    0
+#define INT1    1
+#define INTF0   0
+#define INTF1   1
+#define ISC00   0
+#define ISC01   1
+#define ISC10   2
+#define ISC11   3
+
+// SREG
+#define SREG_I  7
+
+#define _BV(bit)                (1 << (bit))
+#define bit_is_set(sfr, bit)    ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit)  (!((sfr) & _BV(bit)))
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Host stand-in for <avr/pgmspace.h>, flash is ordinary memory here
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <inttypes.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define PGM_P                   const char *
+
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+#define pgm_read_word(address)  (*(const uint16_t *)(address))
+#define pgm_read_ptr(address)   (*(void * const *)(address))
+
+#define memcpy_P                memcpy
+#define strlen_P                strlen
+#define strcmp_P                strcmp
+#define strncmp_P               strncmp
+#define strcpy_P                strcpy
+
+#endif
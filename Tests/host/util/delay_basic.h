@@ -0,0 +1,35 @@
+/*
+ * Host stand-in for <util/delay_basic.h>: a busy loop lets the host clock run
+ * Copyright (C) 2026  Sam Thompson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Created by: Sam Thompson
+ * Created on: October 17, 2026
+ */
+
+#ifndef HOST_UTIL_DELAY_BASIC_H
+#define HOST_UTIL_DELAY_BASIC_H
+
+#include <inttypes.h>
+
+namespace Host {
+    void advance(uint32_t nanos);
+}
+
+// 4 cycles a count at F_CPU, as on the AVR
+static inline void _delay_loop_2(uint16_t count) { Host::advance((uint32_t)(count * 4000000000ULL / F_CPU)); }
+
+#endif